@@ -0,0 +1,184 @@
+/**
+ * Project 2 - Binary Trees
+ * accountcache.cpp
+ * A bounded LRU cache from (username, discriminator) to DNode.
+ */
+
+#include "accountcache.h"
+#include <algorithm>
+
+/**
+ * Creates an empty cache.
+ * @param capacity most entries held at once, 0 for a cache that holds nothing
+ */
+AccountCache::AccountCache(size_t capacity): _slots(capacity) {
+    _freeSlots.reserve(capacity);
+    for (size_t i = capacity; i > 0; i--) {
+        _freeSlots.push_back(static_cast<uint32_t>(i - 1));
+    }
+}
+
+/**
+ * Looks up an account, making it the most recently used on a hit.
+ * @param username username to match
+ * @param disc discriminator to match
+ * @return the cached DNode, nullptr on a miss
+ */
+DNode* AccountCache::find(const string& username, int disc) {
+    auto found = _byUsername.find(username);
+    if (found != _byUsername.end()) {
+        for (uint32_t slot : found->second) {
+            if (_slots[slot].disc == disc) {
+                if (slot != _newest) {
+                    unlink(slot);
+                    link(slot);
+                }
+                _numHits++;
+                return _slots[slot].node;
+            }
+        }
+    }
+    _numMisses++;
+    return nullptr;
+}
+
+/**
+ * Remembers the DNode of an account, evicting the least recently used entry if
+ * the cache is full.
+ * @param username username of the account
+ * @param disc discriminator of the account
+ * @param node DNode holding the account
+ */
+void AccountCache::put(const string& username, int disc, DNode* node) {
+    if (_slots.empty() || node == nullptr) {
+        return;
+    }
+    auto found = _byUsername.find(username);
+    if (found != _byUsername.end()) {
+        for (uint32_t slot : found->second) {
+            if (_slots[slot].disc == disc) {
+                _slots[slot].node = node;
+                return;
+            }
+        }
+    }
+    if (_freeSlots.empty()) {
+        release(_oldest);
+    }
+    uint32_t slot = _freeSlots.back();
+    _freeSlots.pop_back();
+    _slots[slot].username = username;
+    _slots[slot].disc = disc;
+    _slots[slot].node = node;
+    link(slot);
+    _byUsername[username].push_back(slot);
+    _size++;
+}
+
+/**
+ * Forgets one account.
+ * @param username username of the account
+ * @param disc discriminator of the account
+ */
+void AccountCache::erase(const string& username, int disc) {
+    auto found = _byUsername.find(username);
+    if (found == _byUsername.end()) {
+        return;
+    }
+    for (uint32_t slot : found->second) {
+        if (_slots[slot].disc == disc) {
+            release(slot);
+            return;
+        }
+    }
+}
+
+/**
+ * Forgets every account of a username, e.g. before its DTree is rebuilt.
+ * @param username username whose accounts to forget
+ */
+void AccountCache::eraseUsername(const string& username) {
+    auto found = _byUsername.find(username);
+    if (found == _byUsername.end()) {
+        return;
+    }
+    for (uint32_t slot : found->second) {
+        unlink(slot);
+        _slots[slot].node = nullptr;
+        _freeSlots.push_back(slot);
+        _size--;
+    }
+    _byUsername.erase(found);
+}
+
+/**
+ * Forgets every account. The hit and miss counts are kept.
+ */
+void AccountCache::clear() {
+    _byUsername.clear();
+    _freeSlots.clear();
+    for (size_t i = _slots.size(); i > 0; i--) {
+        _slots[i - 1].node = nullptr;
+        _freeSlots.push_back(static_cast<uint32_t>(i - 1));
+    }
+    _newest = NO_SLOT;
+    _oldest = NO_SLOT;
+    _size = 0;
+}
+
+void AccountCache::resetStats() {
+    _numHits = 0;
+    _numMisses = 0;
+}
+
+/**
+ * @return the share of finds that were hits, 0 before the first find
+ */
+double AccountCache::getHitRate() const {
+    uint64_t total = _numHits + _numMisses;
+    return total == 0 ? 0.0 : static_cast<double>(_numHits) / total;
+}
+
+// Makes a slot the most recently used
+void AccountCache::link(uint32_t slot) {
+    _slots[slot].newer = NO_SLOT;
+    _slots[slot].older = _newest;
+    if (_newest != NO_SLOT) {
+        _slots[_newest].newer = slot;
+    }
+    _newest = slot;
+    if (_oldest == NO_SLOT) {
+        _oldest = slot;
+    }
+}
+
+// Takes a slot out of the recency order
+void AccountCache::unlink(uint32_t slot) {
+    Slot& entry = _slots[slot];
+    if (entry.newer != NO_SLOT) {
+        _slots[entry.newer].older = entry.older;
+    }
+    else {
+        _newest = entry.older;
+    }
+    if (entry.older != NO_SLOT) {
+        _slots[entry.older].newer = entry.newer;
+    }
+    else {
+        _oldest = entry.newer;
+    }
+}
+
+// Frees one slot in use and drops it from its username's list
+void AccountCache::release(uint32_t slot) {
+    unlink(slot);
+    auto found = _byUsername.find(_slots[slot].username);
+    vector<uint32_t>& slots = found->second;
+    slots.erase(std::find(slots.begin(), slots.end(), slot));
+    if (slots.empty()) {
+        _byUsername.erase(found);
+    }
+    _slots[slot].node = nullptr;
+    _freeSlots.push_back(slot);
+    _size--;
+}
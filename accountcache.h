@@ -0,0 +1,66 @@
+/**
+ * Project 2 - Binary Trees
+ * accountcache.h
+ * An interface for the AccountCache class, a bounded LRU cache of account lookups.
+ */
+
+#pragma once
+
+#include "dtree.h"
+#include <unordered_map>
+#include <cstdint>
+
+#define DEFAULT_CACHE_CAPACITY 1024     //accounts an AccountCache holds unless told otherwise
+
+/**
+ * The DNodes of the most recently looked up accounts, keyed by (username,
+ * discriminator), so a lookup of a hot account is one hash probe instead of a
+ * descent through both trees. Once full, a new entry evicts the least recently
+ * used one. Entries are grouped per username, so all of a username's entries can
+ * be dropped at once when its DTree is rebuilt.
+ *
+ * The cache only remembers pointers: whoever owns the DNodes has to erase an
+ * entry before its DNode is freed, reused or made vacant. UTree::enableCache
+ * sets one up in front of UTree::retrieveUser.
+ */
+class AccountCache {
+public:
+    AccountCache(size_t capacity = DEFAULT_CACHE_CAPACITY);
+
+    DNode* find(const string& username, int disc);
+    void put(const string& username, int disc, DNode* node);
+    void erase(const string& username, int disc);
+    void eraseUsername(const string& username);
+    void clear();
+    void resetStats();
+
+    /* Getters */
+    size_t getCapacity() const {return _slots.size();}
+    size_t getSize() const {return _size;}
+    uint64_t getNumHits() const {return _numHits;}
+    uint64_t getNumMisses() const {return _numMisses;}
+    double getHitRate() const;
+
+private:
+    struct Slot {
+        string username;
+        int disc = INVALID_DISC;
+        DNode* node = nullptr;
+        uint32_t newer = NO_SLOT;   //neighbours in recency order
+        uint32_t older = NO_SLOT;
+    };
+    static const uint32_t NO_SLOT = UINT32_MAX;
+
+    vector<Slot> _slots;
+    std::unordered_map<string, vector<uint32_t>> _byUsername;  //slots in use per username
+    vector<uint32_t> _freeSlots;
+    uint32_t _newest = NO_SLOT;
+    uint32_t _oldest = NO_SLOT;
+    size_t _size = 0;
+    uint64_t _numHits = 0;
+    uint64_t _numMisses = 0;
+
+    void link(uint32_t slot);
+    void unlink(uint32_t slot);
+    void release(uint32_t slot);
+};
@@ -0,0 +1,853 @@
+/**
+ * Project 2 - Binary Trees
+ * bench.cpp
+ * Throughput benchmarks for the account loaders and trees.
+ * Usage: ./bench [numLines] [scratch file]
+ */
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include "dtree.h"
+#include "utree.h"
+#include "csvloader.h"
+#include "journal.h"
+#include "checkpoint.h"
+#include "columnar.h"
+#include "treeworker.h"
+#include "bitmapindex.h"
+#include "query.h"
+#include "discindex.h"
+#include "mappedtree.h"
+#include "streamloader.h"
+#include <map>
+#include <mutex>
+#include <thread>
+
+using std::cout, std::endl, std::string;
+
+#define DEFAULT_BENCH_LINES 4000000
+#define DEFAULT_BENCH_FILE "bench_accounts.csv"
+
+static const char* BADGES[] = {"Early Supporter", "Bug Hunter", "HypeSquad", "Partner", "Staff", "None"};
+static const char* STATUSES[] = {"online", "offline", "idle", "dnd"};
+
+// Seconds elapsed since start
+double secondsSince(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Writes numLines random accounts spread over numLines / 8 usernames
+void writeAccounts(const string& path, long numLines) {
+    std::ofstream out(path);
+    long numNames = numLines / 8 + 1;
+    unsigned int seed = 221;
+    for (long i = 0; i < numLines; i++) {
+        seed = seed * 1103515245 + 12345;
+        long name = (seed >> 8) % numNames;
+        out << "user" << name << ',' << (seed >> 4) % (MAX_DISC + 1) << ',' << (seed & 1) << ','
+            << BADGES[(seed >> 12) % 6] << ',' << STATUSES[(seed >> 16) % 4] << '\n';
+    }
+}
+
+// The tokenizing loop UTree::loadData used before the mapped scanner
+long legacyParse(const string& path) {
+    std::ifstream instream(path);
+    string line;
+    string fields[CSV_NUM_FIELDS];
+    long checksum = 0;
+    while (std::getline(instream, line)) {
+        std::stringstream buffer(line);
+        int delimCount = 0;
+        for (unsigned int c = 0; c < buffer.str().length(); c++) if (buffer.str()[c] == CSV_DELIM) delimCount++;
+        if (delimCount != CSV_NUM_FIELDS - 1) {
+            throw std::invalid_argument("Malformed input file detected");
+        }
+        for (int i = 0; i < CSV_NUM_FIELDS; i++) {
+            std::getline(buffer, line, CSV_DELIM);
+            fields[i] = line;
+        }
+        checksum += std::stoi(fields[1]) + std::stoi(fields[2]) + fields[0].size();
+    }
+    return checksum;
+}
+
+long mappedParse(const string& path) {
+    MappedFile file;
+    if (!file.open(path)) {
+        throw std::runtime_error("could not map " + path);
+    }
+    CSVScanner scanner(file.getView());
+    RecordView record;
+    long checksum = 0;
+    while (scanner.next(record)) {
+        checksum += record.disc + record.nitro + record.username.size();
+    }
+    return checksum;
+}
+
+void benchParse(const string& path, long numLines) {
+    auto start = std::chrono::steady_clock::now();
+    long legacy = legacyParse(path);
+    double legacySec = secondsSince(start);
+
+    cout << "parse " << numLines << " lines" << endl;
+    cout << "\tgetline/stringstream: " << legacySec << " s (" << numLines / legacySec / 1e6 << " M lines/s)" << endl;
+
+    const CSVScanMode modes[] = {SCAN_SCALAR, SCAN_SSE2, SCAN_AVX2};
+    for (CSVScanMode mode : modes) {
+        if (!setCSVScanMode(mode)) {
+            continue;
+        }
+        start = std::chrono::steady_clock::now();
+        long mapped = mappedParse(path);
+        double mappedSec = secondsSince(start);
+        cout << "\tmmap/" << std::left << std::setw(15) << getCSVScanMode() << mappedSec << " s ("
+             << numLines / mappedSec / 1e6 << " M lines/s, " << legacySec / mappedSec << "x)"
+             << (legacy == mapped ? "" : " CHECKSUM MISMATCH") << endl;
+    }
+    setCSVScanMode(SCAN_AUTO);
+}
+
+// Full load through the sort-then-bulk-build path of loadData
+void benchBulkLoad(const string& path, long numLines) {
+    UTree tree;
+    auto start = std::chrono::steady_clock::now();
+    tree.loadData(path, false);
+    double loadSec = secondsSince(start);
+    cout << "bulk loadData " << numLines << " lines: " << loadSec << " s ("
+         << numLines / loadSec / 1e6 << " M lines/s)" << endl;
+
+    UTree lazy;
+    start = std::chrono::steady_clock::now();
+    lazy.loadDataLazy(path);
+    double lazySec = secondsSince(start);
+    size_t numUsernames = lazy.getNumLazy();
+    //touch one username in a hundred
+    start = std::chrono::steady_clock::now();
+    for (long i = 0; i < numLines / 8; i += 100) {
+        lazy.retrieveUser("user" + std::to_string(i), 0);
+    }
+    double touchSec = secondsSince(start);
+    cout << "\tloadDataLazy: " << lazySec << " s (" << loadSec / lazySec << "x), then " << touchSec
+         << " s to build " << numUsernames - lazy.getNumLazy() << " of " << numUsernames << " DTrees" << endl;
+}
+
+// Appending a file through loadData's insert per line against StreamLoader's insertBatch per batch
+void benchStreamLoader(const string& path, long numLines) {
+    //one account already there keeps loadData off its bulk path
+    UTree inserted;
+    inserted.insert(Account("seed", 0, false, "None", "online"));
+    auto start = std::chrono::steady_clock::now();
+    inserted.loadData(path, true);
+    double insertSec = secondsSince(start);
+
+    UTree streamed;
+    streamed.insert(Account("seed", 0, false, "None", "online"));
+    StreamLoader loader(streamed);
+    start = std::chrono::steady_clock::now();
+    bool loaded = loader.loadFile(path);
+    double streamSec = secondsSince(start);
+
+    cout << "append " << numLines << " lines: loadData " << insertSec << " s, StreamLoader " << streamSec << " s ("
+         << insertSec / streamSec << "x, " << loader.getNumInserted() << " inserted)" << (loaded ? "" : " LOAD FAILED") << endl;
+}
+
+// Restart cost: bulk parse of the .csv against a binary snapshot of the same tree
+void benchSnapshot(const string& path, long numLines) {
+    UTree tree;
+    tree.loadData(path, false);
+    string snapshot = path + ".snap";
+
+    auto start = std::chrono::steady_clock::now();
+    tree.saveSnapshot(snapshot);
+    double saveSec = secondsSince(start);
+
+    UTree restored;
+    start = std::chrono::steady_clock::now();
+    bool loaded = restored.loadSnapshot(snapshot);
+    double loadSec = secondsSince(start);
+
+    std::ifstream csv(path, std::ios::ate | std::ios::binary);
+    std::ifstream snap(snapshot, std::ios::ate | std::ios::binary);
+    cout << "snapshot of " << numLines << " lines: " << snap.tellg() << " bytes (csv " << csv.tellg() << ")" << endl;
+    cout << "\tsave: " << saveSec << " s, load: " << loadSec << " s" << (loaded ? "" : " LOAD FAILED") << endl;
+    std::remove(snapshot.c_str());
+}
+
+// Restarting from a tree file against loading a snapshot: opening maps the file, and lookups page in what they touch
+void benchMappedTree(const string& path, long numLines) {
+    UTree tree;
+    tree.loadData(path, false);
+    string snapshot = path + ".snap";
+    string treeFile = path + ".map";
+    std::remove(treeFile.c_str());
+
+    auto start = std::chrono::steady_clock::now();
+    bool imported = false;
+    {
+        MappedUTree mapped;
+        imported = mapped.open(treeFile) && mapped.importTree(tree) && mapped.sync();
+    }
+    double importSec = secondsSince(start);
+    tree.saveSnapshot(snapshot);
+
+    UTree restored;
+    start = std::chrono::steady_clock::now();
+    restored.loadSnapshot(snapshot);
+    double snapshotSec = secondsSince(start);
+
+    MappedUTree mapped;
+    start = std::chrono::steady_clock::now();
+    bool opened = mapped.open(treeFile);
+    double openSec = secondsSince(start);
+
+    //every tenth account writeAccounts wrote, in the order it wrote them
+    vector<std::pair<string, int>> keys;
+    long numNames = numLines / 8 + 1;
+    unsigned int seed = 221;
+    for (long i = 0; i < numLines; i++) {
+        seed = seed * 1103515245 + 12345;
+        if (i % 10 == 0) {
+            keys.emplace_back("user" + std::to_string((seed >> 8) % numNames), (seed >> 4) % (MAX_DISC + 1));
+        }
+    }
+    vector<bool> found(keys.size());
+    start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < keys.size(); i++) {
+        Account account;
+        found[i] = mapped.retrieveUser(keys[i].first, keys[i].second, account);
+    }
+    double lookupSec = secondsSince(start);
+    long mismatches = 0;
+    for (size_t i = 0; i < keys.size(); i++) {
+        mismatches += found[i] != (tree.retrieveUser(keys[i].first, keys[i].second) != nullptr);
+    }
+
+    std::ifstream file(treeFile, std::ios::ate | std::ios::binary);
+    cout << "tree file of " << numLines << " lines: " << file.tellg() << " bytes, imported in " << importSec << " s"
+         << (imported ? "" : " IMPORT FAILED") << endl;
+    cout << "\trestart: open " << openSec * 1e3 << " ms, loadSnapshot " << snapshotSec * 1e3 << " ms; then "
+         << keys.size() << " lookups in " << lookupSec * 1e3 << " ms" << (opened && mismatches == 0 ? "" : " RESULT MISMATCH") << endl;
+    mapped.close();
+    std::remove(treeFile.c_str());
+    std::remove(snapshot.c_str());
+}
+
+// Writer pause of a blocking snapshot against a forked one, with writes running during the fork's save
+void benchCheckpoint(const string& path, long numLines) {
+    UTree tree;
+    tree.loadData(path, false);
+    string snapshot = path + ".snap";
+
+    auto start = std::chrono::steady_clock::now();
+    tree.saveSnapshot(snapshot);
+    double blockingSec = secondsSince(start);
+
+    BackgroundCheckpoint checkpoint;
+    checkpoint.start(tree, snapshot);
+    long writes = 0;
+    while (!checkpoint.poll()) {
+        tree.insert(Account("checkpoint" + std::to_string(writes % 64), writes / 64 * 7919 % (MAX_DISC + 1), true, "badge", "online"));
+        writes++;
+    }
+    CheckpointStats stats = checkpoint.getStats();
+    cout << "checkpoint of " << numLines << " lines: blocking save paused writes " << blockingSec * 1e3 << " ms" << endl;
+    cout << "\tforked: paused " << stats.pauseMicros / 1e3 << " ms, child " << stats.childMicros / 1e3 << " ms, "
+         << writes << " inserts meanwhile, " << stats.cowBytes / 1024 << " KiB copied"
+         << (stats.succeeded ? "" : " FAILED") << endl;
+    std::remove(snapshot.c_str());
+}
+
+// printUsers against buffered exports of the same tree, all written to /dev/null
+void benchExport(const string& path, long numLines) {
+    UTree tree;
+    tree.loadData(path, false);
+    std::ofstream sink("/dev/null");
+
+    std::streambuf* saved = cout.rdbuf(sink.rdbuf());
+    auto start = std::chrono::steady_clock::now();
+    tree.printUsers();
+    double printSec = secondsSince(start);
+    cout.rdbuf(saved);
+    cout << "export of " << numLines << " lines: printUsers " << printSec << " s" << endl;
+
+    const char* names[] = {"csv", "jsonl"};
+    for (int f = 0; f < 2; f++) {
+        for (unsigned int threads : {1u, 0u}) {
+            start = std::chrono::steady_clock::now();
+            tree.exportAccounts(sink, static_cast<ExportFormat>(f), threads);
+            double exportSec = secondsSince(start);
+            cout << "\t" << names[f] << (threads == 1 ? ", 1 thread: " : ", all threads: ") << exportSec << " s ("
+                 << printSec / exportSec << "x)" << endl;
+        }
+    }
+    string columnar = path + ".col";
+    start = std::chrono::steady_clock::now();
+    tree.exportColumnar(columnar);
+    double columnarSec = secondsSince(start);
+
+    //a scan that only needs the nitro column
+    start = std::chrono::steady_clock::now();
+    ColumnarReader reader;
+    reader.open(columnar);
+    long numNitro = 0;
+    for (size_t g = 0; g < reader.getNumRowGroups(); g++) {
+        string_view bitmap = reader.getColumn(g, COLUMN_NITRO);
+        for (char byte : bitmap) {
+            numNitro += __builtin_popcount(static_cast<unsigned char>(byte));
+        }
+    }
+    double scanSec = secondsSince(start);
+    std::ifstream file(columnar, std::ios::ate | std::ios::binary);
+    cout << "\tcolumnar: " << columnarSec << " s, " << file.tellg() << " bytes; nitro scan " << scanSec * 1e3
+         << " ms (" << numNitro << " with nitro)" << endl;
+    std::remove(columnar.c_str());
+}
+
+// Per-account insert against insertBatch of the same accounts into a loaded tree
+void benchInsertBatch(const string& path, long numLines) {
+    vector<Account> accounts;
+    unsigned int seed = 977;
+    for (long i = 0; i < numLines / 4; i++) {
+        seed = seed * 1103515245 + 12345;
+        accounts.emplace_back("user" + std::to_string((seed >> 8) % (numLines / 8 + 1)), (seed >> 4) % (MAX_DISC + 1),
+                              seed & 1, BADGES[(seed >> 12) % 6], STATUSES[(seed >> 16) % 4]);
+    }
+    UTree single;
+    single.loadData(path, false);
+    auto start = std::chrono::steady_clock::now();
+    for (const Account& account : accounts) {
+        single.insert(account);
+    }
+    double singleSec = secondsSince(start);
+
+    UTree batched;
+    batched.loadData(path, false);
+    start = std::chrono::steady_clock::now();
+    batched.insertBatch(vector<Account>(accounts));
+    double batchSec = secondsSince(start);
+    cout << "insert " << accounts.size() << " accounts: one by one " << singleSec << " s, insertBatch " << batchSec
+         << " s (" << singleSec / batchSec << "x)" << endl;
+}
+
+// Per-key removeUser against removeBatch of the same keys, then removeIf on a status
+void benchRemoveBatch(const string& path, long numLines) {
+    //replay writeAccounts' generator so every key exists
+    vector<std::pair<string, int>> keys;
+    long numNames = numLines / 8 + 1;
+    unsigned int seed = 221;
+    for (long i = 0; i < numLines; i++) {
+        seed = seed * 1103515245 + 12345;
+        if (i % 10 == 0) {
+            keys.emplace_back("user" + std::to_string((seed >> 8) % numNames), (seed >> 4) % (MAX_DISC + 1));
+        }
+    }
+    UTree single;
+    single.loadData(path, false);
+    auto start = std::chrono::steady_clock::now();
+    for (const auto& key : keys) {
+        DNode* removed = nullptr;
+        single.removeUser(key.first, key.second, removed);
+    }
+    double singleSec = secondsSince(start);
+
+    UTree batched;
+    batched.loadData(path, false);
+    start = std::chrono::steady_clock::now();
+    size_t numRemoved = batched.removeBatch(keys).size();
+    double batchSec = secondsSince(start);
+    start = std::chrono::steady_clock::now();
+    size_t numIdle = batched.removeIf([](const Account& account) {
+        return account.getStatus() == "idle";
+    }).size();
+    double predicateSec = secondsSince(start);
+    cout << "remove " << numRemoved << " accounts: one by one " << singleSec << " s, removeBatch " << batchSec
+         << " s (" << singleSec / batchSec << "x); removeIf idle: " << numIdle << " in " << predicateSec << " s" << endl;
+}
+
+// A loop of retrieveUser against retrieveMany on the same keys, about half of them present
+void benchRetrieveMany(const string& path, long numLines) {
+    UTree tree;
+    tree.loadData(path, false);
+    vector<std::pair<string, int>> keys;
+    long numNames = numLines / 8 + 1;
+    unsigned int seed = 221;
+    for (long i = 0; i < numLines; i++) {
+        seed = seed * 1103515245 + 12345;
+        int disc = (i % 2 == 0) ? (seed >> 4) % (MAX_DISC + 1) : (seed >> 3) % (MAX_DISC + 1);
+        keys.emplace_back("user" + std::to_string((seed >> 8) % numNames), disc);
+    }
+    //lookups arrive in no particular order
+    for (size_t i = keys.size() - 1; i > 0; i--) {
+        seed = seed * 1103515245 + 12345;
+        std::swap(keys[i], keys[(seed >> 4) % (i + 1)]);
+    }
+
+    vector<DNode*> single(keys.size());
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < keys.size(); i++) {
+        single[i] = tree.retrieveUser(keys[i].first, keys[i].second);
+    }
+    double singleSec = secondsSince(start);
+
+    start = std::chrono::steady_clock::now();
+    vector<DNode*> many = tree.retrieveMany(keys);
+    double manySec = secondsSince(start);
+    cout << "lookup " << keys.size() << " keys: retrieveUser loop " << keys.size() / singleSec / 1e6
+         << " M/s, retrieveMany " << keys.size() / manySec / 1e6 << " M/s (" << singleSec / manySec << "x)"
+         << (single == many ? "" : " RESULT MISMATCH") << endl;
+}
+
+// A mass status change on a tenth of the accounts: removeUser then insert, update one by one, and updateBatch
+void benchUpdate(const string& path) {
+    vector<Account> changes;
+    {
+        UTree tree;
+        tree.loadData(path, false);
+        vector<Account> accounts = tree.retrievePrefix("");
+        unsigned int seed = 613;
+        for (Account& account : accounts) {
+            seed = seed * 1103515245 + 12345;
+            if ((seed >> 8) % 10 == 0) {
+                account.setStatus("offline");
+                changes.push_back(account);
+            }
+        }
+        //requests arrive in no particular order
+        for (size_t i = changes.size(); i > 1; i--) {
+            seed = seed * 1103515245 + 12345;
+            std::swap(changes[i - 1], changes[(seed >> 4) % i]);
+        }
+    }
+
+    UTree reinserted;
+    reinserted.loadData(path, false);
+    auto start = std::chrono::steady_clock::now();
+    for (const Account& account : changes) {
+        DNode* removed = nullptr;
+        if (reinserted.removeUser(account.getUsername(), account.getDiscriminator(), removed)) {
+            reinserted.insert(account);
+        }
+    }
+    double reinsertSec = secondsSince(start);
+
+    UTree single;
+    single.loadData(path, false);
+    start = std::chrono::steady_clock::now();
+    for (const Account& account : changes) {
+        single.update(account, UPDATE_STATUS);
+    }
+    double singleSec = secondsSince(start);
+
+    UTree batched;
+    batched.loadData(path, false);
+    start = std::chrono::steady_clock::now();
+    batched.updateBatch(changes, UPDATE_STATUS);
+    double batchSec = secondsSince(start);
+    cout << "set status of " << changes.size() << " accounts: remove and insert " << reinsertSec << " s, update "
+         << singleSec << " s (" << reinsertSec / singleSec << "x), updateBatch " << batchSec << " s ("
+         << reinsertSec / batchSec << "x)" << endl;
+}
+
+// retrieveUser on a skewed workload, nine of ten lookups on a few hundred hot accounts, without and with the cache
+void benchAccountCache(const string& path, long numLines) {
+    UTree tree;
+    tree.loadData(path, false);
+    vector<Account> accounts = tree.retrievePrefix("");
+    if (accounts.empty()) {
+        return;
+    }
+    const size_t numHot = 512;
+    vector<std::pair<string, int>> keys;
+    unsigned int seed = 977;
+    for (long i = 0; i < numLines; i++) {
+        seed = seed * 1103515245 + 12345;
+        size_t pick = (seed >> 8) % accounts.size();
+        if ((seed >> 4) % 10 != 0) {
+            pick = pick % numHot * (accounts.size() / numHot);
+        }
+        keys.emplace_back(accounts[pick].getUsername(), accounts[pick].getDiscriminator());
+    }
+
+    vector<DNode*> plain(keys.size());
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < keys.size(); i++) {
+        plain[i] = tree.retrieveUser(keys[i].first, keys[i].second);
+    }
+    double plainSec = secondsSince(start);
+
+    tree.enableCache(DEFAULT_CACHE_CAPACITY);
+    vector<DNode*> cached(keys.size());
+    start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < keys.size(); i++) {
+        cached[i] = tree.retrieveUser(keys[i].first, keys[i].second);
+    }
+    double cachedSec = secondsSince(start);
+    cout << "skewed lookup " << keys.size() << " keys: retrieveUser " << keys.size() / plainSec / 1e6
+         << " M/s, with cache " << keys.size() / cachedSec / 1e6 << " M/s (" << plainSec / cachedSec << "x, "
+         << tree.getCache()->getHitRate() * 100 << "% hits)" << (plain == cached ? "" : " RESULT MISMATCH") << endl;
+}
+
+// numUsers where four of five usernames are missing, e.g. availability checks, without and with the username filter
+void benchUsernameFilter(const string& path, long numLines) {
+    UTree tree;
+    tree.loadData(path, false);
+    long numNames = numLines / 8 + 1;
+    vector<string> usernames;
+    unsigned int seed = 419;
+    for (long i = 0; i < numLines; i++) {
+        seed = seed * 1103515245 + 12345;
+        long id = (seed >> 8) % numNames;
+        usernames.push_back((seed >> 4) % 5 == 0 ? "user" + std::to_string(id) : "taken" + std::to_string(id));
+    }
+
+    long plainFound = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (const string& username : usernames) {
+        plainFound += tree.numUsers(username);
+    }
+    double plainSec = secondsSince(start);
+
+    auto buildStart = std::chrono::steady_clock::now();
+    tree.enableUsernameFilter();
+    double buildSec = secondsSince(buildStart);
+    long filteredFound = 0;
+    start = std::chrono::steady_clock::now();
+    for (const string& username : usernames) {
+        filteredFound += tree.numUsers(username);
+    }
+    double filteredSec = secondsSince(start);
+    const UsernameFilter* filter = tree.getUsernameFilter();
+    cout << "numUsers " << usernames.size() << " names, 80% missing: plain " << usernames.size() / plainSec / 1e6
+         << " M/s, filtered " << usernames.size() / filteredSec / 1e6 << " M/s (" << plainSec / filteredSec << "x); filter of "
+         << filter->getNumUsernames() << " names " << filter->getMemoryBytes() / 1024 << " KiB built in " << buildSec * 1e3 << " ms"
+         << (plainFound == filteredFound ? "" : " RESULT MISMATCH") << endl;
+}
+
+// retrieve on present usernames in random order through the AVL descent and through the B+ tree index
+void benchUsernameIndex(const string& path, long numLines) {
+    UTree tree;
+    tree.loadData(path, false);
+    long numNames = numLines / 8 + 1;
+    vector<string> usernames;
+    unsigned int seed = 733;
+    for (long i = 0; i < numLines; i++) {
+        seed = seed * 1103515245 + 12345;
+        usernames.push_back("user" + std::to_string((seed >> 8) % numNames));
+    }
+
+    long avlFound = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (const string& username : usernames) {
+        avlFound += (tree.retrieve(username) != nullptr);
+    }
+    double avlSec = secondsSince(start);
+    cout << "retrieve " << usernames.size() << " names: AVL " << usernames.size() / avlSec / 1e6 << " M/s" << endl;
+
+    for (bool compress : {false, true}) {
+        auto buildStart = std::chrono::steady_clock::now();
+        tree.enableUsernameIndex(compress);
+        double buildSec = secondsSince(buildStart);
+        long indexFound = 0;
+        start = std::chrono::steady_clock::now();
+        for (const string& username : usernames) {
+            indexFound += (tree.retrieve(username) != nullptr);
+        }
+        double indexSec = secondsSince(start);
+        const UsernameIndex* index = tree.getUsernameIndex();
+        cout << "\tB+ tree" << (compress ? ", prefix compressed: " : ": ") << usernames.size() / indexSec / 1e6 << " M/s ("
+             << avlSec / indexSec << "x), height " << index->getHeight() << ", " << index->getMemoryBytes() / 1024
+             << " KiB, built in " << buildSec * 1e3 << " ms" << (avlFound == indexFound ? "" : " RESULT MISMATCH") << endl;
+    }
+}
+
+// DTree lookups on usernames with thousands of discriminators, walking the DNodes against the frozen array
+void benchFreeze(long numLines) {
+    const int numUsernames = 64;
+    long perUsername = std::min<long>(numLines / numUsernames, MAX_DISC + 1);
+    UTree tree;
+    //interleaved random inserts scatter each DTree's DNodes over the heap, as a live tree's are
+    unsigned int seed = 887;
+    for (long i = 0; i < perUsername * numUsernames; i++) {
+        seed = seed * 1103515245 + 12345;
+        tree.insert(Account("celebrity" + std::to_string(i % numUsernames), (seed >> 8) % (MAX_DISC + 1), false, "None", "online"));
+    }
+    vector<DTree*> dtrees;
+    for (int u = 0; u < numUsernames; u++) {
+        dtrees.push_back(tree.retrieve("celebrity" + std::to_string(u))->getDTree());
+    }
+    vector<std::pair<int, int>> lookups;
+    for (long i = 0; i < numLines; i++) {
+        seed = seed * 1103515245 + 12345;
+        lookups.emplace_back((seed >> 4) % numUsernames, (seed >> 8) % (MAX_DISC + 1));
+    }
+
+    vector<DNode*> walked(lookups.size());
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < lookups.size(); i++) {
+        walked[i] = dtrees[lookups[i].first]->retrieve(lookups[i].second);
+    }
+    double walkSec = secondsSince(start);
+
+    start = std::chrono::steady_clock::now();
+    size_t numFrozen = tree.freezeDTrees();
+    double freezeSec = secondsSince(start);
+    vector<DNode*> frozen(lookups.size());
+    start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < lookups.size(); i++) {
+        frozen[i] = dtrees[lookups[i].first]->retrieve(lookups[i].second);
+    }
+    double frozenSec = secondsSince(start);
+    cout << "DTree lookup " << lookups.size() << " keys over " << numFrozen << " DTrees of about " << dtrees[0]->getNumUsers()
+         << ": DNodes " << lookups.size() / walkSec / 1e6 << " M/s, frozen " << lookups.size() / frozenSec / 1e6 << " M/s ("
+         << walkSec / frozenSec << "x), froze in " << freezeSec * 1e3 << " ms" << (walked == frozen ? "" : " RESULT MISMATCH") << endl;
+}
+
+// Several client threads sending a mix of inserts and lookups, each call under one mutex against pipelined through a TreeWorker
+void benchTreeWorker(const string& path, long numLines) {
+    const int numClients = 4;
+    long numOps = numLines / numClients;
+    long numNames = numLines / 8 + 1;
+    auto makeOp = [&](int client, long i, string& username, int& disc) {
+        unsigned int seed = (client * numOps + i) * 2654435761u;
+        username = "user" + std::to_string((seed >> 8) % numNames);
+        disc = (seed >> 4) % (MAX_DISC + 1);
+        return i % 4 == 0;  //every fourth op is an insert
+    };
+
+    UTree locked;
+    locked.loadData(path, false);
+    std::mutex mutex;
+    auto start = std::chrono::steady_clock::now();
+    vector<std::thread> clients;
+    for (int c = 0; c < numClients; c++) {
+        clients.emplace_back([&, c]() {
+            string username;
+            int disc;
+            for (long i = 0; i < numOps; i++) {
+                bool isInsert = makeOp(c, i, username, disc);
+                std::lock_guard<std::mutex> lock(mutex);
+                if (isInsert) {
+                    locked.insert(Account(username, disc, false, "None", "online"));
+                }
+                else {
+                    locked.retrieveUser(username, disc);
+                }
+            }
+        });
+    }
+    for (std::thread& client : clients) {
+        client.join();
+    }
+    double lockedSec = secondsSince(start);
+
+    UTree owned;
+    owned.loadData(path, false);
+    TreeWorker worker(owned);
+    worker.start();
+    std::atomic<long> numDone(0);
+    start = std::chrono::steady_clock::now();
+    clients.clear();
+    for (int c = 0; c < numClients; c++) {
+        clients.emplace_back([&, c]() {
+            string username;
+            int disc;
+            auto done = [&](const CommandResult&) {
+                numDone.fetch_add(1, std::memory_order_relaxed);
+            };
+            for (long i = 0; i < numOps; i++) {
+                if (makeOp(c, i, username, disc)) {
+                    worker.insert(Account(username, disc, false, "None", "online"), done);
+                }
+                else {
+                    worker.retrieve(username, disc, done);
+                }
+            }
+        });
+    }
+    for (std::thread& client : clients) {
+        client.join();
+    }
+    worker.stop();
+    double workerSec = secondsSince(start);
+    long total = numOps * numClients;
+    cout << numClients << " clients, " << total << " ops: mutex " << total / lockedSec / 1e6 << " M/s, TreeWorker "
+         << total / workerSec / 1e6 << " M/s (" << lockedSec / workerSec << "x, " << worker.getNumBatches()
+         << " batches)" << (numDone.load() == total ? "" : " LOST COMMANDS") << endl;
+}
+
+// Counting nitro accounts with a badge by walking every account against the bitmap indexes
+void benchBitmapIndex(const string& path) {
+    UTree plain;
+    auto start = std::chrono::steady_clock::now();
+    plain.loadData(path, false);
+    double plainLoadSec = secondsSince(start);
+    UTree tree;
+    BitmapIndex index;
+    tree.addObserver(&index);
+    start = std::chrono::steady_clock::now();
+    tree.loadData(path, false);
+    double indexedLoadSec = secondsSince(start);
+
+    start = std::chrono::steady_clock::now();
+    long walked = 0;
+    for (const Account& account : tree.retrievePrefix("")) {
+        walked += (account.hasNitro() && account.getBadge() == "Staff") ? 1 : 0;
+    }
+    double walkSec = secondsSince(start);
+
+    const int numQueries = 100;
+    uint64_t counted = 0;
+    start = std::chrono::steady_clock::now();
+    for (int q = 0; q < numQueries; q++) {
+        counted = index.getNitro().andCardinality(index.getBadge("Staff"));
+    }
+    double countSec = secondsSince(start) / numQueries;
+    start = std::chrono::steady_clock::now();
+    uint64_t combined = 0;
+    for (int q = 0; q < numQueries; q++) {
+        combined = (((index.getBadge("Staff") | index.getBadge("Partner")) & index.getStatus("online")) - index.getNitro())
+                   .getCardinality();
+    }
+    double combinedSec = secondsSince(start) / numQueries;
+    size_t bytes = index.getAll().getMemoryBytes() + index.getNitro().getMemoryBytes();
+    for (const string& badge : index.getBadges()) {
+        bytes += index.getBadge(badge).getMemoryBytes();
+    }
+    for (const string& status : index.getStatuses()) {
+        bytes += index.getStatus(status).getMemoryBytes();
+    }
+    cout << "nitro and Staff: walk " << walkSec * 1e3 << " ms, bitmap " << countSec * 1e6 << " us ("
+         << walkSec / countSec << "x)" << (static_cast<uint64_t>(walked) == counted ? "" : " RESULT MISMATCH")
+         << "; (Staff or Partner) and online and not nitro " << combinedSec * 1e6 << " us for " << combined
+         << "; load " << plainLoadSec << " s -> " << indexedLoadSec << " s with the index, bitmaps "
+         << bytes / 1024 << " KiB" << endl;
+}
+
+// "count by status where nitro and disc < 1000" by walking every account against a Query over AccountColumns
+void benchQuery(const string& path) {
+    UTree tree;
+    AccountColumns columns;
+    tree.addObserver(&columns);
+    tree.loadData(path, false);
+
+    auto start = std::chrono::steady_clock::now();
+    std::map<string, uint64_t> walked;
+    for (const Account& account : tree.retrievePrefix("")) {
+        if (account.hasNitro() && account.getDiscriminator() < 1000) {
+            walked[account.getStatus()]++;
+        }
+    }
+    double walkSec = secondsSince(start);
+
+    Query query;
+    query.parse("count by status where nitro and disc < 1000");
+    const int numQueries = 20;
+    vector<QueryRow> rows;
+    start = std::chrono::steady_clock::now();
+    for (int q = 0; q < numQueries; q++) {
+        rows = query.run(columns);
+    }
+    double querySec = secondsSince(start) / numQueries;
+    bool same = rows.size() == walked.size();
+    for (const QueryRow& row : rows) {
+        same = same && walked[row.group] == row.count;
+    }
+    query.parse("max disc by badge where status = 'idle' or not (nitro or disc > 9000)");
+    start = std::chrono::steady_clock::now();
+    for (int q = 0; q < numQueries; q++) {
+        query.run(columns);
+    }
+    double complexSec = secondsSince(start) / numQueries;
+    cout << "count by status where nitro and disc < 1000 over " << columns.getNumAccounts() << " accounts: walk "
+         << walkSec * 1e3 << " ms, query " << querySec * 1e3 << " ms (" << walkSec / querySec << "x)"
+         << (same ? "" : " RESULT MISMATCH") << "; a four-comparison max by badge " << complexSec * 1e3 << " ms" << endl;
+}
+
+// Usernames holding one discriminator, by walking every account against the DiscIndex
+void benchDiscIndex(const string& path) {
+    UTree tree;
+    DiscIndex index;
+    tree.addObserver(&index);
+    tree.loadData(path, false);
+
+    auto start = std::chrono::steady_clock::now();
+    vector<string> walked;
+    for (const Account& account : tree.retrievePrefix("")) {
+        if (account.getDiscriminator() == 1337) {
+            walked.push_back(account.getUsername());
+        }
+    }
+    double walkSec = secondsSince(start);
+
+    const int numQueries = 1000;
+    vector<string> found;
+    start = std::chrono::steady_clock::now();
+    for (int q = 0; q < numQueries; q++) {
+        found = index.getUsernames(1337);
+    }
+    double indexSec = secondsSince(start) / numQueries;
+    cout << "usernames with disc 1337 (" << found.size() << "): walk " << walkSec * 1e3 << " ms, DiscIndex "
+         << indexSec * 1e6 << " us (" << walkSec / indexSec << "x)" << (walked == found ? "" : " RESULT MISMATCH") << endl;
+}
+
+// Insert throughput with the journal attached under each sync policy
+void benchJournal(const string& path) {
+    const SyncPolicy policies[] = {SYNC_ALWAYS, SYNC_GROUP, SYNC_NONE};
+    const char* names[] = {"always", "group", "none"};
+    const long counts[] = {2000, 200000, 200000};
+    string journalPath = path + ".journal";
+    cout << "journaled inserts" << endl;
+    for (int p = 0; p < 3; p++) {
+        std::remove(journalPath.c_str());
+        UTree tree;
+        Journal journal;
+        journal.open(journalPath, policies[p]);
+        tree.addObserver(&journal);
+        auto start = std::chrono::steady_clock::now();
+        for (long i = 0; i < counts[p]; i++) {
+            tree.insert(Account("user" + std::to_string(i % 64), i / 64 * 7919 % (MAX_DISC + 1), i & 1, "badge", "online"));
+        }
+        journal.commit();
+        double seconds = secondsSince(start);
+        cout << "\t" << std::left << std::setw(8) << names[p] << counts[p] / seconds << " ops/s, "
+             << journal.getNumSyncs() << " fsyncs for " << journal.getNumRecords() << " records" << endl;
+    }
+    std::remove(journalPath.c_str());
+}
+
+int main(int argc, char** argv) {
+    long numLines = (argc > 1) ? std::atol(argv[1]) : DEFAULT_BENCH_LINES;
+    string path = (argc > 2) ? argv[2] : DEFAULT_BENCH_FILE;
+
+    writeAccounts(path, numLines);
+    benchParse(path, numLines);
+    benchBulkLoad(path, numLines);
+    benchStreamLoader(path, numLines);
+    benchSnapshot(path, numLines);
+    benchMappedTree(path, numLines);
+    benchCheckpoint(path, numLines);
+    benchExport(path, numLines);
+    benchInsertBatch(path, numLines);
+    benchRemoveBatch(path, numLines);
+    benchUpdate(path);
+    benchRetrieveMany(path, numLines);
+    benchAccountCache(path, numLines);
+    benchUsernameFilter(path, numLines);
+    benchUsernameIndex(path, numLines);
+    benchFreeze(numLines);
+    benchTreeWorker(path, numLines);
+    benchBitmapIndex(path);
+    benchQuery(path);
+    benchDiscIndex(path);
+    benchJournal(path);
+
+    std::remove(path.c_str());
+    return 0;
+}
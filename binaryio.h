@@ -0,0 +1,180 @@
+/**
+ * Project 2 - Binary Trees
+ * binaryio.h
+ * Helpers for the binary file formats: little-endian integers, varints and CRC-32.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <unordered_map>
+
+using std::string;
+
+/* Appends value as a LEB128 varint, 7 bits per byte */
+inline void putVarint(string& out, uint64_t value) {
+    char bytes[10];
+    int count = 0;
+    while (value >= 0x80) {
+        bytes[count++] = static_cast<char>(value | 0x80);
+        value >>= 7;
+    }
+    bytes[count++] = static_cast<char>(value);
+    out.append(bytes, count);
+}
+
+/* Reads a varint and advances cursor, false if the buffer ends first or the value is too long */
+inline bool getVarint(const char*& cursor, const char* end, uint64_t& value) {
+    value = 0;
+    for (int shift = 0; shift < 64 && cursor < end; shift += 7) {
+        uint8_t byte = static_cast<uint8_t>(*cursor++);
+        value |= static_cast<uint64_t>(byte & 0x7f) << shift;
+        if ((byte & 0x80) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+inline void putFixed16(string& out, uint16_t value) {
+    char bytes[2] = {static_cast<char>(value), static_cast<char>(value >> 8)};
+    out.append(bytes, 2);
+}
+
+inline void putFixed32(string& out, uint32_t value) {
+    char bytes[4] = {static_cast<char>(value), static_cast<char>(value >> 8),
+                     static_cast<char>(value >> 16), static_cast<char>(value >> 24)};
+    out.append(bytes, 4);
+}
+
+inline void putFixed64(string& out, uint64_t value) {
+    putFixed32(out, static_cast<uint32_t>(value));
+    putFixed32(out, static_cast<uint32_t>(value >> 32));
+}
+
+inline uint16_t getFixed16(const char* bytes) {
+    const uint8_t* b = reinterpret_cast<const uint8_t*>(bytes);
+    return static_cast<uint16_t>(b[0] | b[1] << 8);
+}
+
+inline uint32_t getFixed32(const char* bytes) {
+    const uint8_t* b = reinterpret_cast<const uint8_t*>(bytes);
+    return static_cast<uint32_t>(b[0]) | static_cast<uint32_t>(b[1]) << 8
+         | static_cast<uint32_t>(b[2]) << 16 | static_cast<uint32_t>(b[3]) << 24;
+}
+
+inline uint64_t getFixed64(const char* bytes) {
+    return static_cast<uint64_t>(getFixed32(bytes)) | static_cast<uint64_t>(getFixed32(bytes + 4)) << 32;
+}
+
+/* Appends a varint length followed by the bytes of text */
+inline void putString(string& out, const string& text) {
+    putVarint(out, text.size());
+    out.append(text);
+}
+
+inline bool getString(const char*& cursor, const char* end, string& text) {
+    uint64_t length;
+    if (!getVarint(cursor, end, length) || length > static_cast<uint64_t>(end - cursor)) {
+        return false;
+    }
+    text.assign(cursor, length);
+    cursor += length;
+    return true;
+}
+
+/* Assigns dense codes to distinct strings in order of first use */
+class StringDictionary {
+public:
+    uint64_t encode(const string& text) {
+        auto found = _codes.emplace(text, _values.size());
+        if (found.second) {
+            _values.push_back(text);
+        }
+        return found.first->second;
+    }
+    bool find(const string& text, uint64_t& code) const {
+        auto found = _codes.find(text);
+        if (found == _codes.end()) {
+            return false;
+        }
+        code = found->second;
+        return true;
+    }
+    void clear() {
+        _codes.clear();
+        _values.clear();
+    }
+    const std::vector<string>& getValues() const {return _values;}
+    void write(string& out) const {
+        putVarint(out, _values.size());
+        for (const string& value : _values) {
+            putString(out, value);
+        }
+    }
+
+private:
+    std::unordered_map<string, uint64_t> _codes;
+    std::vector<string> _values;
+};
+
+/* Reads a dictionary written by StringDictionary::write */
+inline bool readDictionary(const char*& cursor, const char* end, std::vector<string>& values) {
+    uint64_t count;
+    if (!getVarint(cursor, end, count) || count > static_cast<uint64_t>(end - cursor)) {
+        return false;
+    }
+    values.resize(count);
+    for (string& value : values) {
+        if (!getString(cursor, end, value)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/* Lookup tables for crc32, four bytes per step */
+struct CRC32Table {
+    uint32_t entries[4][256];
+
+    CRC32Table() {
+        for (uint32_t i = 0; i < 256; i++) {
+            uint32_t value = i;
+            for (int bit = 0; bit < 8; bit++) {
+                value = (value & 1) ? (value >> 1) ^ 0xEDB88320u : value >> 1;
+            }
+            entries[0][i] = value;
+        }
+        for (uint32_t i = 0; i < 256; i++) {
+            for (int t = 1; t < 4; t++) {
+                entries[t][i] = (entries[t - 1][i] >> 8) ^ entries[0][entries[t - 1][i] & 0xff];
+            }
+        }
+    }
+};
+
+/**
+ * CRC-32 (the zlib/PNG polynomial) of a buffer.
+ * Pass the previous result as crc to checksum a buffer in pieces.
+ */
+inline uint32_t crc32(const char* data, size_t length, uint32_t crc = 0) {
+    static const CRC32Table tables;
+    const uint32_t (*table)[256] = tables.entries;
+    const uint8_t* bytes = reinterpret_cast<const uint8_t*>(data);
+    crc = ~crc;
+    while (length >= 4) {
+        crc ^= static_cast<uint32_t>(bytes[0]) | static_cast<uint32_t>(bytes[1]) << 8
+             | static_cast<uint32_t>(bytes[2]) << 16 | static_cast<uint32_t>(bytes[3]) << 24;
+        crc = table[3][crc & 0xff] ^ table[2][(crc >> 8) & 0xff] ^ table[1][(crc >> 16) & 0xff] ^ table[0][crc >> 24];
+        bytes += 4;
+        length -= 4;
+    }
+    while (length-- > 0) {
+        crc = (crc >> 8) ^ table[0][(crc ^ *bytes++) & 0xff];
+    }
+    return ~crc;
+}
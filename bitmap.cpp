@@ -0,0 +1,401 @@
+/**
+ * Project 2 - Binary Trees
+ * bitmap.cpp
+ * A compressed set of 32-bit ids with array and bitset containers.
+ */
+
+#include "bitmap.h"
+#include <algorithm>
+#include <iterator>
+
+bool Bitmap::Container::contains(uint16_t low) const {
+    if (isBits()) {
+        return (bits[low >> 6] >> (low & 63)) & 1;
+    }
+    return std::binary_search(values.begin(), values.end(), low);
+}
+
+void Bitmap::Container::toBits() {
+    bits.assign(BITMAP_CONTAINER_WORDS, 0);
+    for (uint16_t low : values) {
+        bits[low >> 6] |= 1ull << (low & 63);
+    }
+    vector<uint16_t>().swap(values);
+}
+
+void Bitmap::Container::toArray() {
+    values.clear();
+    values.reserve(cardinality);
+    for (size_t w = 0; w < BITMAP_CONTAINER_WORDS; w++) {
+        for (uint64_t word = bits[w]; word != 0; word &= word - 1) {
+            values.push_back(static_cast<uint16_t>(w * 64 + __builtin_ctzll(word)));
+        }
+    }
+    vector<uint64_t>().swap(bits);
+}
+
+// Picks the smaller representation for the current cardinality
+void Bitmap::Container::normalize() {
+    if (isBits() && cardinality <= BITMAP_ARRAY_MAX) {
+        toArray();
+    }
+    else if (!isBits() && cardinality > BITMAP_ARRAY_MAX) {
+        toBits();
+    }
+}
+
+// Index of the first container whose key is not less than key
+size_t Bitmap::findContainer(uint16_t key) const {
+    return std::lower_bound(_containers.begin(), _containers.end(), key,
+        [](const Container& container, uint16_t k) {
+            return container.key < k;
+        }) - _containers.begin();
+}
+
+/**
+ * Adds an id to the set.
+ * @param id id to add
+ * @return true if the id was added, false if it was already present
+ */
+bool Bitmap::add(uint32_t id) {
+    uint16_t key = id >> 16;
+    uint16_t low = id & 0xffff;
+    size_t index = findContainer(key);
+    if (index == _containers.size() || _containers[index].key != key) {
+        Container container;
+        container.key = key;
+        _containers.insert(_containers.begin() + index, std::move(container));
+    }
+    Container& container = _containers[index];
+    if (container.isBits()) {
+        uint64_t& word = container.bits[low >> 6];
+        uint64_t mask = 1ull << (low & 63);
+        if (word & mask) {
+            return false;
+        }
+        word |= mask;
+    }
+    else {
+        auto position = std::lower_bound(container.values.begin(), container.values.end(), low);
+        if (position != container.values.end() && *position == low) {
+            return false;
+        }
+        container.values.insert(position, low);
+    }
+    container.cardinality++;
+    _cardinality++;
+    container.normalize();
+    return true;
+}
+
+/**
+ * Removes an id from the set, dropping its container once empty.
+ * @param id id to remove
+ * @return true if the id was removed, false if it was not present
+ */
+bool Bitmap::remove(uint32_t id) {
+    uint16_t key = id >> 16;
+    uint16_t low = id & 0xffff;
+    size_t index = findContainer(key);
+    if (index == _containers.size() || _containers[index].key != key) {
+        return false;
+    }
+    Container& container = _containers[index];
+    if (container.isBits()) {
+        uint64_t& word = container.bits[low >> 6];
+        uint64_t mask = 1ull << (low & 63);
+        if ((word & mask) == 0) {
+            return false;
+        }
+        word &= ~mask;
+    }
+    else {
+        auto position = std::lower_bound(container.values.begin(), container.values.end(), low);
+        if (position == container.values.end() || *position != low) {
+            return false;
+        }
+        container.values.erase(position);
+    }
+    container.cardinality--;
+    _cardinality--;
+    if (container.cardinality == 0) {
+        _containers.erase(_containers.begin() + index);
+    }
+    else {
+        container.normalize();
+    }
+    return true;
+}
+
+bool Bitmap::contains(uint32_t id) const {
+    size_t index = findContainer(id >> 16);
+    return index < _containers.size() && _containers[index].key == (id >> 16)
+        && _containers[index].contains(id & 0xffff);
+}
+
+void Bitmap::clear() {
+    _containers.clear();
+    _cardinality = 0;
+}
+
+/* Visits every id in increasing order */
+void Bitmap::forEach(const std::function<void(uint32_t)>& visit) const {
+    for (const Container& container : _containers) {
+        uint32_t high = static_cast<uint32_t>(container.key) << 16;
+        if (container.isBits()) {
+            for (size_t w = 0; w < BITMAP_CONTAINER_WORDS; w++) {
+                for (uint64_t word = container.bits[w]; word != 0; word &= word - 1) {
+                    visit(high | static_cast<uint32_t>(w * 64 + __builtin_ctzll(word)));
+                }
+            }
+        }
+        else {
+            for (uint16_t low : container.values) {
+                visit(high | low);
+            }
+        }
+    }
+}
+
+vector<uint32_t> Bitmap::toVector() const {
+    vector<uint32_t> ids;
+    ids.reserve(_cardinality);
+    forEach([&](uint32_t id) {
+        ids.push_back(id);
+    });
+    return ids;
+}
+
+/* Bytes held by the containers, not counting the Bitmap itself */
+size_t Bitmap::getMemoryBytes() const {
+    size_t bytes = _containers.capacity() * sizeof(Container);
+    for (const Container& container : _containers) {
+        bytes += container.values.capacity() * sizeof(uint16_t) + container.bits.capacity() * sizeof(uint64_t);
+    }
+    return bytes;
+}
+
+Bitmap::Container Bitmap::intersect(const Container& a, const Container& b) {
+    Container result;
+    result.key = a.key;
+    if (a.isBits() && b.isBits()) {
+        result.bits.resize(BITMAP_CONTAINER_WORDS);
+        for (size_t w = 0; w < BITMAP_CONTAINER_WORDS; w++) {
+            result.bits[w] = a.bits[w] & b.bits[w];
+            result.cardinality += __builtin_popcountll(result.bits[w]);
+        }
+        result.normalize();
+    }
+    else if (a.isBits() || b.isBits()) {
+        const Container& array = a.isBits() ? b : a;
+        const Container& bits = a.isBits() ? a : b;
+        for (uint16_t low : array.values) {
+            if (bits.contains(low)) {
+                result.values.push_back(low);
+            }
+        }
+        result.cardinality = result.values.size();
+    }
+    else {
+        std::set_intersection(a.values.begin(), a.values.end(), b.values.begin(), b.values.end(),
+                              std::back_inserter(result.values));
+        result.cardinality = result.values.size();
+    }
+    return result;
+}
+
+Bitmap::Container Bitmap::unite(const Container& a, const Container& b) {
+    Container result;
+    result.key = a.key;
+    if (a.isBits() || b.isBits()) {
+        const Container& bits = a.isBits() ? a : b;
+        const Container& other = a.isBits() ? b : a;
+        result.bits = bits.bits;
+        if (other.isBits()) {
+            for (size_t w = 0; w < BITMAP_CONTAINER_WORDS; w++) {
+                result.bits[w] |= other.bits[w];
+            }
+        }
+        else {
+            for (uint16_t low : other.values) {
+                result.bits[low >> 6] |= 1ull << (low & 63);
+            }
+        }
+        for (uint64_t word : result.bits) {
+            result.cardinality += __builtin_popcountll(word);
+        }
+    }
+    else {
+        std::set_union(a.values.begin(), a.values.end(), b.values.begin(), b.values.end(),
+                       std::back_inserter(result.values));
+        result.cardinality = result.values.size();
+        result.normalize();
+    }
+    return result;
+}
+
+Bitmap::Container Bitmap::subtract(const Container& a, const Container& b) {
+    Container result;
+    result.key = a.key;
+    if (a.isBits()) {
+        result.bits = a.bits;
+        if (b.isBits()) {
+            for (size_t w = 0; w < BITMAP_CONTAINER_WORDS; w++) {
+                result.bits[w] &= ~b.bits[w];
+            }
+        }
+        else {
+            for (uint16_t low : b.values) {
+                result.bits[low >> 6] &= ~(1ull << (low & 63));
+            }
+        }
+        for (uint64_t word : result.bits) {
+            result.cardinality += __builtin_popcountll(word);
+        }
+        result.normalize();
+    }
+    else if (b.isBits()) {
+        for (uint16_t low : a.values) {
+            if (!b.contains(low)) {
+                result.values.push_back(low);
+            }
+        }
+        result.cardinality = result.values.size();
+    }
+    else {
+        std::set_difference(a.values.begin(), a.values.end(), b.values.begin(), b.values.end(),
+                            std::back_inserter(result.values));
+        result.cardinality = result.values.size();
+    }
+    return result;
+}
+
+uint32_t Bitmap::intersectCount(const Container& a, const Container& b) {
+    uint32_t count = 0;
+    if (a.isBits() && b.isBits()) {
+        for (size_t w = 0; w < BITMAP_CONTAINER_WORDS; w++) {
+            count += __builtin_popcountll(a.bits[w] & b.bits[w]);
+        }
+    }
+    else if (a.isBits() || b.isBits()) {
+        const Container& array = a.isBits() ? b : a;
+        const Container& bits = a.isBits() ? a : b;
+        for (uint16_t low : array.values) {
+            count += bits.contains(low) ? 1 : 0;
+        }
+    }
+    else {
+        auto x = a.values.begin();
+        auto y = b.values.begin();
+        while (x != a.values.end() && y != b.values.end()) {
+            if (*x < *y) {
+                x++;
+            }
+            else if (*y < *x) {
+                y++;
+            }
+            else {
+                count++;
+                x++;
+                y++;
+            }
+        }
+    }
+    return count;
+}
+
+/**
+ * Ids present in both sets. Only containers whose keys match are combined.
+ * @param other set to intersect with
+ * @return the intersection
+ */
+Bitmap Bitmap::operator&(const Bitmap& other) const {
+    Bitmap result;
+    size_t i = 0;
+    size_t j = 0;
+    while (i < _containers.size() && j < other._containers.size()) {
+        if (_containers[i].key < other._containers[j].key) {
+            i++;
+        }
+        else if (other._containers[j].key < _containers[i].key) {
+            j++;
+        }
+        else {
+            Container container = intersect(_containers[i++], other._containers[j++]);
+            if (container.cardinality > 0) {
+                result._cardinality += container.cardinality;
+                result._containers.push_back(std::move(container));
+            }
+        }
+    }
+    return result;
+}
+
+/**
+ * Ids present in either set.
+ * @param other set to unite with
+ * @return the union
+ */
+Bitmap Bitmap::operator|(const Bitmap& other) const {
+    Bitmap result;
+    size_t i = 0;
+    size_t j = 0;
+    while (i < _containers.size() || j < other._containers.size()) {
+        if (j == other._containers.size() || (i < _containers.size() && _containers[i].key < other._containers[j].key)) {
+            result._containers.push_back(_containers[i++]);
+        }
+        else if (i == _containers.size() || other._containers[j].key < _containers[i].key) {
+            result._containers.push_back(other._containers[j++]);
+        }
+        else {
+            result._containers.push_back(unite(_containers[i++], other._containers[j++]));
+        }
+        result._cardinality += result._containers.back().cardinality;
+    }
+    return result;
+}
+
+/**
+ * Ids present in this set but not in other.
+ * @param other ids to leave out
+ * @return the difference
+ */
+Bitmap Bitmap::operator-(const Bitmap& other) const {
+    Bitmap result;
+    size_t j = 0;
+    for (const Container& container : _containers) {
+        while (j < other._containers.size() && other._containers[j].key < container.key) {
+            j++;
+        }
+        Container difference = (j < other._containers.size() && other._containers[j].key == container.key)
+                             ? subtract(container, other._containers[j]) : container;
+        if (difference.cardinality > 0) {
+            result._cardinality += difference.cardinality;
+            result._containers.push_back(std::move(difference));
+        }
+    }
+    return result;
+}
+
+/**
+ * Size of the intersection, counted without building it.
+ * @param other set to intersect with
+ * @return number of ids present in both sets
+ */
+uint64_t Bitmap::andCardinality(const Bitmap& other) const {
+    uint64_t count = 0;
+    size_t i = 0;
+    size_t j = 0;
+    while (i < _containers.size() && j < other._containers.size()) {
+        if (_containers[i].key < other._containers[j].key) {
+            i++;
+        }
+        else if (other._containers[j].key < _containers[i].key) {
+            j++;
+        }
+        else {
+            count += intersectCount(_containers[i++], other._containers[j++]);
+        }
+    }
+    return count;
+}
@@ -0,0 +1,71 @@
+/**
+ * Project 2 - Binary Trees
+ * bitmap.h
+ * An interface for the Bitmap class, a compressed set of 32-bit ids.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <functional>
+#include <vector>
+
+using std::vector;
+
+#define BITMAP_ARRAY_MAX 4096           //values a container keeps as a sorted array before switching to bits
+#define BITMAP_CONTAINER_WORDS 1024     //64-bit words in a bits container, one bit per low 16-bit value
+
+/**
+ * Set of 32-bit ids in the style of a Roaring bitmap. Ids are split by their high
+ * 16 bits into containers; a container holding few ids stores their low 16 bits
+ * as a sorted array, one holding more than BITMAP_ARRAY_MAX stores a 8 KiB
+ * bitset. Sparse sets then cost about two bytes per id, dense ones an eighth of
+ * a byte, and &, | and - combine matching containers with merges or word-wide
+ * bit operations.
+ */
+class Bitmap {
+public:
+    Bitmap(): _cardinality(0) {}
+
+    bool add(uint32_t id);
+    bool remove(uint32_t id);
+    bool contains(uint32_t id) const;
+    void clear();
+    void forEach(const std::function<void(uint32_t)>& visit) const;
+    vector<uint32_t> toVector() const;
+
+    Bitmap operator&(const Bitmap& other) const;
+    Bitmap operator|(const Bitmap& other) const;
+    Bitmap operator-(const Bitmap& other) const;
+    uint64_t andCardinality(const Bitmap& other) const;
+
+    /* Getters */
+    uint64_t getCardinality() const {return _cardinality;}
+    bool isEmpty() const {return _cardinality == 0;}
+    size_t getNumContainers() const {return _containers.size();}
+    size_t getMemoryBytes() const;
+
+private:
+    struct Container {
+        uint16_t key = 0;               //high 16 bits of every id in the container
+        uint32_t cardinality = 0;
+        vector<uint16_t> values;        //sorted low bits, while an array container
+        vector<uint64_t> bits;          //BITMAP_CONTAINER_WORDS words, once a bits container
+
+        bool isBits() const {return !bits.empty();}
+        bool contains(uint16_t low) const;
+        void toBits();
+        void toArray();
+        void normalize();
+    };
+
+    vector<Container> _containers;      //sorted by key
+    uint64_t _cardinality;
+
+    size_t findContainer(uint16_t key) const;
+    static Container intersect(const Container& a, const Container& b);
+    static Container unite(const Container& a, const Container& b);
+    static Container subtract(const Container& a, const Container& b);
+    static uint32_t intersectCount(const Container& a, const Container& b);
+};
@@ -0,0 +1,171 @@
+/**
+ * Project 2 - Binary Trees
+ * bitmapindex.cpp
+ * Secondary bitmap indexes on nitro, badge and status, kept up to date as an observer.
+ */
+
+#include "bitmapindex.h"
+#include <algorithm>
+
+// Clears an id from the bitmap of a value, dropping the bitmap once empty
+static void removeFrom(std::unordered_map<string, Bitmap>& bitmaps, const string& value, uint32_t id) {
+    auto found = bitmaps.find(value);
+    if (found != bitmaps.end()) {
+        found->second.remove(id);
+        if (found->second.isEmpty()) {
+            bitmaps.erase(found);
+        }
+    }
+}
+
+// Sorted keys of a map of bitmaps
+static vector<string> valuesOf(const std::unordered_map<string, Bitmap>& bitmaps) {
+    vector<string> values;
+    for (const auto& entry : bitmaps) {
+        values.push_back(entry.first);
+    }
+    std::sort(values.begin(), values.end());
+    return values;
+}
+
+/**
+ * Gives a new account an id and sets it in the bitmaps of its fields.
+ * @param account account the UTree inserted
+ */
+void BitmapIndex::accountInserted(const Account& account) {
+    std::pair<string, int> key(account.getUsername(), account.getDiscriminator());
+    uint32_t id;
+    if (!_freeIds.empty()) {
+        id = _freeIds.back();
+        _freeIds.pop_back();
+        _keys[id] = key;
+    }
+    else {
+        id = static_cast<uint32_t>(_keys.size());
+        _keys.push_back(key);
+    }
+    if (!_ids.emplace(std::move(key), id).second) {
+        //already indexed, the tree never inserts a key twice
+        _freeIds.push_back(id);
+        return;
+    }
+    _all.add(id);
+    if (account.hasNitro()) {
+        _nitro.add(id);
+    }
+    _badges[account.getBadge()].add(id);
+    _statuses[account.getStatus()].add(id);
+}
+
+/**
+ * Clears a removed account from the bitmaps and frees its id.
+ * @param account account the UTree removed
+ */
+void BitmapIndex::accountRemoved(const Account& account) {
+    auto found = _ids.find(std::make_pair(account.getUsername(), account.getDiscriminator()));
+    if (found == _ids.end()) {
+        return;
+    }
+    uint32_t id = found->second;
+    _ids.erase(found);
+    _all.remove(id);
+    _nitro.remove(id);
+    removeFrom(_badges, account.getBadge(), id);
+    removeFrom(_statuses, account.getStatus(), id);
+    _keys[id] = std::pair<string, int>();
+    _freeIds.push_back(id);
+}
+
+/**
+ * Moves an updated account's id between the bitmaps of the values that changed,
+ * keeping the id.
+ * @param before account as it was
+ * @param after account as it is now, with the same key
+ */
+void BitmapIndex::accountUpdated(const Account& before, const Account& after) {
+    auto found = _ids.find(std::make_pair(after.getUsername(), after.getDiscriminator()));
+    if (found == _ids.end()) {
+        return;
+    }
+    uint32_t id = found->second;
+    if (after.hasNitro()) {
+        _nitro.add(id);
+    }
+    else {
+        _nitro.remove(id);
+    }
+    if (before.getBadge() != after.getBadge()) {
+        removeFrom(_badges, before.getBadge(), id);
+        _badges[after.getBadge()].add(id);
+    }
+    if (before.getStatus() != after.getStatus()) {
+        removeFrom(_statuses, before.getStatus(), id);
+        _statuses[after.getStatus()].add(id);
+    }
+}
+
+void BitmapIndex::treeCleared() {
+    _ids.clear();
+    _keys.clear();
+    _freeIds.clear();
+    _all.clear();
+    _nitro.clear();
+    _badges.clear();
+    _statuses.clear();
+}
+
+/**
+ * Returns the ids of the accounts with a badge.
+ * @param badge badge to match
+ * @return the bitmap, empty if no account has the badge
+ */
+const Bitmap& BitmapIndex::getBadge(const string& badge) const {
+    static const Bitmap empty;
+    auto found = _badges.find(badge);
+    return (found != _badges.end()) ? found->second : empty;
+}
+
+const Bitmap& BitmapIndex::getStatus(const string& status) const {
+    static const Bitmap empty;
+    auto found = _statuses.find(status);
+    return (found != _statuses.end()) ? found->second : empty;
+}
+
+vector<string> BitmapIndex::getBadges() const {
+    return valuesOf(_badges);
+}
+
+vector<string> BitmapIndex::getStatuses() const {
+    return valuesOf(_statuses);
+}
+
+/**
+ * Looks up the id of an account.
+ * @param username username of the account
+ * @param disc discriminator of the account
+ * @param id set to the id if found
+ * @return true if the account is indexed, false otherwise
+ */
+bool BitmapIndex::findId(const string& username, int disc, uint32_t& id) const {
+    auto found = _ids.find(std::make_pair(username, disc));
+    if (found == _ids.end()) {
+        return false;
+    }
+    id = found->second;
+    return true;
+}
+
+/**
+ * Turns a query result back into account keys, which retrieveUser or
+ * retrieveMany can then look up.
+ * @param ids ids from the bitmaps of this index
+ * @return (username, discriminator) of each id, in id order
+ */
+vector<std::pair<string, int>> BitmapIndex::getKeys(const Bitmap& ids) const {
+    vector<std::pair<string, int>> keys;
+    keys.reserve(ids.getCardinality());
+    ids.forEach([&](uint32_t id) {
+        keys.push_back(_keys[id]);
+    });
+    return keys;
+}
@@ -0,0 +1,53 @@
+/**
+ * Project 2 - Binary Trees
+ * bitmapindex.h
+ * An interface for the BitmapIndex class, secondary indexes on nitro, badge and status.
+ */
+
+#pragma once
+
+#include "utree.h"
+#include "bitmap.h"
+#include <unordered_map>
+
+/**
+ * Secondary indexes over the accounts of a UTree. Attached as an observer, it
+ * gives every account a dense id and keeps one Bitmap of ids for nitro, for each
+ * badge and for each status, so questions like "how many nitro accounts have
+ * badge X" are a bitmap AND and a popcount instead of a walk over the tree:
+ *
+ *     index.getNitro().andCardinality(index.getBadge("Staff"));
+ *     index.getKeys(index.getStatus("idle") - index.getNitro());
+ *
+ * Ids freed by removals are handed out again, which keeps the bitmaps dense.
+ */
+class BitmapIndex : public UTreeObserver {
+public:
+    /* UTreeObserver */
+    void accountInserted(const Account& account) override;
+    void accountRemoved(const Account& account) override;
+    void accountUpdated(const Account& before, const Account& after) override;
+    void treeCleared() override;
+
+    const Bitmap& getBadge(const string& badge) const;
+    const Bitmap& getStatus(const string& status) const;
+    vector<string> getBadges() const;
+    vector<string> getStatuses() const;
+    bool findId(const string& username, int disc, uint32_t& id) const;
+    vector<std::pair<string, int>> getKeys(const Bitmap& ids) const;
+
+    /* Getters */
+    const Bitmap& getAll() const {return _all;}
+    const Bitmap& getNitro() const {return _nitro;}
+    const std::pair<string, int>& getKey(uint32_t id) const {return _keys[id];}
+    size_t getNumAccounts() const {return _all.getCardinality();}
+
+private:
+    std::unordered_map<std::pair<string, int>, uint32_t, AccountKeyHash> _ids;
+    vector<std::pair<string, int>> _keys;   //(username, discriminator) of each id in use
+    vector<uint32_t> _freeIds;
+    Bitmap _all;
+    Bitmap _nitro;
+    std::unordered_map<string, Bitmap> _badges;
+    std::unordered_map<string, Bitmap> _statuses;
+};
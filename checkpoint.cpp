@@ -0,0 +1,137 @@
+/**
+ * Project 2 - Binary Trees
+ * checkpoint.cpp
+ * Implementation for the BackgroundCheckpoint class.
+ */
+
+#include "checkpoint.h"
+#include <cerrno>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <sys/wait.h>
+#include <unistd.h>
+
+/* Sent from the child to the parent when the snapshot is written */
+struct ChildReport {
+    long childMicros;
+    uint64_t cowBytes;
+};
+
+static long microsSince(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Bytes of this process's memory still shared with another process, 0 if /proc is unavailable
+static uint64_t sharedBytes() {
+    std::ifstream rollup("/proc/self/smaps_rollup");
+    string line;
+    uint64_t total = 0;
+    while (std::getline(rollup, line)) {
+        if (line.compare(0, 13, "Shared_Clean:") == 0 || line.compare(0, 13, "Shared_Dirty:") == 0) {
+            std::istringstream fields(line.substr(13));
+            uint64_t kilobytes = 0;
+            fields >> kilobytes;
+            total += kilobytes * 1024;
+        }
+    }
+    return total;
+}
+
+/**
+ * Forks a child that writes a snapshot of the tree as it is right now. Returns
+ * as soon as the fork is done; changes made to the tree afterwards are not in
+ * the snapshot.
+ * @param tree tree to snapshot
+ * @param outfile path of the snapshot, replaced atomically when the child succeeds
+ * @return true if the child was started, false if a checkpoint is already
+ * running or the fork failed
+ */
+bool BackgroundCheckpoint::start(const UTree& tree, string outfile) {
+    if (isRunning()) {
+        _error = "a checkpoint is already running";
+        return false;
+    }
+    int fds[2];
+    if (pipe(fds) != 0) {
+        _error = string("could not create pipe: ") + std::strerror(errno);
+        return false;
+    }
+    _stats = CheckpointStats();
+    _start = std::chrono::steady_clock::now();
+    pid_t pid = fork();
+    if (pid == 0) {
+        //child: the tree is a private copy-on-write image from here on
+        ::close(fds[0]);
+        uint64_t baseline = sharedBytes();
+        auto childStart = std::chrono::steady_clock::now();
+        bool saved = tree.saveSnapshot(outfile);
+        ChildReport report = {microsSince(childStart), 0};
+        //every page that stopped being shared was copied by one side or the other
+        uint64_t current = sharedBytes();
+        report.cowBytes = (baseline > current) ? baseline - current : 0;
+        ssize_t written = ::write(fds[1], &report, sizeof(report));
+        _exit((saved && written == sizeof(report)) ? 0 : 1);
+    }
+    _stats.pauseMicros = microsSince(_start);
+    ::close(fds[1]);
+    if (pid < 0) {
+        _error = string("fork failed: ") + std::strerror(errno);
+        ::close(fds[0]);
+        return false;
+    }
+    _pid = pid;
+    _pipe = fds[0];
+    return true;
+}
+
+/**
+ * Checks without blocking whether the child has finished.
+ * @return true if no checkpoint is running any more, false if it still is
+ */
+bool BackgroundCheckpoint::poll() {
+    if (!isRunning()) {
+        return true;
+    }
+    int status;
+    pid_t done = waitpid(_pid, &status, WNOHANG);
+    if (done == 0) {
+        return false;
+    }
+    finish(done == _pid ? status : -1);
+    return true;
+}
+
+/**
+ * Blocks until the running checkpoint, if any, has finished.
+ * @return true if the last checkpoint succeeded, false otherwise
+ */
+bool BackgroundCheckpoint::wait() {
+    if (isRunning()) {
+        int status;
+        pid_t done;
+        do {
+            done = waitpid(_pid, &status, 0);
+        } while (done < 0 && errno == EINTR);
+        finish(done == _pid ? status : -1);
+    }
+    return _stats.succeeded;
+}
+
+// Collects the child's report once it has been reaped
+bool BackgroundCheckpoint::finish(int status) {
+    _stats.totalMicros = microsSince(_start);
+    ChildReport report;
+    ssize_t count = ::read(_pipe, &report, sizeof(report));
+    ::close(_pipe);
+    _pipe = -1;
+    _pid = -1;
+    _stats.succeeded = status >= 0 && WIFEXITED(status) && WEXITSTATUS(status) == 0 && count == sizeof(report);
+    if (!_stats.succeeded) {
+        _error = "checkpoint child failed";
+        return false;
+    }
+    _stats.childMicros = report.childMicros;
+    _stats.cowBytes = report.cowBytes;
+    return true;
+}
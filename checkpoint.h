@@ -0,0 +1,57 @@
+/**
+ * Project 2 - Binary Trees
+ * checkpoint.h
+ * An interface for snapshots written by a forked child while the tree keeps changing.
+ */
+
+#pragma once
+
+#include "utree.h"
+#include <chrono>
+#include <sys/types.h>
+
+/* What a background checkpoint cost */
+struct CheckpointStats {
+    bool succeeded = false;
+    long pauseMicros = 0;       //time the caller was stopped for fork()
+    long childMicros = 0;       //time the child took to write the snapshot
+    long totalMicros = 0;       //from start() until the child was reaped
+    uint64_t cowBytes = 0;      //pages copied because parent or child wrote to them
+};
+
+/**
+ * Writes a snapshot of a UTree from a forked child process. fork() gives the
+ * child a copy-on-write image of the tree frozen at that instant, so the parent
+ * only pauses for the fork and can keep changing the tree while the child walks
+ * and serializes its copy. Each page either process writes afterwards is copied
+ * once; the child reports how many bytes that came to.
+ *
+ * Fork only from a process whose other threads are not mid-allocation, the
+ * child runs the snapshot writer with whatever locks were held at fork time.
+ */
+class BackgroundCheckpoint {
+public:
+    BackgroundCheckpoint(): _pid(-1), _pipe(-1) {}
+    ~BackgroundCheckpoint() {wait();}
+
+    BackgroundCheckpoint(const BackgroundCheckpoint&) = delete;
+    BackgroundCheckpoint& operator=(const BackgroundCheckpoint&) = delete;
+
+    bool start(const UTree& tree, string outfile);
+    bool poll();
+    bool wait();
+
+    /* Getters */
+    bool isRunning() const {return _pid > 0;}
+    CheckpointStats getStats() const {return _stats;}
+    string getError() const {return _error;}
+
+private:
+    pid_t _pid;
+    int _pipe;              //read end, the child writes its half of the stats here
+    std::chrono::steady_clock::time_point _start;
+    CheckpointStats _stats;
+    string _error;
+
+    bool finish(int status);
+};
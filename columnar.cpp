@@ -0,0 +1,229 @@
+/**
+ * Project 2 - Binary Trees
+ * columnar.cpp
+ * Columnar export of every account in a UTree for analytics scans.
+ *
+ * Layout (integers little-endian, varints LEB128):
+ *   magic "DTCOLS\0\0" | version fixed32
+ *   row groups, each storing its columns back to back in Column order
+ *   footer: badge dictionary, status dictionary (as in snapshots), varint row
+ *     group count, then per group: varint row count and, per column, fixed64
+ *     file offset and fixed64 length
+ *   footer length fixed32 | CRC-32 of footer fixed32 | magic
+ */
+
+#include "columnar.h"
+#include "binaryio.h"
+#include <cstdio>
+
+#define COLUMNAR_MAGIC "DTCOLS\0\0"
+#define COLUMNAR_MAGIC_SIZE 8
+#define COLUMNAR_VERSION 1
+#define COLUMNAR_HEADER_SIZE (COLUMNAR_MAGIC_SIZE + 4)
+#define COLUMNAR_TAIL_SIZE (4 + 4 + COLUMNAR_MAGIC_SIZE)
+
+// Bytes a fixed-width column of a group with numRows rows must have, -1 if any length is fine
+static int64_t expectedColumnSize(Column column, uint64_t numRows) {
+    switch (column) {
+        case COLUMN_USERNAME_OFFSETS: return 4 * (numRows + 1);
+        case COLUMN_DISC: return 2 * numRows;
+        case COLUMN_NITRO: return (numRows + 7) / 8;
+        case COLUMN_BADGE:
+        case COLUMN_STATUS: return 4 * numRows;
+        default: return -1;
+    }
+}
+
+/**
+ * Writes every account to a columnar file in one pass over the tree. Rows are
+ * buffered one row group at a time, so memory stays bounded by the group size;
+ * badge and status strings are replaced by dictionary codes and the
+ * dictionaries are written in the footer. The file is renamed into place once
+ * complete.
+ * @param outfile path of the export
+ * @param rowGroupSize accounts per row group
+ * @return true if the export was written, false otherwise
+ */
+bool UTree::exportColumnar(string outfile, size_t rowGroupSize) const {
+    if (rowGroupSize == 0) {
+        rowGroupSize = COLUMNAR_ROW_GROUP_SIZE;
+    }
+    string temp = outfile + ".tmp";
+    std::ofstream out(temp, std::ios::binary | std::ios::trunc);
+    if (!out) {
+        return false;
+    }
+    string header(COLUMNAR_MAGIC, COLUMNAR_MAGIC_SIZE);
+    putFixed32(header, COLUMNAR_VERSION);
+    out.write(header.data(), header.size());
+    uint64_t position = header.size();
+
+    StringDictionary badges;
+    StringDictionary statuses;
+    string columns[NUM_COLUMNS];
+    string groupIndex;
+    uint64_t numGroups = 0;
+    size_t numRows = 0;
+
+    auto writeGroup = [&]() {
+        putFixed32(columns[COLUMN_USERNAME_OFFSETS], columns[COLUMN_USERNAME_BYTES].size());
+        putVarint(groupIndex, numRows);
+        for (string& column : columns) {
+            putFixed64(groupIndex, position);
+            putFixed64(groupIndex, column.size());
+            out.write(column.data(), column.size());
+            position += column.size();
+            column.clear();
+        }
+        numGroups++;
+        numRows = 0;
+    };
+
+    forEachNode(_root, [&](UNode* node) {
+        forEachAccount(node, [&](const Account& account) {
+            putFixed32(columns[COLUMN_USERNAME_OFFSETS], columns[COLUMN_USERNAME_BYTES].size());
+            columns[COLUMN_USERNAME_BYTES] += account._username;
+            putFixed16(columns[COLUMN_DISC], static_cast<uint16_t>(account._disc));
+            if (numRows % 8 == 0) {
+                columns[COLUMN_NITRO].push_back(0);
+            }
+            if (account._nitro) {
+                columns[COLUMN_NITRO].back() |= static_cast<char>(1 << (numRows % 8));
+            }
+            putFixed32(columns[COLUMN_BADGE], badges.encode(account._badge));
+            putFixed32(columns[COLUMN_STATUS], statuses.encode(account._status));
+            if (++numRows == rowGroupSize) {
+                writeGroup();
+            }
+        });
+    });
+    if (numRows > 0) {
+        writeGroup();
+    }
+
+    string footer;
+    badges.write(footer);
+    statuses.write(footer);
+    putVarint(footer, numGroups);
+    footer += groupIndex;
+    string tail;
+    putFixed32(tail, footer.size());
+    putFixed32(tail, crc32(footer.data(), footer.size()));
+    tail.append(COLUMNAR_MAGIC, COLUMNAR_MAGIC_SIZE);
+    out.write(footer.data(), footer.size());
+    out.write(tail.data(), tail.size());
+    out.close();
+    if (!out || std::rename(temp.c_str(), outfile.c_str()) != 0) {
+        std::remove(temp.c_str());
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Maps a columnar export and reads its footer.
+ * @param path path of the export
+ * @return true if the file is a valid export, false otherwise
+ */
+bool ColumnarReader::open(string path) {
+    close();
+    if (!_file.open(path) || _file.getSize() < COLUMNAR_HEADER_SIZE + COLUMNAR_TAIL_SIZE) {
+        close();
+        return false;
+    }
+    const char* data = _file.getData();
+    const char* tail = data + _file.getSize() - COLUMNAR_TAIL_SIZE;
+    uint32_t footerSize = getFixed32(tail);
+    if (std::memcmp(data, COLUMNAR_MAGIC, COLUMNAR_MAGIC_SIZE) != 0
+        || getFixed32(data + COLUMNAR_MAGIC_SIZE) != COLUMNAR_VERSION
+        || std::memcmp(tail + 8, COLUMNAR_MAGIC, COLUMNAR_MAGIC_SIZE) != 0
+        || footerSize > static_cast<uint64_t>(tail - data - COLUMNAR_HEADER_SIZE)
+        || getFixed32(tail + 4) != crc32(tail - footerSize, footerSize)) {
+        close();
+        return false;
+    }
+    const char* cursor = tail - footerSize;
+    uint64_t dataEnd = cursor - data;
+    uint64_t numGroups;
+    bool valid = readDictionary(cursor, tail, _badges) && readDictionary(cursor, tail, _statuses)
+              && getVarint(cursor, tail, numGroups) && numGroups <= static_cast<uint64_t>(tail - cursor);
+    for (uint64_t g = 0; valid && g < numGroups; g++) {
+        RowGroup group;
+        uint64_t numRows;
+        valid = getVarint(cursor, tail, numRows) && static_cast<uint64_t>(tail - cursor) >= NUM_COLUMNS * 16;
+        for (int c = 0; valid && c < NUM_COLUMNS; c++) {
+            uint64_t offset = getFixed64(cursor);
+            uint64_t length = getFixed64(cursor + 8);
+            cursor += 16;
+            int64_t expected = expectedColumnSize(static_cast<Column>(c), numRows);
+            valid = offset >= COLUMNAR_HEADER_SIZE && offset <= dataEnd && length <= dataEnd - offset
+                 && (expected < 0 || static_cast<uint64_t>(expected) == length);
+            group.columns[c] = string_view(data + offset, valid ? length : 0);
+        }
+        group.numRows = numRows;
+        _groups.push_back(group);
+        _numRows += numRows;
+    }
+    if (!valid || cursor != tail) {
+        close();
+        return false;
+    }
+    return true;
+}
+
+void ColumnarReader::close() {
+    _file.close();
+    _groups.clear();
+    _badges.clear();
+    _statuses.clear();
+    _numRows = 0;
+}
+
+/**
+ * Returns the raw bytes of one column of a row group, laid out as described by Column.
+ * @param group index of the row group
+ * @param column column to return
+ * @return view into the mapping, valid until close()
+ */
+string_view ColumnarReader::getColumn(size_t group, Column column) const {
+    return _groups[group].columns[column];
+}
+
+string_view ColumnarReader::getUsername(size_t group, size_t row) const {
+    const RowGroup& rows = _groups[group];
+    uint32_t start = getFixed32(rows.columns[COLUMN_USERNAME_OFFSETS].data() + 4 * row);
+    uint32_t end = getFixed32(rows.columns[COLUMN_USERNAME_OFFSETS].data() + 4 * row + 4);
+    if (start > end || end > rows.columns[COLUMN_USERNAME_BYTES].size()) {
+        return string_view();
+    }
+    return rows.columns[COLUMN_USERNAME_BYTES].substr(start, end - start);
+}
+
+int ColumnarReader::getDiscriminator(size_t group, size_t row) const {
+    return getFixed16(_groups[group].columns[COLUMN_DISC].data() + 2 * row);
+}
+
+bool ColumnarReader::hasNitro(size_t group, size_t row) const {
+    return (_groups[group].columns[COLUMN_NITRO][row / 8] >> (row % 8)) & 1;
+}
+
+string ColumnarReader::getBadge(size_t group, size_t row) const {
+    uint32_t code = getFixed32(_groups[group].columns[COLUMN_BADGE].data() + 4 * row);
+    return (code < _badges.size()) ? _badges[code] : string();
+}
+
+string ColumnarReader::getStatus(size_t group, size_t row) const {
+    uint32_t code = getFixed32(_groups[group].columns[COLUMN_STATUS].data() + 4 * row);
+    return (code < _statuses.size()) ? _statuses[code] : string();
+}
+
+/**
+ * Rebuilds the account stored in a row.
+ * @param group index of the row group
+ * @param row index of the row within the group
+ * @return the account
+ */
+Account ColumnarReader::getAccount(size_t group, size_t row) const {
+    return Account(string(getUsername(group, row)), getDiscriminator(group, row), hasNitro(group, row),
+                   getBadge(group, row), getStatus(group, row));
+}
@@ -0,0 +1,60 @@
+/**
+ * Project 2 - Binary Trees
+ * columnar.h
+ * An interface for reading the columnar account export written by UTree::exportColumnar.
+ */
+
+#pragma once
+
+#include "utree.h"
+
+/* Columns of a row group, in the order they are stored */
+enum Column {
+    COLUMN_USERNAME_OFFSETS,    //fixed32 per row plus one, start of each username in COLUMN_USERNAME_BYTES
+    COLUMN_USERNAME_BYTES,      //usernames back to back
+    COLUMN_DISC,                //fixed16 per row
+    COLUMN_NITRO,               //one bit per row, least significant bit first
+    COLUMN_BADGE,               //fixed32 badge dictionary code per row
+    COLUMN_STATUS,              //fixed32 status dictionary code per row
+    NUM_COLUMNS
+};
+
+/**
+ * Reads a columnar export through a read-only mapping. Only the footer is
+ * parsed on open, so a scan that reads a single column only pages in that
+ * column's bytes. Rows are in username then discriminator order, split into
+ * row groups; a row is addressed by its group and its index within the group.
+ */
+class ColumnarReader {
+public:
+    bool open(string path);
+    void close();
+
+    string_view getColumn(size_t group, Column column) const;
+    string_view getUsername(size_t group, size_t row) const;
+    int getDiscriminator(size_t group, size_t row) const;
+    bool hasNitro(size_t group, size_t row) const;
+    string getBadge(size_t group, size_t row) const;
+    string getStatus(size_t group, size_t row) const;
+    Account getAccount(size_t group, size_t row) const;
+
+    /* Getters */
+    bool isOpen() const {return _file.isOpen();}
+    size_t getNumRowGroups() const {return _groups.size();}
+    size_t getNumRows(size_t group) const {return _groups[group].numRows;}
+    uint64_t getNumRows() const {return _numRows;}
+    const vector<string>& getBadges() const {return _badges;}
+    const vector<string>& getStatuses() const {return _statuses;}
+
+private:
+    struct RowGroup {
+        size_t numRows;
+        string_view columns[NUM_COLUMNS];
+    };
+
+    MappedFile _file;
+    vector<RowGroup> _groups;
+    vector<string> _badges;
+    vector<string> _statuses;
+    uint64_t _numRows = 0;
+};
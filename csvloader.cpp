@@ -0,0 +1,283 @@
+/**
+ * Project 2 - Binary Trees
+ * csvloader.cpp
+ * Implementation for the memory-mapped .csv scanner.
+ */
+
+#include "csvloader.h"
+#include <charconv>
+#include <cstring>
+#include <stdexcept>
+#include <utility>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+/**
+ * Maps a whole file into memory for reading.
+ * @param path path of the file to map
+ * @return true if the file was mapped (an empty file maps to an empty view), false otherwise
+ */
+bool MappedFile::open(const string& path) {
+    close();
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat info;
+    if (fstat(fd, &info) != 0) {
+        ::close(fd);
+        return false;
+    }
+    _size = static_cast<size_t>(info.st_size);
+    //mmap refuses zero length mappings, an empty file is just an empty view
+    if (_size > 0) {
+        void* mapped = mmap(nullptr, _size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (mapped == MAP_FAILED) {
+            ::close(fd);
+            _size = 0;
+            return false;
+        }
+        //the file is read front to back exactly once
+        madvise(mapped, _size, MADV_SEQUENTIAL);
+        _data = static_cast<const char*>(mapped);
+    }
+    //the mapping stays valid after the descriptor is closed
+    ::close(fd);
+    _opened = true;
+    return true;
+}
+
+/**
+ * Releases the mapping, if any.
+ */
+void MappedFile::close() {
+    if (_data != nullptr) {
+        munmap(const_cast<char*>(_data), _size);
+    }
+    _data = nullptr;
+    _size = 0;
+    _opened = false;
+}
+
+// Exchanges mappings, e.g. to keep a file validated through a temporary mapped for good
+void MappedFile::swap(MappedFile& other) {
+    std::swap(_data, other._data);
+    std::swap(_size, other._size);
+    std::swap(_opened, other._opened);
+}
+
+// Drops the read-ahead requested by open() for a mapping that will be read at random
+void MappedFile::adviseRandomAccess() {
+    if (_data != nullptr) {
+        madvise(const_cast<char*>(_data), _size, MADV_RANDOM);
+    }
+}
+
+/**
+ * Parses an integer field the same way std::stoi does: leading whitespace and a
+ * sign are allowed and parsing stops at the first non-digit.
+ * @param field text of the field
+ * @param value parsed integer
+ * @return true if at least one digit was parsed and the value fits in an int
+ */
+bool parseCSVInt(string_view field, int& value) {
+    const char* first = field.data();
+    const char* last = first + field.size();
+    while (first != last && (*first == ' ' || (*first >= '\t' && *first <= '\r'))) {
+        first++;
+    }
+    //from_chars takes '-' but not '+'
+    if (first != last && *first == '+') {
+        first++;
+        if (first != last && *first == '-') {
+            return false;
+        }
+    }
+    std::from_chars_result result = std::from_chars(first, last, value);
+    return result.ec == std::errc();
+}
+
+// Sets bit i of delims/newlines when block[i] is ',' or '\n'
+typedef void (*BlockMaskFn)(const char* block, uint64_t& delims, uint64_t& newlines);
+
+static void blockMaskScalar(const char* block, uint64_t& delims, uint64_t& newlines) {
+    delims = 0;
+    newlines = 0;
+    for (int i = 0; i < CSV_BLOCK_SIZE; i++) {
+        delims |= static_cast<uint64_t>(block[i] == CSV_DELIM) << i;
+        newlines |= static_cast<uint64_t>(block[i] == CSV_NEWLINE) << i;
+    }
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+__attribute__((target("sse2")))
+static void blockMaskSSE2(const char* block, uint64_t& delims, uint64_t& newlines) {
+    const __m128i delim = _mm_set1_epi8(CSV_DELIM);
+    const __m128i newline = _mm_set1_epi8(CSV_NEWLINE);
+    delims = 0;
+    newlines = 0;
+    for (int i = 0; i < CSV_BLOCK_SIZE; i += 16) {
+        __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(block + i));
+        delims |= static_cast<uint64_t>(static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(chunk, delim)))) << i;
+        newlines |= static_cast<uint64_t>(static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(chunk, newline)))) << i;
+    }
+}
+
+__attribute__((target("avx2")))
+static void blockMaskAVX2(const char* block, uint64_t& delims, uint64_t& newlines) {
+    const __m256i delim = _mm256_set1_epi8(CSV_DELIM);
+    const __m256i newline = _mm256_set1_epi8(CSV_NEWLINE);
+    __m256i low = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(block));
+    __m256i high = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(block + 32));
+    delims = static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(low, delim)))
+           | static_cast<uint64_t>(static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(high, delim)))) << 32;
+    newlines = static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(low, newline)))
+             | static_cast<uint64_t>(static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(high, newline)))) << 32;
+}
+#endif
+
+static bool modeSupported(CSVScanMode mode) {
+    switch (mode) {
+        case SCAN_AUTO:
+        case SCAN_SCALAR:
+            return true;
+#if defined(__x86_64__) || defined(__i386__)
+        case SCAN_SSE2:
+            return __builtin_cpu_supports("sse2");
+        case SCAN_AVX2:
+            return __builtin_cpu_supports("avx2");
+#endif
+        default:
+            return false;
+    }
+}
+
+static BlockMaskFn kernelFor(CSVScanMode mode) {
+#if defined(__x86_64__) || defined(__i386__)
+    if (mode == SCAN_AUTO) {
+        mode = modeSupported(SCAN_AVX2) ? SCAN_AVX2 : (modeSupported(SCAN_SSE2) ? SCAN_SSE2 : SCAN_SCALAR);
+    }
+    if (mode == SCAN_AVX2) {
+        return blockMaskAVX2;
+    }
+    if (mode == SCAN_SSE2) {
+        return blockMaskSSE2;
+    }
+#endif
+    return blockMaskScalar;
+}
+
+//chosen once from the CPU features, setCSVScanMode can pin a kernel for benchmarks
+static BlockMaskFn blockMask = kernelFor(SCAN_AUTO);
+
+/**
+ * Selects the kernel used to classify blocks of the buffer.
+ * @param mode kernel to use, SCAN_AUTO for the widest one the CPU supports
+ * @return true if the kernel was selected, false if the CPU does not support it
+ */
+bool setCSVScanMode(CSVScanMode mode) {
+    if (!modeSupported(mode)) {
+        return false;
+    }
+    blockMask = kernelFor(mode);
+    return true;
+}
+
+/**
+ * Names the kernel currently in use.
+ * @return "avx2", "sse2" or "scalar"
+ */
+string getCSVScanMode() {
+#if defined(__x86_64__) || defined(__i386__)
+    if (blockMask == blockMaskAVX2) {
+        return "avx2";
+    }
+    if (blockMask == blockMaskSSE2) {
+        return "sse2";
+    }
+#endif
+    return "scalar";
+}
+
+CSVScanner::CSVScanner(string_view buffer): _buffer(buffer), _pos(0), _line(0), _blockPos(0), _delimBits(0), _newlineBits(0) {
+    if (!_buffer.empty()) {
+        loadBlock();
+    }
+}
+
+// Classifies the block starting at _blockPos, the tail of the buffer is padded first
+void CSVScanner::loadBlock() {
+    size_t remaining = _buffer.size() - _blockPos;
+    if (remaining >= CSV_BLOCK_SIZE) {
+        blockMask(_buffer.data() + _blockPos, _delimBits, _newlineBits);
+        return;
+    }
+    char padded[CSV_BLOCK_SIZE] = {};
+    std::memcpy(padded, _buffer.data() + _blockPos, remaining);
+    blockMask(padded, _delimBits, _newlineBits);
+}
+
+/**
+ * Scans the next line of the buffer. The delimiters are counted in the same pass
+ * that finds the end of the line.
+ * @param record filled with views of the 5 fields
+ * @return true if a line was scanned, false at the end of the buffer
+ */
+bool CSVScanner::next(RecordView& record) {
+    const size_t length = _buffer.size();
+    if (_pos >= length) {
+        return false;
+    }
+    const char* base = _buffer.data();
+    size_t delims[CSV_NUM_FIELDS - 1];
+    int delimCount = 0;
+    size_t end = length;
+    while (true) {
+        uint64_t pending = _delimBits | _newlineBits;
+        if (pending == 0) {
+            _blockPos += CSV_BLOCK_SIZE;
+            if (_blockPos >= length) {
+                //last line without a newline
+                break;
+            }
+            loadBlock();
+            continue;
+        }
+        uint64_t lowest = pending & (~pending + 1);
+        size_t position = _blockPos + __builtin_ctzll(pending);
+        if (_newlineBits & lowest) {
+            _newlineBits &= ~lowest;
+            end = position;
+            break;
+        }
+        _delimBits &= ~lowest;
+        if (delimCount < CSV_NUM_FIELDS - 1) {
+            delims[delimCount] = position;
+        }
+        delimCount++;
+    }
+    size_t begin = _pos;
+    _pos = (end < length) ? end + 1 : length;
+    _line++;
+
+    if (delimCount != CSV_NUM_FIELDS - 1) {
+        throw std::invalid_argument("Malformed input file detected - ensure each line contains 5 fields deliminated by a ','");
+    }
+
+    record.username = string_view(base + begin, delims[0] - begin);
+    record.badge = string_view(base + delims[2] + 1, delims[3] - delims[2] - 1);
+    record.status = string_view(base + delims[3] + 1, end - delims[3] - 1);
+    int nitro = 0;
+    if (!parseCSVInt(string_view(base + delims[0] + 1, delims[1] - delims[0] - 1), record.disc)
+        || !parseCSVInt(string_view(base + delims[1] + 1, delims[2] - delims[1] - 1), nitro)) {
+        throw std::invalid_argument("Malformed input file detected - discriminator and nitro fields must be integers (line "
+                                    + std::to_string(_line) + ")");
+    }
+    record.nitro = nitro != 0;
+    return true;
+}
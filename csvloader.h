@@ -0,0 +1,105 @@
+/**
+ * Project 2 - Binary Trees
+ * csvloader.h
+ * An interface for the memory-mapped .csv scanner used to load accounts.
+ */
+
+#pragma once
+
+#include "dtree.h"
+#include <string_view>
+#include <cstddef>
+#include <cstdint>
+
+using std::string_view;
+
+#define CSV_NUM_FIELDS 5
+#define CSV_DELIM ','
+#define CSV_NEWLINE '\n'
+
+/**
+ * Read-only view of an entire file mapped into memory.
+ * The mapping is released by close() or the destructor.
+ */
+class MappedFile {
+public:
+    MappedFile(): _data(nullptr), _size(0), _opened(false) {}
+    ~MappedFile() {close();}
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    bool open(const string& path);
+    void close();
+    void swap(MappedFile& other);
+    void adviseRandomAccess();
+
+    /* Getters */
+    const char* getData() const {return _data;}
+    size_t getSize() const {return _size;}
+    bool isOpen() const {return _opened;}
+    string_view getView() const {return string_view(_data, _size);}
+
+private:
+    const char* _data;
+    size_t _size;
+    bool _opened;
+};
+
+/**
+ * One parsed line of the .csv file. Strings are views into the scanned
+ * buffer and are only copied when the record is turned into an Account.
+ */
+struct RecordView {
+    string_view username;
+    int disc = INVALID_DISC;
+    bool nitro = false;
+    string_view badge;
+    string_view status;
+
+    Account toAccount() const {
+        return Account(string(username), disc, nitro, string(badge), string(status));
+    }
+};
+
+/* Kernels that can classify a block of the buffer */
+enum CSVScanMode {
+    SCAN_AUTO,      //widest kernel the CPU supports
+    SCAN_SCALAR,
+    SCAN_SSE2,
+    SCAN_AVX2
+};
+
+#define CSV_BLOCK_SIZE 64
+
+/**
+ * Single pass tokenizer over a buffer of .csv lines.
+ * Each line must hold exactly 5 fields separated by ','; lines are split on '\n'
+ * the same way std::getline does, so a trailing '\r' stays in the last field.
+ * The buffer is classified 64 bytes at a time into bitmasks of delimiters and
+ * newlines (SSE2/AVX2 when available), so every byte is only looked at once.
+ */
+class CSVScanner {
+public:
+    CSVScanner(string_view buffer);
+
+    bool next(RecordView& record);
+
+    /* Getters */
+    size_t getPosition() const {return _pos;}
+    size_t getLineNumber() const {return _line;}
+
+private:
+    string_view _buffer;
+    size_t _pos;
+    size_t _line;
+    size_t _blockPos;       //offset of the block the masks describe
+    uint64_t _delimBits;    //unconsumed ',' positions in the block
+    uint64_t _newlineBits;  //unconsumed '\n' positions in the block
+
+    void loadBlock();
+};
+
+bool setCSVScanMode(CSVScanMode mode);
+string getCSVScanMode();
+bool parseCSVInt(string_view field, int& value);
@@ -0,0 +1,107 @@
+/**
+ * Project 2 - Binary Trees
+ * discindex.cpp
+ * An inverted index from discriminator to usernames, kept up to date as an observer.
+ */
+
+#include "discindex.h"
+#include <algorithm>
+
+/**
+ * Adds the account's username to the list of its discriminator. An account the
+ * index already holds, e.g. replayed by UTree::replayContents after it was
+ * attached, is ignored.
+ * @param account account the UTree inserted
+ */
+void DiscIndex::accountInserted(const Account& account) {
+    int disc = account.getDiscriminator();
+    if (disc < MIN_DISC || disc > MAX_DISC) {
+        return;
+    }
+    uint32_t id;
+    auto found = _ids.find(account.getUsername());
+    if (found != _ids.end()) {
+        id = found->second;
+    }
+    else {
+        if (!_freeIds.empty()) {
+            id = _freeIds.back();
+            _freeIds.pop_back();
+        }
+        else {
+            id = static_cast<uint32_t>(_names.size());
+            _names.emplace_back();
+        }
+        _names[id].username = account.getUsername();
+        _ids.emplace(_names[id].username, id);
+    }
+    vector<uint32_t>& list = _lists[disc];
+    auto position = std::lower_bound(list.begin(), list.end(), id);
+    if (position != list.end() && *position == id) {
+        return;
+    }
+    list.insert(position, id);
+    _names[id].numDiscs++;
+    _numAccounts++;
+}
+
+/**
+ * Takes the account's username out of the list of its discriminator, freeing
+ * the username once no discriminator refers to it.
+ * @param account account the UTree removed
+ */
+void DiscIndex::accountRemoved(const Account& account) {
+    int disc = account.getDiscriminator();
+    auto found = _ids.find(account.getUsername());
+    if (disc < MIN_DISC || disc > MAX_DISC || found == _ids.end()) {
+        return;
+    }
+    uint32_t id = found->second;
+    vector<uint32_t>& list = _lists[disc];
+    auto position = std::lower_bound(list.begin(), list.end(), id);
+    if (position == list.end() || *position != id) {
+        return;
+    }
+    list.erase(position);
+    _numAccounts--;
+    if (--_names[id].numDiscs == 0) {
+        _ids.erase(found);
+        _names[id].username.clear();
+        _freeIds.push_back(id);
+    }
+}
+
+// An update keeps the username and discriminator, which is all the index holds
+void DiscIndex::accountUpdated(const Account&, const Account&) {}
+
+void DiscIndex::treeCleared() {
+    for (vector<uint32_t>& list : _lists) {
+        list.clear();
+    }
+    _names.clear();
+    _ids.clear();
+    _freeIds.clear();
+    _numAccounts = 0;
+}
+
+/**
+ * Returns the usernames holding a discriminator.
+ * @param disc discriminator to look up
+ * @return the usernames in alphabetical order, empty for a discriminator out of range
+ */
+vector<string> DiscIndex::getUsernames(int disc) const {
+    vector<string> usernames;
+    if (disc < MIN_DISC || disc > MAX_DISC) {
+        return usernames;
+    }
+    usernames.reserve(_lists[disc].size());
+    for (uint32_t id : _lists[disc]) {
+        usernames.push_back(_names[id].username);
+    }
+    std::sort(usernames.begin(), usernames.end());
+    return usernames;
+}
+
+size_t DiscIndex::getNumUsernames(int disc) const {
+    return (disc < MIN_DISC || disc > MAX_DISC) ? 0 : _lists[disc].size();
+}
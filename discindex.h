@@ -0,0 +1,47 @@
+/**
+ * Project 2 - Binary Trees
+ * discindex.h
+ * An interface for the DiscIndex class, an inverted index from discriminator to usernames.
+ */
+
+#pragma once
+
+#include "utree.h"
+#include <unordered_map>
+
+/**
+ * For each discriminator, the usernames holding it. Attached as an observer it
+ * follows inserts and removals, so "which usernames hold discriminator 1337"
+ * costs time proportional to the answer rather than a visit to every UNode.
+ * Usernames are stored once and referred to by id from each discriminator's
+ * list.
+ */
+class DiscIndex : public UTreeObserver {
+public:
+    DiscIndex(): _lists(MAX_DISC + 1) {}
+
+    /* UTreeObserver */
+    void accountInserted(const Account& account) override;
+    void accountRemoved(const Account& account) override;
+    void accountUpdated(const Account& before, const Account& after) override;
+    void treeCleared() override;
+
+    vector<string> getUsernames(int disc) const;
+    size_t getNumUsernames(int disc) const;
+
+    /* Getters */
+    size_t getNumAccounts() const {return _numAccounts;}
+    size_t getNumDistinctUsernames() const {return _ids.size();}
+
+private:
+    struct Name {
+        string username;
+        uint32_t numDiscs = 0;      //lists the id is in, the name is freed at 0
+    };
+
+    vector<vector<uint32_t>> _lists;    //username ids per discriminator, sorted
+    vector<Name> _names;
+    std::unordered_map<string, uint32_t> _ids;
+    vector<uint32_t> _freeIds;
+    size_t _numAccounts = 0;
+};
@@ -10,6 +10,7 @@
  */
 #include <iostream>
 #include <vector>
+#include <algorithm>
 #include "dtree.h"
 
 using namespace std;
@@ -29,6 +30,7 @@ DTree& DTree::operator=(const DTree& rhs) {
     if (this == &rhs) {
         return *this;
     }
+    thaw();
     clear(_root);
     _root = subTreeCopy(rhs._root);
     return *this;
@@ -68,6 +70,7 @@ bool DTree::insert(Account newAcct) {
     if (newAcct.getDiscriminator() == INVALID_DISC) {
         return false;
     }
+    thaw();
     return insert(_root, newAcct);
 }
 
@@ -130,11 +133,40 @@ bool DTree::insert(DNode*& node, Account newAcct) {
             return insert(node->_right, newAcct);
         }
     } 
+    else if (node->_vacant) {
+        // The discriminator was removed, its vacant node takes the account back
+        replaceVacantNode(node, newAcct);
+        updateNumVacant(node);
+        updateSize(node);
+        return true;
+    }
     else {
         // Duplicate discriminator, insertion fails
         return false;
     }
 }
+/**
+ * Replaces the contents of the tree with a perfectly balanced tree built in one pass.
+ * @param accounts accounts sorted by discriminator without duplicates, moved into the tree
+ */
+void DTree::buildSorted(vector<Account>& accounts) {
+    clear();
+    _root = buildSorted(accounts, 0, static_cast<int>(accounts.size()) - 1);
+}
+
+DNode* DTree::buildSorted(vector<Account>& accounts, int start, int end) {
+    if (start > end) {
+        return nullptr;
+    }
+    int mid = (start + end) / 2;
+    DNode* root = new DNode(std::move(accounts[mid]));
+    root->_left = buildSorted(accounts, start, mid - 1);
+    root->_right = buildSorted(accounts, mid + 1, end);
+    //children are complete, so the size is known without another traversal
+    root->_size = end - start + 1;
+    return root;
+}
+
 // Helper function to get the maximum discriminator in a subtree
 int DTree::getMaxDiscriminator(DNode* node) const {
     while (node->_right != nullptr) {
@@ -181,7 +213,7 @@ bool DTree::remove(int disc, DNode*& removed) {
     if(retrieve(disc) == nullptr){
         return false;
     }
-
+    thaw();
 
 
     DNode* parent = nullptr;
@@ -234,6 +266,9 @@ DNode* DTree::retrieve(int disc) {
     if(disc < MIN_DISC || disc > MAX_DISC){
         return nullptr;
     }
+    if(isFrozen()){
+        return retrieveFrozen(disc);
+    }
     if(_root == nullptr){
         return nullptr;
     }
@@ -260,10 +295,68 @@ DNode* DTree::retrieve(int disc) {
     return nullptr;
 }
 
+/**
+ * Lays the live discriminators out in one array in breadth-first (Eytzinger) order
+ * for read-mostly use. retrieve then searches the array without branching on the
+ * comparisons and prefetches four levels ahead, instead of chasing DNodes scattered
+ * over the heap. The DNodes stay as they are and are what retrieve returns. The
+ * first insert or removal thaws the tree again.
+ */
+void DTree::freeze() {
+    vector<DNode*> sorted;
+    fillArray(_root, sorted);
+    thaw();
+    if (sorted.empty()) {
+        return;
+    }
+    _frozenDiscs.resize(sorted.size() + 1);
+    _frozenNodes.resize(sorted.size() + 1);
+    //slot 0 is unused, a search that finds nothing ends there
+    _frozenDiscs[0] = INVALID_DISC;
+    _frozenNodes[0] = nullptr;
+    layOut(sorted, 0, 1);
+}
+
+/**
+ * Drops the array freeze built; lookups go back to walking the DNodes.
+ */
+void DTree::thaw() {
+    _frozenDiscs.clear();
+    _frozenDiscs.shrink_to_fit();
+    _frozenNodes.clear();
+    _frozenNodes.shrink_to_fit();
+}
+
+// Fills the subtree at slot with sorted nodes from next on, in order; returns the next unused
+size_t DTree::layOut(const vector<DNode*>& sorted, size_t next, size_t slot) {
+    if (slot < _frozenDiscs.size()) {
+        next = layOut(sorted, next, 2 * slot);
+        _frozenDiscs[slot] = sorted[next]->_account.getDiscriminator();
+        _frozenNodes[slot] = sorted[next++];
+        next = layOut(sorted, next, 2 * slot + 1);
+    }
+    return next;
+}
+
+// Descends the Eytzinger array with the comparison as arithmetic rather than a branch,
+// then undoes the right turns taken after the last left one to land on the lower bound
+DNode* DTree::retrieveFrozen(int disc) const {
+    const int* discs = _frozenDiscs.data();
+    size_t size = _frozenDiscs.size();
+    size_t slot = 1;
+    while (slot < size) {
+        __builtin_prefetch(discs + std::min(slot * FROZEN_PREFETCH_STRIDE, size - 1));
+        slot = 2 * slot + (discs[slot] < disc);
+    }
+    slot >>= __builtin_ffsll(~static_cast<long long>(slot));
+    return discs[slot] == disc ? _frozenNodes[slot] : nullptr;
+}
+
 /**
  * Helper for the destructor to clear dynamic memory.
  */
 void DTree::clear() {
+    thaw();
     clear(_root);
     _root = nullptr;
 }
@@ -293,11 +386,31 @@ void DTree::printAccounts(DNode* node) const {
     }
     printAccounts(node->_left);
     if(node->_vacant == false){
-        cout << node->getAccount() << endl;
+        //no endl, flushing every account made printing slower than the tree walk
+        cout << node->getAccount() << '\n';
     }
     printAccounts(node->_right);
 }
 
+/**
+ * Visits every non-vacant account in discriminator order.
+ * @param visit called once per account
+ */
+void DTree::forEachAccount(const std::function<void(const Account&)>& visit) const {
+    forEachAccount(_root, visit);
+}
+
+void DTree::forEachAccount(DNode* node, const std::function<void(const Account&)>& visit) const {
+    if (node == nullptr) {
+        return;
+    }
+    forEachAccount(node->_left, visit);
+    if (!node->_vacant) {
+        visit(node->_account);
+    }
+    forEachAccount(node->_right, visit);
+}
+
 /**
  * Dump the DTree in the '()' notation.
  */
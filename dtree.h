@@ -14,6 +14,8 @@
 #include <string>
 #include <exception>
 #include <vector>
+#include <utility>
+#include <functional>
 
 //for debugging
 #include <iomanip> // For std::setw
@@ -32,6 +34,7 @@ using std::vector;
 #define DEFAULT_STATUS ""
 
 #define DEFAULT_SIZE 1
+#define FROZEN_PREFETCH_STRIDE 16   //a frozen DTree's search prefetches the node this many slots down, four levels
 #define DEFAULT_NUM_VACANT 0
 
 class Grader;   /* For grading purposes */
@@ -43,6 +46,7 @@ public:
     friend class Tester;
     friend class DNode;
     friend class DTree;
+    friend class UTree;
     Account() {
         _username = DEFAULT_USERNAME;
         _disc = INVALID_DISC;
@@ -70,6 +74,11 @@ public:
     string getBadge() const {return _badge;}
     string getStatus() const {return _status;}
 
+    /* Setters, the username and discriminator are the key and stay fixed */
+    void setNitro(bool nitro) {_nitro = nitro;}
+    void setBadge(string badge) {_badge = std::move(badge);}
+    void setStatus(string status) {_status = std::move(status);}
+
 private:
     string _username;
     int _disc;
@@ -85,6 +94,7 @@ class DNode {
     friend class Grader;
     friend class Tester;
     friend class DTree;
+    friend class UTree;
 
 public:
     DNode() {
@@ -96,7 +106,7 @@ public:
     }
 
     DNode(Account account) {
-        _account = account;
+        _account = std::move(account);
         _size = DEFAULT_SIZE;
         _numVacant = DEFAULT_NUM_VACANT;
         _vacant = false;
@@ -155,12 +165,17 @@ public:
     /* IMPLEMENT: Basic operations */
 
     bool insert(Account newAcct);
+    void buildSorted(vector<Account>& accounts);
     bool remove(int disc, DNode*& removed);
     DNode* retrieve(int disc);
     void clear();
     void printAccounts() const;
+    void forEachAccount(const std::function<void(const Account&)>& visit) const;
     void dump() const {dump(_root);}
     void dump(DNode* node) const;
+    void freeze();
+    void thaw();
+    bool isFrozen() const {return !_frozenDiscs.empty();}
 
     /* IMPLEMENT: "Helper" functions */
     
@@ -218,17 +233,25 @@ void printTreeStructure(DNode* node, int depth = 0, const std::string& prefix =
 
 private:
     DNode* _root;
+    //set by freeze until the next write: the live discriminators in Eytzinger order from
+    //index 1, so the children of slot k are 2k and 2k + 1, and the DNode of each
+    vector<int> _frozenDiscs;
+    vector<DNode*> _frozenNodes;
 
     /* IMPLEMENT (optional): any additional helper functions here */
     void clear(DNode* node);
     DNode* subTreeCopy(const DNode* rhsNode);
     void printAccounts(DNode* node) const;
+    void forEachAccount(DNode* node, const std::function<void(const Account&)>& visit) const;
     int getNumUsers(DNode* node) const;
     int intUpdateSize(DNode* node);
     int intUpdateNumVacant(DNode* node);
     //DNode** arraySort(DNode* node, DNode**& sortedArray, int& index);
     void fillArray(DNode* node, vector<DNode*>& nodeArray);
     DNode* sortedNewTree(vector<DNode*>& nodeArray, int start, int end);
+    DNode* buildSorted(vector<Account>& accounts, int start, int end);
+    size_t layOut(const vector<DNode*>& sorted, size_t next, size_t slot);
+    DNode* retrieveFrozen(int disc) const;
     bool insert(DNode*& node, Account newAcct);
     void replaceVacantNode(DNode* node, Account newAcct);
     int getMaxDiscriminator(DNode* node) const;
@@ -0,0 +1,133 @@
+/**
+ * Project 2 - Binary Trees
+ * export.cpp
+ * Bulk export of every account in a UTree as .csv or JSON Lines.
+ */
+
+#include "utree.h"
+#include <charconv>
+#include <thread>
+#include <algorithm>
+
+static void appendInt(string& out, int value) {
+    char digits[16];
+    auto result = std::to_chars(digits, digits + sizeof(digits), value);
+    out.append(digits, result.ptr - digits);
+}
+
+// A field the loader would split on cannot be written to a .csv
+static bool appendCSVField(string& out, const string& field) {
+    if (field.find_first_of(",\n") != string::npos) {
+        return false;
+    }
+    out += field;
+    return true;
+}
+
+static void appendJSONString(string& out, const string& text) {
+    static const char HEX[] = "0123456789abcdef";
+    out += '"';
+    for (char c : text) {
+        unsigned char byte = static_cast<unsigned char>(c);
+        if (c == '"' || c == '\\') {
+            out += '\\';
+            out += c;
+        }
+        else if (byte < 0x20) {
+            out += "\\u00";
+            out += HEX[byte >> 4];
+            out += HEX[byte & 0xf];
+        }
+        else {
+            out += c;
+        }
+    }
+    out += '"';
+}
+
+// Formats the accounts of nodes[start] .. nodes[end - 1] into out
+bool UTree::formatAccounts(const vector<UNode*>& nodes, size_t start, size_t end, ExportFormat format, string& out) const {
+    bool valid = true;
+    for (size_t n = start; n < end && valid; n++) {
+        forEachAccount(nodes[n], [&](const Account& account) {
+            if (format == EXPORT_CSV) {
+                valid = valid && appendCSVField(out, account.getUsername());
+                out += CSV_DELIM;
+                appendInt(out, account.getDiscriminator());
+                out += CSV_DELIM;
+                out += account.hasNitro() ? '1' : '0';
+                out += CSV_DELIM;
+                valid = valid && appendCSVField(out, account.getBadge());
+                out += CSV_DELIM;
+                valid = valid && appendCSVField(out, account.getStatus());
+            }
+            else {
+                out += "{\"username\":";
+                appendJSONString(out, account.getUsername());
+                out += ",\"discriminator\":";
+                appendInt(out, account.getDiscriminator());
+                out += account.hasNitro() ? ",\"nitro\":true,\"badge\":" : ",\"nitro\":false,\"badge\":";
+                appendJSONString(out, account.getBadge());
+                out += ",\"status\":";
+                appendJSONString(out, account.getStatus());
+                out += '}';
+            }
+            out += CSV_NEWLINE;
+        });
+    }
+    return valid;
+}
+
+/**
+ * Writes every account in username then discriminator order, the same order as
+ * printUsers. Accounts are formatted in batches on several threads into reusable
+ * buffers that are written to the stream in order, one large write per batch and
+ * a single flush at the end. A .csv export can be read back with loadData.
+ * @param out stream to write to
+ * @param format EXPORT_CSV or EXPORT_JSONL
+ * @param numThreads number of threads formatting batches, 0 for one per hardware thread
+ * @return true if every account was written, false on a stream error or, for a .csv,
+ * a field containing a comma or newline, in which case earlier batches may already be written
+ */
+bool UTree::exportAccounts(ostream& out, ExportFormat format, unsigned int numThreads) const {
+    if (numThreads == 0) {
+        numThreads = std::max(1u, std::thread::hardware_concurrency());
+    }
+
+    //cut the username order into batches of about EXPORT_BATCH_ACCOUNTS accounts
+    vector<UNode*> nodes;
+    vector<size_t> batchStarts(1, 0);
+    size_t batchAccounts = 0;
+    forEachNode(_root, [&](UNode* node) {
+        if (batchAccounts >= EXPORT_BATCH_ACCOUNTS) {
+            batchStarts.push_back(nodes.size());
+            batchAccounts = 0;
+        }
+        nodes.push_back(node);
+        batchAccounts += node->isLazy() ? node->_lazyCount : node->_dtree->getRoot()->getSize();
+    });
+    batchStarts.push_back(nodes.size());
+
+    //format a wave of batches in parallel, then write them in order
+    size_t numBatches = batchStarts.size() - 1;
+    vector<string> buffers(std::min<size_t>(numThreads, numBatches));
+    vector<char> valid(buffers.size());
+    for (size_t wave = 0; wave < numBatches; wave += buffers.size()) {
+        size_t count = std::min(buffers.size(), numBatches - wave);
+        parallelFor(count, numThreads, [&](size_t slot) {
+            buffers[slot].clear();
+            valid[slot] = formatAccounts(nodes, batchStarts[wave + slot], batchStarts[wave + slot + 1], format, buffers[slot]);
+        });
+        for (size_t slot = 0; slot < count; slot++) {
+            if (!valid[slot]) {
+                return false;
+            }
+            out.write(buffers[slot].data(), buffers[slot].size());
+        }
+        if (!out) {
+            return false;
+        }
+    }
+    out.flush();
+    return static_cast<bool>(out);
+}
@@ -0,0 +1,265 @@
+/**
+ * Project 2 - Binary Trees
+ * journal.cpp
+ * Implementation for the Journal class.
+ */
+
+#include "journal.h"
+#include "binaryio.h"
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+
+#define JOURNAL_OP_INSERT 'I'
+#define JOURNAL_OP_REMOVE 'R'
+#define JOURNAL_OP_CLEAR 'C'
+#define JOURNAL_OP_UPDATE 'U'
+#define JOURNAL_RECORD_HEADER 8
+
+// Appends every field of an account, the payload of inserts and updates
+static void putAccount(string& payload, const Account& account) {
+    putString(payload, account.getUsername());
+    putVarint(payload, account.getDiscriminator());
+    payload.push_back(account.hasNitro() ? 1 : 0);
+    putString(payload, account.getBadge());
+    putString(payload, account.getStatus());
+}
+
+Journal::Journal()
+    : _fd(-1), _policy(SYNC_GROUP), _groupSize(DEFAULT_GROUP_SIZE), _groupWindow(DEFAULT_GROUP_MILLIS),
+      _pending(0), _numRecords(0), _numSyncs(0), _numReplayed(0) {}
+
+/**
+ * Opens (or creates) a journal file for appending.
+ * @param path path of the journal file
+ * @param policy when records are forced to disk
+ * @param groupSize records per group commit with SYNC_GROUP
+ * @param groupMillis longest a group stays open with SYNC_GROUP
+ * @return true if the journal was opened, false otherwise
+ */
+bool Journal::open(string path, SyncPolicy policy, size_t groupSize, int groupMillis) {
+    close();
+    _fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_APPEND, 0644);
+    if (_fd < 0) {
+        _error = "could not open journal " + path + ": " + std::strerror(errno);
+        return false;
+    }
+    _path = path;
+    _policy = policy;
+    _groupSize = (groupSize > 0) ? groupSize : 1;
+    _groupWindow = std::chrono::milliseconds(groupMillis);
+    _pending = 0;
+    return true;
+}
+
+/**
+ * Commits anything still buffered and closes the file.
+ */
+void Journal::close() {
+    if (_fd < 0) {
+        return;
+    }
+    commit();
+    ::close(_fd);
+    _fd = -1;
+}
+
+/**
+ * Writes every buffered record and forces them to disk.
+ * @return true if all records are durable, false on an I/O error
+ */
+bool Journal::commit() {
+    if (_fd < 0) {
+        return false;
+    }
+    if (!writeBuffer()) {
+        return false;
+    }
+    return _pending == 0 || sync();
+}
+
+void Journal::accountInserted(const Account& account) {
+    string payload(1, JOURNAL_OP_INSERT);
+    putAccount(payload, account);
+    append(payload);
+}
+
+void Journal::accountRemoved(const Account& account) {
+    string payload(1, JOURNAL_OP_REMOVE);
+    putString(payload, account.getUsername());
+    putVarint(payload, account.getDiscriminator());
+    append(payload);
+}
+
+// One record, so a torn tail can never leave the account removed but not reinserted
+void Journal::accountUpdated(const Account&, const Account& after) {
+    string payload(1, JOURNAL_OP_UPDATE);
+    putAccount(payload, after);
+    append(payload);
+}
+
+void Journal::treeCleared() {
+    append(string(1, JOURNAL_OP_CLEAR));
+}
+
+/**
+ * Applies every intact record of the journal to a tree, in order. Replay stops at
+ * the first torn or corrupt record, which can only be the tail of a crashed write;
+ * the file is cut back to the last intact record so later appends follow it.
+ * The journal stops observing the tree so replayed changes are not logged twice;
+ * attach it again once replay is done.
+ * @param tree tree to apply the records to, usually just restored from a snapshot
+ * @return true if the journal was read, false on an I/O error
+ */
+bool Journal::replay(UTree& tree) {
+    if (_fd < 0 || !commit()) {
+        return false;
+    }
+    tree.removeObserver(this);
+    MappedFile file;
+    if (!file.open(_path)) {
+        _error = "could not map journal " + _path;
+        return false;
+    }
+    const char* data = file.getData();
+    const char* end = data + file.getSize();
+    const char* cursor = data;
+    _numReplayed = 0;
+    while (end - cursor >= JOURNAL_RECORD_HEADER) {
+        uint32_t length = getFixed32(cursor);
+        uint32_t checksum = getFixed32(cursor + 4);
+        const char* payload = cursor + JOURNAL_RECORD_HEADER;
+        if (length == 0 || length > static_cast<uint64_t>(end - payload) || crc32(payload, length) != checksum) {
+            break;
+        }
+        const char* field = payload + 1;
+        const char* payloadEnd = payload + length;
+        string username, badge, status;
+        uint64_t disc;
+        bool valid = true;
+        if (*payload == JOURNAL_OP_INSERT || *payload == JOURNAL_OP_UPDATE) {
+            valid = getString(field, payloadEnd, username) && getVarint(field, payloadEnd, disc) && field < payloadEnd;
+            bool nitro = valid && *field++ != 0;
+            valid = valid && disc <= MAX_DISC && getString(field, payloadEnd, badge) && getString(field, payloadEnd, status);
+            if (valid && *payload == JOURNAL_OP_INSERT) {
+                tree.insert(Account(username, static_cast<int>(disc), nitro, badge, status));
+            }
+            else if (valid) {
+                tree.update(Account(username, static_cast<int>(disc), nitro, badge, status));
+            }
+        }
+        else if (*payload == JOURNAL_OP_REMOVE) {
+            valid = getString(field, payloadEnd, username) && getVarint(field, payloadEnd, disc) && disc <= MAX_DISC;
+            DNode* removed = nullptr;
+            if (valid) {
+                tree.removeUser(username, static_cast<int>(disc), removed);
+            }
+        }
+        else if (*payload == JOURNAL_OP_CLEAR) {
+            tree.clear();
+        }
+        else {
+            valid = false;
+        }
+        if (!valid) {
+            break;
+        }
+        _numReplayed++;
+        cursor = payloadEnd;
+    }
+
+    //drop a torn tail so new records are not appended behind garbage
+    if (cursor != end && ftruncate(_fd, cursor - data) != 0) {
+        _error = string("could not truncate journal: ") + std::strerror(errno);
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Saves a snapshot of the tree and empties the journal, since the snapshot now
+ * holds every change it recorded. If the process dies between the two steps the
+ * journal is replayed on top of the new snapshot, which ends in the same state.
+ * @param tree tree the journal records
+ * @param snapshotPath where to write the snapshot
+ * @return true if the snapshot was written and the journal truncated
+ */
+bool Journal::checkpoint(UTree& tree, string snapshotPath) {
+    if (!commit()) {
+        return false;
+    }
+    if (!tree.saveSnapshot(snapshotPath)) {
+        _error = "could not write snapshot " + snapshotPath;
+        return false;
+    }
+    if (ftruncate(_fd, 0) != 0 || fsync(_fd) != 0) {
+        _error = string("could not truncate journal: ") + std::strerror(errno);
+        return false;
+    }
+    _numSyncs++;
+    return true;
+}
+
+// Frames a record and hands it to the sync policy
+void Journal::append(const string& payload) {
+    if (_fd < 0) {
+        return;
+    }
+    if (_pending == 0 && _buffer.empty()) {
+        _groupStart = std::chrono::steady_clock::now();
+    }
+    putFixed32(_buffer, payload.size());
+    putFixed32(_buffer, crc32(payload.data(), payload.size()));
+    _buffer.append(payload);
+    _pending++;
+    _numRecords++;
+
+    switch (_policy) {
+        case SYNC_ALWAYS:
+            commit();
+            break;
+        case SYNC_GROUP:
+            if (_pending >= _groupSize || std::chrono::steady_clock::now() - _groupStart >= _groupWindow) {
+                commit();
+            }
+            break;
+        case SYNC_NONE:
+            if (_buffer.size() >= JOURNAL_BUFFER_SIZE) {
+                writeBuffer();
+                _pending = 0;
+            }
+            break;
+    }
+}
+
+// Writes the buffered records to the file without syncing
+bool Journal::writeBuffer() {
+    const char* data = _buffer.data();
+    size_t remaining = _buffer.size();
+    while (remaining > 0) {
+        ssize_t count = ::write(_fd, data, remaining);
+        if (count < 0 && errno == EINTR) {
+            continue;
+        }
+        if (count <= 0) {
+            _error = string("journal write failed: ") + std::strerror(errno);
+            _buffer.erase(0, data - _buffer.data());
+            return false;
+        }
+        data += count;
+        remaining -= count;
+    }
+    _buffer.clear();
+    return true;
+}
+
+bool Journal::sync() {
+    if (fdatasync(_fd) != 0) {
+        _error = string("journal sync failed: ") + std::strerror(errno);
+        return false;
+    }
+    _pending = 0;
+    _numSyncs++;
+    return true;
+}
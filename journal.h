@@ -0,0 +1,87 @@
+/**
+ * Project 2 - Binary Trees
+ * journal.h
+ * An interface for the write-ahead journal of UTree changes.
+ */
+
+#pragma once
+
+#include "utree.h"
+#include <chrono>
+
+#define DEFAULT_GROUP_SIZE 256
+#define DEFAULT_GROUP_MILLIS 10
+#define JOURNAL_BUFFER_SIZE 65536
+
+/* When appended records are forced to disk */
+enum SyncPolicy {
+    SYNC_ALWAYS,    //write and fsync every record before the change returns
+    SYNC_GROUP,     //fsync once per group of records or group window, whichever fills first
+    SYNC_NONE       //write when the buffer fills, leave flushing to the OS
+};
+
+/**
+ * Append-only log of the inserts, removals, updates and clears made to a UTree.
+ * Attached as an observer, it records every change; on startup the log is
+ * replayed on top of the last snapshot, and checkpoint() writes a new snapshot
+ * and truncates the log.
+ *
+ * Typical restart:
+ *     tree.loadSnapshot(snapshotPath);
+ *     journal.open(journalPath);
+ *     journal.replay(tree);
+ *     tree.addObserver(&journal);
+ *
+ * Group commit happens on the calling thread: a group is synced when it fills
+ * or when a record arrives after the group window has passed, so callers that
+ * go idle should call commit() to bound how long records stay buffered.
+ *
+ * Record layout: fixed32 payload length | fixed32 CRC-32 of payload | payload,
+ * where the payload is an op byte ('I', 'R', 'U' or 'C') followed by the op's fields.
+ */
+class Journal : public UTreeObserver {
+public:
+    Journal();
+    ~Journal() {close();}
+
+    Journal(const Journal&) = delete;
+    Journal& operator=(const Journal&) = delete;
+
+    bool open(string path, SyncPolicy policy = SYNC_GROUP, size_t groupSize = DEFAULT_GROUP_SIZE,
+              int groupMillis = DEFAULT_GROUP_MILLIS);
+    void close();
+    bool commit();
+    bool replay(UTree& tree);
+    bool checkpoint(UTree& tree, string snapshotPath);
+
+    /* UTreeObserver */
+    void accountInserted(const Account& account) override;
+    void accountRemoved(const Account& account) override;
+    void accountUpdated(const Account& before, const Account& after) override;
+    void treeCleared() override;
+
+    /* Getters */
+    bool isOpen() const {return _fd >= 0;}
+    string getError() const {return _error;}
+    size_t getNumRecords() const {return _numRecords;}
+    size_t getNumSyncs() const {return _numSyncs;}
+    size_t getNumReplayed() const {return _numReplayed;}
+
+private:
+    int _fd;
+    string _path;
+    SyncPolicy _policy;
+    size_t _groupSize;
+    std::chrono::milliseconds _groupWindow;
+    string _buffer;         //encoded records not yet written
+    size_t _pending;        //records written or buffered since the last fsync
+    std::chrono::steady_clock::time_point _groupStart;
+    string _error;
+    size_t _numRecords;
+    size_t _numSyncs;
+    size_t _numReplayed;
+
+    void append(const string& payload);
+    bool writeBuffer();
+    bool sync();
+};
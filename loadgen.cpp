@@ -0,0 +1,270 @@
+/**
+ * Project 2 - Binary Trees
+ * loadgen.cpp
+ * A load generator for server: pipelines a random request mix over a Unix domain socket.
+ *
+ * Usage: loadgen SOCKET [requests] [depth] [connections] [usernames]
+ * Each connection keeps up to depth requests in flight. Usernames are user0 ..
+ * user<usernames - 1>, the names bench writes, so a server started with
+ * --load on a bench file answers most lookups. Prints throughput and latency as
+ * seen by the client, then the server's own STATS.
+ *
+ * Build: g++ -std=c++17 -O2 -pthread loadgen.cpp -o loadgen
+ */
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <string>
+#include <thread>
+#include <vector>
+
+using std::string;
+using std::vector;
+
+#define DEFAULT_LOADGEN_REQUESTS 1000000
+#define DEFAULT_LOADGEN_DEPTH 128
+#define DEFAULT_LOADGEN_USERNAMES 125000
+#define LOADGEN_READ_SIZE 65536
+
+static const char* BADGES[] = {"Early Supporter", "Bug Hunter", "HypeSquad", "Partner", "Staff", "None"};
+static const char* STATUSES[] = {"online", "offline", "idle", "dnd"};
+
+/* What one connection saw */
+struct ClientReport {
+    long numRequests = 0;
+    long numErrors = 0;
+    vector<uint64_t> latencies;     //nanoseconds from sending a request to reading its answer
+    string failure;
+};
+
+// Connects to the server's socket, -1 on failure
+static int connectTo(const string& path) {
+    sockaddr_un address = {};
+    if (path.size() >= sizeof(address.sun_path)) {
+        return -1;
+    }
+    address.sun_family = AF_UNIX;
+    std::memcpy(address.sun_path, path.c_str(), path.size() + 1);
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd >= 0 && connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static bool writeAll(int fd, const string& data) {
+    size_t written = 0;
+    while (written < data.size()) {
+        ssize_t count = write(fd, data.data() + written, data.size() - written);
+        if (count <= 0) {
+            return false;
+        }
+        written += count;
+    }
+    return true;
+}
+
+/**
+ * Reads answers line by line. PREFIX and STATS answers start with "OK n" and
+ * are followed by n more lines, which belong to the same answer.
+ */
+class AnswerReader {
+public:
+    AnswerReader(int fd): _fd(fd), _start(0) {}
+
+    /* True if a whole line has been read ahead */
+    bool hasLine() const {
+        return _buffer.find('\n', _start) != string::npos;
+    }
+
+    bool readLine(string& line) {
+        while (true) {
+            size_t newline = _buffer.find('\n', _start);
+            if (newline != string::npos) {
+                line.assign(_buffer, _start, newline - _start);
+                _start = newline + 1;
+                return true;
+            }
+            _buffer.erase(0, _start);
+            _start = 0;
+            size_t size = _buffer.size();
+            _buffer.resize(size + LOADGEN_READ_SIZE);
+            ssize_t count = read(_fd, &_buffer[size], LOADGEN_READ_SIZE);
+            _buffer.resize(size + std::max<ssize_t>(count, 0));
+            if (count <= 0) {
+                return false;
+            }
+        }
+    }
+
+    bool readAnswer(bool multiLine, string& answer) {
+        if (!readLine(answer)) {
+            return false;
+        }
+        long extra = (multiLine && answer.compare(0, 3, "OK ") == 0) ? std::atol(answer.c_str() + 3) : 0;
+        string line;
+        for (long l = 0; l < extra; l++) {
+            if (!readLine(line)) {
+                return false;
+            }
+            answer += '\n';
+            answer += line;
+        }
+        return true;
+    }
+
+private:
+    int _fd;
+    string _buffer;
+    size_t _start;
+};
+
+// Appends a random request: 30% INSERT, 10% REMOVE, 50% GET, 5% COUNT, 5% PREFIX
+static bool appendRequest(string& out, unsigned int& seed, long numNames) {
+    seed = seed * 1103515245 + 12345;
+    unsigned int kind = (seed >> 16) % 20;
+    seed = seed * 1103515245 + 12345;
+    string username = "user" + std::to_string((seed >> 8) % numNames);
+    int disc = (seed >> 4) % 10000;
+    if (kind < 6) {
+        out += "INSERT " + username + ',' + std::to_string(disc) + ',' + std::to_string(seed & 1) + ','
+             + BADGES[(seed >> 12) % 6] + ',' + STATUSES[(seed >> 16) % 4] + '\n';
+    }
+    else if (kind < 8) {
+        out += "REMOVE " + username + ' ' + std::to_string(disc) + '\n';
+    }
+    else if (kind < 18) {
+        out += "GET " + username + ' ' + std::to_string(disc) + '\n';
+    }
+    else if (kind < 19) {
+        out += "COUNT " + username + '\n';
+    }
+    else {
+        out += "PREFIX " + username + " 10\n";
+        return true;
+    }
+    return false;
+}
+
+/**
+ * Sends numRequests requests on one connection, topping the pipeline back up
+ * to depth whenever answers come back.
+ */
+static void runClient(const string& path, long numRequests, long depth, long numNames, unsigned int seed,
+                      ClientReport& report) {
+    int fd = connectTo(path);
+    if (fd < 0) {
+        report.failure = "cannot connect to " + path;
+        return;
+    }
+    struct Pending {
+        std::chrono::steady_clock::time_point sent;
+        bool multiLine;
+    };
+    std::deque<Pending> pending;
+    AnswerReader reader(fd);
+    string requests;
+    string answer;
+    long numSent = 0;
+    report.latencies.reserve(numRequests);
+    while (report.numRequests < numRequests) {
+        requests.clear();
+        auto now = std::chrono::steady_clock::now();
+        while (numSent < numRequests && static_cast<long>(pending.size()) < depth) {
+            pending.push_back({now, appendRequest(requests, seed, numNames)});
+            numSent++;
+        }
+        if (!requests.empty() && !writeAll(fd, requests)) {
+            report.failure = "write failed";
+            break;
+        }
+        //read at least one answer, then whatever else already arrived
+        do {
+            Pending front = pending.front();
+            if (!reader.readAnswer(front.multiLine, answer)) {
+                report.failure = "server closed the connection";
+                close(fd);
+                return;
+            }
+            pending.pop_front();
+            report.latencies.push_back(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now() - front.sent).count());
+            report.numRequests++;
+            if (answer.compare(0, 3, "ERR") == 0) {
+                report.numErrors++;
+            }
+        } while (!pending.empty() && reader.hasLine());
+    }
+    close(fd);
+}
+
+static double percentileMicros(const vector<uint64_t>& sorted, double fraction) {
+    if (sorted.empty()) {
+        return 0;
+    }
+    return sorted[std::min(sorted.size() - 1, static_cast<size_t>(fraction * sorted.size()))] / 1e3;
+}
+
+int main(int argc, char** argv) {
+    if (argc < 2) {
+        std::fprintf(stderr, "usage: %s SOCKET [requests] [depth] [connections] [usernames]\n", argv[0]);
+        return 2;
+    }
+    string path = argv[1];
+    long numRequests = (argc > 2) ? std::atol(argv[2]) : DEFAULT_LOADGEN_REQUESTS;
+    long depth = std::max(1L, (argc > 3) ? std::atol(argv[3]) : DEFAULT_LOADGEN_DEPTH);
+    long numClients = std::max(1L, (argc > 4) ? std::atol(argv[4]) : 1L);
+    long numNames = std::max(1L, (argc > 5) ? std::atol(argv[5]) : DEFAULT_LOADGEN_USERNAMES);
+
+    vector<ClientReport> reports(numClients);
+    vector<std::thread> clients;
+    auto start = std::chrono::steady_clock::now();
+    for (long c = 0; c < numClients; c++) {
+        long share = numRequests / numClients + (c < numRequests % numClients ? 1 : 0);
+        clients.emplace_back(runClient, path, share, depth, numNames, static_cast<unsigned int>(221 + c),
+                             std::ref(reports[c]));
+    }
+    for (std::thread& client : clients) {
+        client.join();
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    vector<uint64_t> latencies;
+    long total = 0;
+    long errors = 0;
+    for (const ClientReport& report : reports) {
+        if (!report.failure.empty()) {
+            std::fprintf(stderr, "client failed: %s\n", report.failure.c_str());
+            return 1;
+        }
+        latencies.insert(latencies.end(), report.latencies.begin(), report.latencies.end());
+        total += report.numRequests;
+        errors += report.numErrors;
+    }
+    std::sort(latencies.begin(), latencies.end());
+    std::printf("%ld requests on %ld connections, depth %ld: %.0f requests/s, %ld errors\n",
+                total, numClients, depth, total / seconds, errors);
+    std::printf("client latency us: p50 %.1f p99 %.1f p999 %.1f max %.1f\n", percentileMicros(latencies, 0.5),
+                percentileMicros(latencies, 0.99), percentileMicros(latencies, 0.999), percentileMicros(latencies, 1.0));
+
+    int fd = connectTo(path);
+    string stats;
+    if (fd >= 0 && writeAll(fd, "STATS\n")) {
+        AnswerReader reader(fd);
+        if (reader.readAnswer(true, stats)) {
+            std::printf("server %s\n", stats.c_str());
+        }
+    }
+    if (fd >= 0) {
+        close(fd);
+    }
+    return 0;
+}
@@ -0,0 +1,723 @@
+/**
+ * Project 2 - Binary Trees
+ * mappedtree.cpp
+ * Implementation for the MappedUTree class.
+ */
+
+#include "mappedtree.h"
+#include "utree.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Size of the block that holds a request of the given size, and the free list it goes back to
+static uint64_t blockSize(uint64_t bytes, int& sizeClass) {
+    bytes = std::max<uint64_t>((bytes + 7) & ~static_cast<uint64_t>(7), 8);
+    if (bytes <= 8 * MAPPED_SMALL_CLASSES) {
+        sizeClass = static_cast<int>(bytes / 8) - 1;
+        return bytes;
+    }
+    uint64_t size = 16 * MAPPED_SMALL_CLASSES;
+    sizeClass = MAPPED_SMALL_CLASSES;
+    while (size < bytes) {
+        size <<= 1;
+        sizeClass++;
+    }
+    return size;
+}
+
+static uint64_t blockSize(uint64_t bytes) {
+    int sizeClass;
+    return blockSize(bytes, sizeClass);
+}
+
+/**
+ * Opens a tree file, creating an empty tree if the file does not exist or is empty.
+ * Nothing but the mapping is set up, records are paged in when they are touched.
+ * @param path path of the tree file
+ * @return true if the file was opened, false if it could not be or is not a tree file
+ */
+bool MappedUTree::open(string path) {
+    close();
+    _fd = ::open(path.c_str(), O_RDWR | O_CREAT, 0644);
+    struct stat info;
+    if (_fd < 0 || fstat(_fd, &info) != 0) {
+        _error = "could not open " + path + ": " + std::strerror(errno);
+        close();
+        return false;
+    }
+    uint64_t size = static_cast<uint64_t>(info.st_size);
+    bool fresh = (size == 0);
+    if (fresh) {
+        size = MAPPED_INITIAL_SIZE;
+        if (ftruncate(_fd, size) != 0) {
+            _error = "could not size " + path + ": " + std::strerror(errno);
+            close();
+            return false;
+        }
+    }
+    else if (size < sizeof(MappedHeader)) {
+        _error = path + " is not a tree file";
+        close();
+        return false;
+    }
+    void* mapped = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, _fd, 0);
+    if (mapped == MAP_FAILED) {
+        _error = "could not map " + path + ": " + std::strerror(errno);
+        close();
+        return false;
+    }
+    _base = static_cast<char*>(mapped);
+    _mapped = size;
+
+    MappedHeader* h = header();
+    if (fresh) {
+        std::memset(h, 0, sizeof(MappedHeader));
+        std::memcpy(h->magic, MAPPED_MAGIC, MAPPED_MAGIC_SIZE);
+        h->version = MAPPED_VERSION;
+        h->capacity = size;
+        h->used = blockSize(sizeof(MappedHeader));
+    }
+    else if (std::memcmp(h->magic, MAPPED_MAGIC, MAPPED_MAGIC_SIZE) != 0 || h->version != MAPPED_VERSION
+             || h->capacity > size || h->used > h->capacity) {
+        _error = path + " is not a tree file of version " + std::to_string(MAPPED_VERSION);
+        close();
+        return false;
+    }
+    else if (h->capacity < size) {
+        //reserve() grew the file but did not get to record it, the zeroed tail is free space
+        h->capacity = size;
+    }
+    return true;
+}
+
+/**
+ * Unmaps the file; the kernel writes dirty pages back, call sync() first to wait for it.
+ */
+void MappedUTree::close() {
+    if (_base != nullptr) {
+        munmap(_base, _mapped);
+        _base = nullptr;
+        _mapped = 0;
+    }
+    if (_fd >= 0) {
+        ::close(_fd);
+        _fd = -1;
+    }
+}
+
+/**
+ * Forces every change made so far to disk.
+ * @return true if the file was synced, false otherwise
+ */
+bool MappedUTree::sync() {
+    if (!isOpen() || msync(_base, _mapped, MS_SYNC) != 0) {
+        _error = string("sync failed: ") + std::strerror(errno);
+        return false;
+    }
+    return true;
+}
+
+/* Writes the accounts UTree::replayContents reports, which come in username then
+ * discriminator order, as records; each username's DNodes are linked once it is done */
+class MappedUTree::Importer : public UTreeObserver {
+public:
+    explicit Importer(MappedUTree& tree): _tree(tree), _numAccounts(0), _failed(false) {}
+
+    void accountInserted(const Account& account) override {
+        if (_failed) {
+            return;
+        }
+        string username = account.getUsername();
+        uint64_t worstCase = blockSize(sizeof(MappedUNode)) + blockSize(sizeof(MappedDNode))
+                           + blockSize(sizeof(uint32_t) + username.size())
+                           + blockSize(sizeof(uint32_t) + account.getBadge().size())
+                           + blockSize(sizeof(uint32_t) + account.getStatus().size());
+        if (!_tree.reserve(worstCase)) {
+            _failed = true;
+            return;
+        }
+        if (_users.empty() || username != _username) {
+            finishUser();
+            Offset created = _tree.allocate(sizeof(MappedUNode));
+            Offset name = _tree.storeString(username);
+            _tree.at<MappedUNode>(created)->username = name;
+            _users.push_back(created);
+            _username = username;
+        }
+        Offset created = _tree.allocate(sizeof(MappedDNode));
+        Offset badge = _tree.storeString(account.getBadge());
+        Offset status = _tree.storeString(account.getStatus());
+        MappedDNode* entry = _tree.at<MappedDNode>(created);
+        entry->badge = badge;
+        entry->status = status;
+        entry->disc = static_cast<int16_t>(account.getDiscriminator());
+        entry->nitro = account.hasNitro() ? 1 : 0;
+        _discs.push_back(created);
+        _numAccounts++;
+    }
+    void accountRemoved(const Account&) override {}
+    void treeCleared() override {}
+
+    // Links the DNodes of the last username into a balanced DTree
+    void finishUser() {
+        if (_discs.empty()) {
+            return;
+        }
+        MappedUNode* user = _tree.at<MappedUNode>(_users.back());
+        user->numLive = static_cast<int32_t>(_discs.size());
+        user->dtree = _tree.buildBalanced(_discs, 0, static_cast<int>(_discs.size()) - 1);
+        _discs.clear();
+    }
+
+    vector<Offset>& getUsers() {return _users;}
+    uint64_t getNumAccounts() const {return _numAccounts;}
+    bool hasFailed() const {return _failed;}
+
+private:
+    MappedUTree& _tree;
+    vector<Offset> _users;      //UNode records in username order
+    vector<Offset> _discs;      //DNode records of the current username
+    string _username;
+    uint64_t _numAccounts;
+    bool _failed;
+};
+
+/**
+ * Fills a new tree file with every account of a UTree. Records are written in key
+ * order and each level is linked balanced once, instead of rebalancing per insert,
+ * so a tree loaded from a .csv or snapshot can be turned into a file to open later.
+ * @param tree UTree to copy, left unchanged
+ * @return true if the accounts were copied, false if the file is not open, has
+ * been written to before or could not grow, in which case it is left empty
+ */
+bool MappedUTree::importTree(const UTree& tree) {
+    if (!isOpen()) {
+        return false;
+    }
+    uint64_t start = blockSize(sizeof(MappedHeader));
+    if (header()->used != start) {
+        _error = "can only import into a new tree file";
+        return false;
+    }
+    Importer importer(*this);
+    tree.replayContents(&importer);
+    importer.finishUser();
+    MappedHeader* h = header();
+    if (importer.hasFailed()) {
+        //nothing but the import was ever allocated, so dropping it is resetting the header
+        h->used = start;
+        std::memset(h->freeLists, 0, sizeof(h->freeLists));
+        return false;
+    }
+    vector<Offset>& users = importer.getUsers();
+    h->root = buildUsers(users, 0, static_cast<int>(users.size()) - 1);
+    h->numUsernames = users.size();
+    h->numAccounts = importer.getNumAccounts();
+    return true;
+}
+
+/**
+ * Inserts an account, adding a username record if it is new.
+ * @param newAcct Account object to insert
+ * @return true if the account was inserted, false if the discriminator is taken or
+ * the file could not grow
+ */
+bool MappedUTree::insert(Account newAcct) {
+    if (!isOpen() || newAcct.getDiscriminator() < MIN_DISC || newAcct.getDiscriminator() > MAX_DISC) {
+        return false;
+    }
+    string username = newAcct.getUsername();
+    //room for every record the insert can create, so the mapping cannot move mid-insert
+    uint64_t worstCase = blockSize(sizeof(MappedUNode)) + blockSize(sizeof(MappedDNode))
+                       + blockSize(sizeof(uint32_t) + username.size())
+                       + blockSize(sizeof(uint32_t) + newAcct.getBadge().size())
+                       + blockSize(sizeof(uint32_t) + newAcct.getStatus().size());
+    if (!reserve(worstCase)) {
+        return false;
+    }
+    if (!insertUser(header()->root, newAcct, username)) {
+        return false;
+    }
+    header()->numAccounts++;
+    return true;
+}
+
+/**
+ * Removes an account; a username left without accounts is unlinked and its records freed.
+ * @param username username to match
+ * @param disc discriminator to match
+ * @return true if an account was removed, false otherwise
+ */
+bool MappedUTree::removeUser(string username, int disc) {
+    if (!isOpen() || !removeUser(header()->root, username, disc)) {
+        return false;
+    }
+    header()->numAccounts--;
+    return true;
+}
+
+/**
+ * Retrieves a copy of the specified account.
+ * @param username username to match
+ * @param disc discriminator to match
+ * @param found filled with the account if it exists
+ * @return true if the account exists, false otherwise
+ */
+bool MappedUTree::retrieveUser(string username, int disc, Account& found) const {
+    Offset user = findUser(username);
+    if (user == 0) {
+        return false;
+    }
+    Offset node = findDisc(at<MappedUNode>(user)->dtree, disc);
+    if (node == 0 || at<MappedDNode>(node)->vacant) {
+        return false;
+    }
+    found = toAccount(node, username);
+    return true;
+}
+
+/**
+ * Returns the number of accounts with a specific username.
+ * @param username username to match
+ * @return number of accounts with the username
+ */
+int MappedUTree::numUsers(string username) const {
+    Offset user = findUser(username);
+    return (user == 0) ? 0 : at<MappedUNode>(user)->numLive;
+}
+
+/**
+ * Prints all accounts' details in username then discriminator order.
+ */
+void MappedUTree::printUsers() const {
+    if (isOpen()) {
+        printUsers(header()->root);
+    }
+}
+
+/**
+ * Dumps the username tree in the '()' notation.
+ */
+void MappedUTree::dump() const {
+    if (isOpen()) {
+        dump(header()->root);
+    }
+}
+
+// Makes sure bytes can be allocated without moving the mapping
+bool MappedUTree::reserve(uint64_t bytes) {
+    MappedHeader* h = header();
+    if (h->used + bytes <= h->capacity) {
+        return true;
+    }
+    uint64_t capacity = h->capacity * 2;
+    while (capacity < h->used + bytes) {
+        capacity *= 2;
+    }
+    if (ftruncate(_fd, capacity) != 0) {
+        _error = string("could not grow file: ") + std::strerror(errno);
+        return false;
+    }
+    void* moved = mremap(_base, _mapped, capacity, MREMAP_MAYMOVE);
+    if (moved == MAP_FAILED) {
+        _error = string("could not remap file: ") + std::strerror(errno);
+        return false;
+    }
+    _base = static_cast<char*>(moved);
+    _mapped = capacity;
+    //only once the file has grown, so a crash never leaves capacity past the end of the file
+    header()->capacity = capacity;
+    return true;
+}
+
+// Takes a zeroed block from its free list or the end of the file; reserve() must have made room
+Offset MappedUTree::allocate(uint64_t bytes) {
+    int sizeClass;
+    uint64_t size = blockSize(bytes, sizeClass);
+    MappedHeader* h = header();
+    Offset block = h->freeLists[sizeClass];
+    if (block != 0) {
+        h->freeLists[sizeClass] = *at<Offset>(block);
+    }
+    else {
+        block = h->used;
+        h->used += size;
+    }
+    std::memset(_base + block, 0, size);
+    return block;
+}
+
+// Pushes a block onto the free list of its size
+void MappedUTree::release(Offset offset, uint64_t bytes) {
+    int sizeClass;
+    blockSize(bytes, sizeClass);
+    MappedHeader* h = header();
+    *at<Offset>(offset) = h->freeLists[sizeClass];
+    h->freeLists[sizeClass] = offset;
+}
+
+// String records are a 32-bit length followed by the bytes
+Offset MappedUTree::storeString(string_view text) {
+    Offset record = allocate(sizeof(uint32_t) + text.size());
+    *at<uint32_t>(record) = static_cast<uint32_t>(text.size());
+    std::memcpy(_base + record + sizeof(uint32_t), text.data(), text.size());
+    return record;
+}
+
+string_view MappedUTree::loadString(Offset offset) const {
+    if (offset == 0) {
+        return string_view();
+    }
+    return string_view(_base + offset + sizeof(uint32_t), *at<uint32_t>(offset));
+}
+
+void MappedUTree::releaseString(Offset offset) {
+    if (offset != 0) {
+        release(offset, sizeof(uint32_t) + *at<uint32_t>(offset));
+    }
+}
+
+Offset MappedUTree::findUser(string_view username) const {
+    if (!isOpen()) {
+        return 0;
+    }
+    Offset node = header()->root;
+    while (node != 0) {
+        const MappedUNode* user = at<MappedUNode>(node);
+        int order = username.compare(loadString(user->username));
+        if (order == 0) {
+            return node;
+        }
+        node = (order < 0) ? user->left : user->right;
+    }
+    return 0;
+}
+
+bool MappedUTree::insertUser(Offset& node, const Account& account, string_view username) {
+    if (node == 0) {
+        Offset created = allocate(sizeof(MappedUNode));
+        Offset name = storeString(username);
+        MappedUNode* user = at<MappedUNode>(created);
+        user->username = name;
+        user->height = 1;
+        user->numLive = 1;
+        insertDisc(user->dtree, account);
+        node = created;
+        header()->numUsernames++;
+        return true;
+    }
+    MappedUNode* user = at<MappedUNode>(node);
+    int order = username.compare(loadString(user->username));
+    if (order == 0) {
+        if (!insertDisc(user->dtree, account)) {
+            return false;
+        }
+        user->numLive++;
+        rebalancePath(user->dtree, account.getDiscriminator());
+        return true;
+    }
+    bool inserted = insertUser((order < 0) ? user->left : user->right, account, username);
+    if (inserted) {
+        updateHeight(node);
+        rebalance(node);
+    }
+    return inserted;
+}
+
+bool MappedUTree::removeUser(Offset& node, string_view username, int disc) {
+    if (node == 0) {
+        return false;
+    }
+    MappedUNode* user = at<MappedUNode>(node);
+    int order = username.compare(loadString(user->username));
+    if (order != 0) {
+        bool removed = removeUser((order < 0) ? user->left : user->right, username, disc);
+        if (removed) {
+            updateHeight(node);
+            rebalance(node);
+        }
+        return removed;
+    }
+    if (!removeDisc(user->dtree, disc)) {
+        return false;
+    }
+    if (--user->numLive > 0) {
+        return true;
+    }
+
+    //that was the last account, unlink the username
+    Offset doomed = node;
+    if (user->left == 0 || user->right == 0) {
+        node = (user->left != 0) ? user->left : user->right;
+    }
+    else {
+        Offset successor = removeMin(user->right);
+        MappedUNode* next = at<MappedUNode>(successor);
+        next->left = user->left;
+        next->right = user->right;
+        node = successor;
+        updateHeight(node);
+        rebalance(node);
+    }
+    releaseDTree(user->dtree);
+    releaseString(user->username);
+    release(doomed, sizeof(MappedUNode));
+    header()->numUsernames--;
+    return true;
+}
+
+// Unlinks the leftmost node of a subtree and returns it
+Offset MappedUTree::removeMin(Offset& node) {
+    MappedUNode* user = at<MappedUNode>(node);
+    if (user->left == 0) {
+        Offset min = node;
+        node = user->right;
+        return min;
+    }
+    Offset min = removeMin(user->left);
+    updateHeight(node);
+    rebalance(node);
+    return min;
+}
+
+void MappedUTree::updateHeight(Offset node) {
+    MappedUNode* user = at<MappedUNode>(node);
+    user->height = 1 + std::max(height(user->left), height(user->right));
+}
+
+// Links sorted UNode records into a perfectly balanced subtree
+Offset MappedUTree::buildUsers(vector<Offset>& users, int start, int end) {
+    if (start > end) {
+        return 0;
+    }
+    int mid = (start + end) / 2;
+    Offset left = buildUsers(users, start, mid - 1);
+    Offset right = buildUsers(users, mid + 1, end);
+    MappedUNode* user = at<MappedUNode>(users[mid]);
+    user->left = left;
+    user->right = right;
+    updateHeight(users[mid]);
+    return users[mid];
+}
+
+void MappedUTree::rebalance(Offset& node) {
+    MappedUNode* user = at<MappedUNode>(node);
+    int balance = height(user->left) - height(user->right);
+    if (balance > 1) {
+        MappedUNode* left = at<MappedUNode>(user->left);
+        if (height(left->left) < height(left->right)) {
+            zigLeft(user->left);
+        }
+        zigRight(node);
+    }
+    else if (balance < -1) {
+        MappedUNode* right = at<MappedUNode>(user->right);
+        if (height(right->right) < height(right->left)) {
+            zigRight(user->right);
+        }
+        zigLeft(node);
+    }
+}
+
+void MappedUTree::zigLeft(Offset& node) {
+    Offset pivot = at<MappedUNode>(node)->right;
+    at<MappedUNode>(node)->right = at<MappedUNode>(pivot)->left;
+    at<MappedUNode>(pivot)->left = node;
+    updateHeight(node);
+    updateHeight(pivot);
+    node = pivot;
+}
+
+void MappedUTree::zigRight(Offset& node) {
+    Offset pivot = at<MappedUNode>(node)->left;
+    at<MappedUNode>(node)->left = at<MappedUNode>(pivot)->right;
+    at<MappedUNode>(pivot)->right = node;
+    updateHeight(node);
+    updateHeight(pivot);
+    node = pivot;
+}
+
+void MappedUTree::printUsers(Offset node) const {
+    if (node == 0) {
+        return;
+    }
+    const MappedUNode* user = at<MappedUNode>(node);
+    printUsers(user->left);
+    printAccounts(user->dtree, loadString(user->username));
+    printUsers(user->right);
+}
+
+void MappedUTree::dump(Offset node) const {
+    if (node == 0) {
+        return;
+    }
+    const MappedUNode* user = at<MappedUNode>(node);
+    cout << "(";
+    dump(user->left);
+    cout << loadString(user->username) << ":" << user->height << ":" << user->numLive;
+    dump(user->right);
+    cout << ")";
+}
+
+bool MappedUTree::insertDisc(Offset& node, const Account& account) {
+    int disc = account.getDiscriminator();
+    if (node == 0) {
+        Offset created = allocate(sizeof(MappedDNode));
+        Offset badge = storeString(account.getBadge());
+        Offset status = storeString(account.getStatus());
+        MappedDNode* entry = at<MappedDNode>(created);
+        entry->badge = badge;
+        entry->status = status;
+        entry->disc = static_cast<int16_t>(disc);
+        entry->nitro = account.hasNitro() ? 1 : 0;
+        entry->size = 1;
+        node = created;
+        return true;
+    }
+    MappedDNode* entry = at<MappedDNode>(node);
+    if (disc == entry->disc) {
+        if (!entry->vacant) {
+            return false;
+        }
+        //reuse the vacancy left by a removal of the same discriminator
+        entry->badge = storeString(account.getBadge());
+        entry->status = storeString(account.getStatus());
+        entry->nitro = account.hasNitro() ? 1 : 0;
+        entry->vacant = 0;
+        entry->numVacant--;
+        return true;
+    }
+    bool inserted = insertDisc((disc < entry->disc) ? entry->left : entry->right, account);
+    if (inserted) {
+        refreshCounts(node);
+    }
+    return inserted;
+}
+
+bool MappedUTree::removeDisc(Offset node, int disc) {
+    if (node == 0) {
+        return false;
+    }
+    MappedDNode* entry = at<MappedDNode>(node);
+    if (disc == entry->disc) {
+        if (entry->vacant) {
+            return false;
+        }
+        releaseString(entry->badge);
+        releaseString(entry->status);
+        entry->badge = 0;
+        entry->status = 0;
+        entry->vacant = 1;
+        entry->numVacant++;
+        return true;
+    }
+    bool removed = removeDisc((disc < entry->disc) ? entry->left : entry->right, disc);
+    if (removed) {
+        entry->numVacant++;
+    }
+    return removed;
+}
+
+Offset MappedUTree::findDisc(Offset node, int disc) const {
+    while (node != 0) {
+        const MappedDNode* entry = at<MappedDNode>(node);
+        if (disc == entry->disc) {
+            return node;
+        }
+        node = (disc < entry->disc) ? entry->left : entry->right;
+    }
+    return 0;
+}
+
+// Recomputes a node's size and vacancy count from its children
+void MappedUTree::refreshCounts(Offset node) {
+    MappedDNode* entry = at<MappedDNode>(node);
+    entry->size = 1 + sizeOf(entry->left) + sizeOf(entry->right);
+    entry->numVacant = (entry->vacant ? 1 : 0) + numVacantOf(entry->left) + numVacantOf(entry->right);
+}
+
+// Rebuilds the highest subtree on the path to disc that breaks the 'Discord' rules
+void MappedUTree::rebalancePath(Offset& node, int disc) {
+    if (node == 0) {
+        return;
+    }
+    MappedDNode* entry = at<MappedDNode>(node);
+    int leftSize = sizeOf(entry->left);
+    int rightSize = sizeOf(entry->right);
+    if ((leftSize >= 4 || rightSize >= 4) && (leftSize > 1.5 * rightSize || rightSize > 1.5 * leftSize)) {
+        vector<Offset> live;
+        collectLive(node, live);
+        node = buildBalanced(live, 0, static_cast<int>(live.size()) - 1);
+        return;
+    }
+    if (disc == entry->disc) {
+        return;
+    }
+    rebalancePath((disc < entry->disc) ? entry->left : entry->right, disc);
+    refreshCounts(node);
+}
+
+// In-order list of the non-vacant nodes of a subtree; vacant nodes are freed
+void MappedUTree::collectLive(Offset node, vector<Offset>& live) {
+    if (node == 0) {
+        return;
+    }
+    MappedDNode* entry = at<MappedDNode>(node);
+    collectLive(entry->left, live);
+    if (entry->vacant) {
+        Offset right = entry->right;
+        release(node, sizeof(MappedDNode));
+        collectLive(right, live);
+        return;
+    }
+    live.push_back(node);
+    collectLive(entry->right, live);
+}
+
+Offset MappedUTree::buildBalanced(vector<Offset>& live, int start, int end) {
+    if (start > end) {
+        return 0;
+    }
+    int mid = (start + end) / 2;
+    MappedDNode* entry = at<MappedDNode>(live[mid]);
+    entry->left = buildBalanced(live, start, mid - 1);
+    entry->right = buildBalanced(live, mid + 1, end);
+    entry->size = end - start + 1;
+    entry->numVacant = 0;
+    return live[mid];
+}
+
+void MappedUTree::releaseDTree(Offset node) {
+    if (node == 0) {
+        return;
+    }
+    MappedDNode* entry = at<MappedDNode>(node);
+    releaseDTree(entry->left);
+    releaseDTree(entry->right);
+    releaseString(entry->badge);
+    releaseString(entry->status);
+    release(node, sizeof(MappedDNode));
+}
+
+void MappedUTree::printAccounts(Offset node, string_view username) const {
+    if (node == 0) {
+        return;
+    }
+    const MappedDNode* entry = at<MappedDNode>(node);
+    printAccounts(entry->left, username);
+    if (!entry->vacant) {
+        cout << toAccount(node, username) << endl;
+    }
+    printAccounts(entry->right, username);
+}
+
+Account MappedUTree::toAccount(Offset node, string_view username) const {
+    const MappedDNode* entry = at<MappedDNode>(node);
+    return Account(string(username), entry->disc, entry->nitro != 0,
+                   string(loadString(entry->badge)), string(loadString(entry->status)));
+}
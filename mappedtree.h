@@ -0,0 +1,148 @@
+/**
+ * Project 2 - Binary Trees
+ * mappedtree.h
+ * An interface for the MappedUTree class, a UTree kept in a memory-mapped file.
+ */
+
+#pragma once
+
+#include "dtree.h"
+#include <cstdint>
+#include <string_view>
+
+using std::string_view;
+
+#define MAPPED_MAGIC "DTMAPPED"
+#define MAPPED_MAGIC_SIZE 8
+#define MAPPED_VERSION 1
+#define MAPPED_INITIAL_SIZE (1 << 20)
+#define MAPPED_SMALL_CLASSES 64     //exact free lists for blocks of 8 .. 512 bytes
+#define MAPPED_NUM_CLASSES (MAPPED_SMALL_CLASSES + 48)
+
+class UTree;
+
+/* Position of a record as a byte offset from the start of the file, 0 is null */
+typedef uint64_t Offset;
+
+/* First bytes of the file */
+struct MappedHeader {
+    char magic[MAPPED_MAGIC_SIZE];
+    uint32_t version;
+    uint32_t reserved;
+    uint64_t capacity;          //size of the file
+    uint64_t used;              //end of the allocated region
+    Offset root;                //root MappedUNode
+    uint64_t numUsernames;
+    uint64_t numAccounts;
+    Offset freeLists[MAPPED_NUM_CLASSES];
+};
+
+/* UNode record: an AVL node keyed by username */
+struct MappedUNode {
+    Offset left;
+    Offset right;
+    Offset dtree;               //root MappedDNode
+    Offset username;            //string record
+    int32_t height;
+    int32_t numLive;            //non-vacant accounts in the DTree
+};
+
+/* DNode record: a node of the discriminator tree */
+struct MappedDNode {
+    Offset left;
+    Offset right;
+    Offset badge;               //string record, 0 while vacant
+    Offset status;              //string record, 0 while vacant
+    int32_t size;
+    int32_t numVacant;
+    int16_t disc;
+    uint8_t nitro;
+    uint8_t vacant;
+};
+
+/**
+ * A UTree whose UNode and DNode records live in a memory-mapped file and link to
+ * each other by offsets instead of pointers, so the file is valid at any address.
+ * Opening an existing file only maps it; pages are read in as lookups touch them.
+ * A new file is filled from a loaded UTree by importTree, or one insert at a time.
+ * The file grows by remapping, which is why every pointer into the mapping is
+ * re-derived from an offset after an allocation could have grown it.
+ *
+ * Usernames are balanced with AVL rules and discriminators with the 'Discord'
+ * rules of DTree: removal leaves a vacant node that a later insert of the same
+ * discriminator reuses, and a lopsided subtree is rebuilt without its vacancies.
+ */
+class MappedUTree {
+public:
+    MappedUTree(): _fd(-1), _base(nullptr), _mapped(0) {}
+    ~MappedUTree() {close();}
+
+    MappedUTree(const MappedUTree&) = delete;
+    MappedUTree& operator=(const MappedUTree&) = delete;
+
+    bool open(string path);
+    void close();
+    bool sync();
+    bool importTree(const UTree& tree);
+
+    bool insert(Account newAcct);
+    bool removeUser(string username, int disc);
+    bool retrieveUser(string username, int disc, Account& found) const;
+    int numUsers(string username) const;
+    void printUsers() const;
+    void dump() const;
+
+    /* Getters */
+    bool isOpen() const {return _base != nullptr;}
+    string getError() const {return _error;}
+    uint64_t getNumUsernames() const {return header()->numUsernames;}
+    uint64_t getNumAccounts() const {return header()->numAccounts;}
+    uint64_t getCapacity() const {return header()->capacity;}
+
+private:
+    int _fd;
+    char* _base;
+    uint64_t _mapped;
+    string _error;
+
+    class Importer;     //the UTreeObserver importTree replays a UTree into
+
+    MappedHeader* header() const {return reinterpret_cast<MappedHeader*>(_base);}
+    template <class T> T* at(Offset offset) const {return reinterpret_cast<T*>(_base + offset);}
+
+    /* Storage */
+    bool reserve(uint64_t bytes);
+    Offset allocate(uint64_t bytes);
+    void release(Offset offset, uint64_t bytes);
+    Offset storeString(string_view text);
+    string_view loadString(Offset offset) const;
+    void releaseString(Offset offset);
+
+    /* Username level */
+    Offset findUser(string_view username) const;
+    bool insertUser(Offset& node, const Account& account, string_view username);
+    bool removeUser(Offset& node, string_view username, int disc);
+    Offset removeMin(Offset& node);
+    int height(Offset node) const {return (node == 0) ? 0 : at<MappedUNode>(node)->height;}
+    void updateHeight(Offset node);
+    Offset buildUsers(vector<Offset>& users, int start, int end);
+    void rebalance(Offset& node);
+    void zigLeft(Offset& node);
+    void zigRight(Offset& node);
+    void printUsers(Offset node) const;
+    void dump(Offset node) const;
+
+    /* Discriminator level */
+    bool insertDisc(Offset& node, const Account& account);
+    bool removeDisc(Offset node, int disc);
+    Offset findDisc(Offset node, int disc) const;
+    int sizeOf(Offset node) const {return (node == 0) ? 0 : at<MappedDNode>(node)->size;}
+    int numVacantOf(Offset node) const {return (node == 0) ? 0 : at<MappedDNode>(node)->numVacant;}
+    void refreshCounts(Offset node);
+    void rebalancePath(Offset& node, int disc);
+    void collectLive(Offset node, vector<Offset>& live);
+    Offset buildBalanced(vector<Offset>& live, int start, int end);
+    void releaseDTree(Offset node);
+    void printAccounts(Offset node, string_view username) const;
+    Account toAccount(Offset node, string_view username) const;
+};
@@ -6,17 +6,28 @@
  * Project 2 - Binary Trees
  * mytest.cpp
  * A test file for the DTree class.
+ *
+ * Build: g++ -std=c++17 -pthread mytest.cpp utree.cpp dtree.cpp csvloader.cpp snapshot.cpp export.cpp
+ *        columnar.cpp accountcache.cpp usernamefilter.cpp usernameindex.cpp journal.cpp
+ *        bitmap.cpp bitmapindex.cpp discindex.cpp query.cpp mappedtree.cpp streamloader.cpp -o mytest
  */
 
 #include <iostream>
 #include "dtree.h"
 #include "utree.h"
+#include "journal.h"
+#include "bitmapindex.h"
+#include "discindex.h"
+#include "query.h"
+#include "mappedtree.h"
+#include "streamloader.h"
 #include <fstream>
 #include <sstream>
 #include <string>
 #include <vector>
 #include <stdexcept>
 #include <cstdlib>
+#include <cstdio>
 #include <iomanip> // For std::setw
 
 using std::cout, std::endl, std::string, std::ostream;
@@ -399,7 +410,355 @@ void testUTreeDump() {
     tree.insert(Account("user2", 2, 200, "email2", "phone2"));
     tree.insert(Account("user3", 3, 300, "email3", "phone3"));
     cout << "Dumping the tree structure:" << endl;
-    tree.dump(tree.getRoot());
+    tree.dump();
+}
+
+void testUTreeInsertBatchVacancies() {
+    // Three trees where user "u" holds discriminators 50 to 69, then loses 50, the DTree's root
+    UTree single, small, merged;
+    for (UTree* tree : {&single, &small, &merged}) {
+        for (int disc = 50; disc < 70; disc++) {
+            tree->insert(Account("u", disc, false, "badge", "online"));
+        }
+        DNode* removed = nullptr;
+        tree->removeUser("u", 50, removed);
+    }
+
+    // Reinsert 50 alone, as a small group and in a group that merges
+    bool result = single.insert(Account("u", 50, false, "badge", "online"));
+    cout << "Insert removed u#50: " << result << " (expected: 1)" << endl;
+    cout << "Test " << (result && single.retrieveUser("u", 50) != nullptr ? "PASSED" : "FAILED") << endl;
+
+    vector<Account> accounts;
+    accounts.emplace_back("u", 50, false, "badge", "online");
+    result = small.insertBatch(std::move(accounts))[0];
+    cout << "insertBatch removed u#50 alone: " << result << " (expected: 1)" << endl;
+    cout << "Test " << (result && small.retrieveUser("u", 50) != nullptr ? "PASSED" : "FAILED") << endl;
+
+    accounts.clear();
+    accounts.emplace_back("u", 50, false, "badge", "online");
+    for (int disc = 0; disc < 20; disc++) {
+        accounts.emplace_back("u", disc, false, "badge", "online");
+    }
+    result = merged.insertBatch(std::move(accounts))[0];
+    cout << "insertBatch removed u#50 with 20 new discriminators: " << result << " (expected: 1)" << endl;
+    cout << "Test " << (result && merged.numUsers("u") == 40 ? "PASSED" : "FAILED") << endl;
+}
+
+// Fills a tree with usernames "name0".. and discriminators 0.., every third account idle
+void fillTree(UTree& tree, int numNames, int numDiscs) {
+    for (int name = 0; name < numNames; name++) {
+        for (int disc = 0; disc < numDiscs; disc++) {
+            tree.insert(Account("name" + std::to_string(name), disc, disc % 2 == 0,
+                                disc % 4 == 0 ? "Staff" : "None", disc % 3 == 0 ? "idle" : "online"));
+        }
+    }
+}
+
+// Every account of a tree as CSV, in username then discriminator order
+string contentsOf(const UTree& tree) {
+    std::ostringstream out;
+    tree.exportAccounts(out, EXPORT_CSV, 1);
+    return out.str();
+}
+
+// The '()' dump of a tree and of each of its DTrees, to compare shapes
+string shapeOf(UTree& tree, const vector<string>& usernames) {
+    std::ostringstream out;
+    std::streambuf* saved = cout.rdbuf(out.rdbuf());
+    tree.dump();
+    for (const string& username : usernames) {
+        UNode* node = tree.retrieve(username);
+        if (node != nullptr) {
+            node->getDTree()->dump();
+        }
+    }
+    cout.rdbuf(saved);
+    return out.str();
+}
+
+void testUTreeLoadDataParallel() {
+    // Usernames out of order, repeated discriminators and a username spread over the whole file
+    std::ofstream csv("mytest_parallel.csv");
+    vector<string> usernames;
+    for (int i = 0; i < 400; i++) {
+        int name = (i * 37) % 23;
+        csv << "name" << name << "," << (i * 13) % 41 << "," << i % 2 << ",None," << (i % 3 == 0 ? "idle" : "online") << "\n";
+        usernames.push_back("name" + std::to_string(name));
+    }
+    csv.close();
+
+    UTree sequential, parallel;
+    sequential.loadData("mytest_parallel.csv", false);
+    parallel.loadDataParallel("mytest_parallel.csv", false, 4);
+    bool result = contentsOf(sequential) == contentsOf(parallel)
+                  && shapeOf(sequential, usernames) == shapeOf(parallel, usernames);
+    cout << "Parallel full load matches loadData: " << result << " (expected: 1)" << endl;
+
+    // Appending only promises the same accounts
+    sequential.loadData("mytest_parallel.csv", true);
+    parallel.loadDataParallel("mytest_parallel.csv", true, 4);
+    result = result && contentsOf(sequential) == contentsOf(parallel);
+    cout << "Test " << (result ? "PASSED" : "FAILED") << endl;
+    std::remove("mytest_parallel.csv");
+}
+
+void testStreamLoader() {
+    // A duplicate, a bad discriminator and lines cut across chunks
+    string csv = "name1,5,1,Staff,idle\nname2,7,0,None,online\nname1,5,0,None,dnd\n"
+                 "name3,99999,0,None,online\nname2,3,1,Partner,idle\nname1,2,0,None,online";
+    UTree tree;
+    StreamLoader loader(tree, 2);
+    bool accepted = true;
+    for (size_t i = 0; i < csv.size(); i += 7) {
+        accepted = loader.feed(string_view(csv).substr(i, 7)) && accepted;
+    }
+    accepted = loader.finish() && accepted;
+    cout << "Streamed " << loader.getNumInserted() << " inserted, " << loader.getNumDuplicates() << " duplicate, "
+         << loader.getNumRejected() << " rejected (expected: 4, 1, 1)" << endl;
+
+    UTree expected;
+    expected.insert(Account("name1", 5, true, "Staff", "idle"));
+    expected.insert(Account("name2", 7, false, "None", "online"));
+    expected.insert(Account("name2", 3, true, "Partner", "idle"));
+    expected.insert(Account("name1", 2, false, "None", "online"));
+    bool result = !accepted && loader.getNumInserted() == 4 && loader.getNumDuplicates() == 1
+                  && loader.getNumRejected() == 1 && loader.getNumBuffered() == 0
+                  && contentsOf(tree) == contentsOf(expected);
+    cout << "Test " << (result ? "PASSED" : "FAILED") << endl;
+}
+
+void testUTreeInsertBatch() {
+    UTree single, batched;
+    fillTree(single, 5, 3);
+    fillTree(batched, 5, 3);
+
+    // New usernames, new discriminators of existing ones, an existing account and a repeat
+    vector<Account> accounts;
+    accounts.emplace_back("name9", 1, false, "None", "online");
+    accounts.emplace_back("name2", 7, false, "None", "online");
+    accounts.emplace_back("name2", 1, false, "None", "online");
+    accounts.emplace_back("name9", 1, true, "Staff", "idle");
+    accounts.emplace_back("name0", 5, false, "None", "online");
+    vector<bool> expected;
+    for (const Account& account : accounts) {
+        expected.push_back(single.insert(account));
+    }
+    vector<bool> inserted = batched.insertBatch(std::move(accounts));
+    cout << "insertBatch results match insert: " << (inserted == expected) << " (expected: 1)" << endl;
+    cout << "Test " << (inserted == expected && contentsOf(single) == contentsOf(batched) ? "PASSED" : "FAILED") << endl;
+}
+
+void testUTreeRemoveBatch() {
+    UTree single, batched;
+    fillTree(single, 5, 3);
+    fillTree(batched, 5, 3);
+
+    // Every account of name1, part of name3, a missing key and a repeated key
+    vector<std::pair<string, int>> keys = {{"name1", 0}, {"name1", 1}, {"name1", 2}, {"name3", 1},
+                                           {"name7", 0}, {"name3", 1}};
+    size_t expected = 0;
+    for (const auto& key : keys) {
+        DNode* removed = nullptr;
+        expected += single.removeUser(key.first, key.second, removed);
+    }
+    vector<Account> removed = batched.removeBatch(keys);
+    cout << "removeBatch removed " << removed.size() << " (expected: " << expected << ")" << endl;
+    bool result = removed.size() == expected && batched.retrieve("name1") == nullptr
+                  && contentsOf(single) == contentsOf(batched);
+    cout << "Test " << (result ? "PASSED" : "FAILED") << endl;
+}
+
+void testUTreeRemoveIf() {
+    UTree tree;
+    fillTree(tree, 4, 6);
+    vector<Account> removed = tree.removeIf([](const Account& account) {
+        return account.getStatus() == "idle";
+    });
+    // discriminators 0 and 3 of each username are idle
+    cout << "removeIf removed " << removed.size() << " (expected: 8)" << endl;
+    bool result = removed.size() == 8 && tree.numUsers("name2") == 4 && tree.retrieveUser("name2", 3) == nullptr;
+    cout << "Test " << (result ? "PASSED" : "FAILED") << endl;
+}
+
+void testUTreeSnapshot() {
+    UTree tree;
+    fillTree(tree, 20, 5);
+    DNode* removed = nullptr;
+    tree.removeUser("name4", 2, removed);
+    bool saved = tree.saveSnapshot("mytest_snapshot.bin");
+
+    UTree loaded;
+    bool result = saved && loaded.loadSnapshot("mytest_snapshot.bin");
+    cout << "Snapshot round trip: " << result << " (expected: 1)" << endl;
+    cout << "Test " << (result && contentsOf(tree) == contentsOf(loaded) ? "PASSED" : "FAILED") << endl;
+    std::remove("mytest_snapshot.bin");
+}
+
+void testMappedUTree() {
+    UTree tree;
+    fillTree(tree, 50, 7);
+    DNode* removed = nullptr;
+    tree.removeUser("name4", 2, removed);
+    std::remove("mytest_tree.map");
+    bool result = false;
+    {
+        MappedUTree mapped;
+        result = mapped.open("mytest_tree.map") && mapped.importTree(tree);
+    }
+
+    // Reopened, every account reads back and the imported tree still takes inserts and removals
+    MappedUTree mapped;
+    result = result && mapped.open("mytest_tree.map");
+    cout << "Mapped tree holds " << mapped.getNumAccounts() << " accounts (expected: 349)" << endl;
+    result = result && mapped.getNumAccounts() == 349 && mapped.getNumUsernames() == 50;
+    for (int name = 0; result && name < 50; name++) {
+        for (int disc = 0; disc < 7; disc++) {
+            string username = "name" + std::to_string(name);
+            Account found;
+            DNode* expected = tree.retrieveUser(username, disc);
+            bool exists = mapped.retrieveUser(username, disc, found);
+            result = result && exists == (expected != nullptr)
+                     && (!exists || (found.getStatus() == expected->getAccount().getStatus()
+                                     && found.hasNitro() == expected->getAccount().hasNitro()));
+        }
+    }
+    result = result && mapped.insert(Account("name4", 2, true, "Staff", "dnd")) && mapped.removeUser("name7", 0)
+             && mapped.numUsers("name4") == 7 && mapped.numUsers("name7") == 6;
+    // Only a new file can be imported into
+    result = result && !mapped.importTree(tree);
+    cout << "Test " << (result ? "PASSED" : "FAILED") << endl;
+    mapped.close();
+    std::remove("mytest_tree.map");
+}
+
+void testJournalReplay() {
+    std::remove("mytest_journal.log");
+    UTree tree;
+    {
+        Journal journal;
+        journal.open("mytest_journal.log", SYNC_ALWAYS);
+        tree.addObserver(&journal);
+        fillTree(tree, 3, 4);
+        DNode* removed = nullptr;
+        tree.removeUser("name1", 2, removed);
+        tree.update(Account("name2", 3, true, "Partner", "dnd"));
+        tree.removeObserver(&journal);
+    }
+
+    UTree restored;
+    Journal journal;
+    bool result = journal.open("mytest_journal.log") && journal.replay(restored);
+    cout << "Journal replayed " << journal.getNumReplayed() << " records (expected: 14)" << endl;
+    result = result && journal.getNumReplayed() == 14 && contentsOf(tree) == contentsOf(restored);
+    cout << "Test " << (result ? "PASSED" : "FAILED") << endl;
+    journal.close();
+    std::remove("mytest_journal.log");
+}
+
+void testDTreeFreeze() {
+    DTree tree;
+    for (int disc = 0; disc < 200; disc += 2) {
+        tree.insert(Account("user", disc, false, "None", "online"));
+    }
+    DNode* removed = nullptr;
+    tree.remove(50, removed);
+    tree.freeze();
+    bool result = tree.isFrozen();
+    for (int disc = 0; disc < 200; disc++) {
+        bool present = disc % 2 == 0 && disc != 50;
+        result = result && (tree.retrieve(disc) != nullptr) == present;
+    }
+    cout << "Frozen lookups: " << result << " (expected: 1)" << endl;
+    cout << "Test " << (result ? "PASSED" : "FAILED") << endl;
+
+    // a write thaws the tree back into DNodes
+    tree.insert(Account("user", 51, false, "None", "online"));
+    result = !tree.isFrozen() && tree.retrieve(51) != nullptr && tree.retrieve(50) == nullptr;
+    cout << "Insert thaws: " << result << " (expected: 1)" << endl;
+    cout << "Test " << (result ? "PASSED" : "FAILED") << endl;
+}
+
+void testUTreeLookups() {
+    UTree plain, fast;
+    fillTree(plain, 30, 4);
+    fillTree(fast, 30, 4);
+    fast.enableCache(16);
+    fast.enableUsernameFilter(8);
+    fast.enableUsernameIndex();
+
+    vector<std::pair<string, int>> keys = {{"name3", 1}, {"name29", 3}, {"name3", 9}, {"name30", 0}, {"zzz", 1}};
+    DNode* removed = nullptr;
+    bool result = true;
+    for (int round = 0; round < 2; round++) {
+        for (const auto& key : keys) {
+            result = result && (plain.retrieveUser(key.first, key.second) != nullptr)
+                               == (fast.retrieveUser(key.first, key.second) != nullptr);
+            result = result && plain.numUsers(key.first) == fast.numUsers(key.first);
+        }
+        // removing every account of name3 drops it from the cache, filter and index
+        for (int disc = 0; disc < 4; disc++) {
+            plain.removeUser("name3", disc, removed);
+            fast.removeUser("name3", disc, removed);
+        }
+    }
+    result = result && fast.retrieve("name3") == nullptr && fast.getCache()->getNumHits() > 0
+             && fast.getUsernameIndex()->getSize() == 29;
+    cout << "Cache, filter and index agree with plain lookups: " << result << " (expected: 1)" << endl;
+    cout << "Test " << (result ? "PASSED" : "FAILED") << endl;
+}
+
+void testBitmapIndex() {
+    UTree tree;
+    BitmapIndex index;
+    tree.addObserver(&index);
+    fillTree(tree, 5, 8);
+
+    // even discriminators have nitro, multiples of four are Staff
+    uint64_t nitroStaff = index.getNitro().andCardinality(index.getBadge("Staff"));
+    cout << "Nitro Staff accounts: " << nitroStaff << " (expected: 10)" << endl;
+    DNode* removed = nullptr;
+    tree.removeUser("name0", 0, removed);
+    tree.update(Account("name1", 4, false, "None", "online"));
+    nitroStaff = index.getNitro().andCardinality(index.getBadge("Staff"));
+    cout << "After a removal and an update: " << nitroStaff << " (expected: 8)" << endl;
+    cout << "Test " << (nitroStaff == 8 && index.getNumAccounts() == 39 ? "PASSED" : "FAILED") << endl;
+}
+
+void testDiscIndex() {
+    UTree tree;
+    DiscIndex index;
+    tree.addObserver(&index);
+    fillTree(tree, 6, 3);
+    DNode* removed = nullptr;
+    tree.removeUser("name2", 1, removed);
+    // Replaying accounts the index already holds adds nothing
+    tree.replayContents(&index);
+    size_t numUsernames = index.getNumUsernames(1);
+    cout << "Usernames with discriminator 1: " << numUsernames << " (expected: 5)" << endl;
+    bool result = numUsernames == 5 && index.getNumUsernames(2) == 6 && index.getNumAccounts() == 17;
+    tree.removeUser("name3", 1, removed);
+    result = result && index.getNumUsernames(1) == 4 && index.getUsernames(1)[2] == "name4";
+    cout << "Test " << (result ? "PASSED" : "FAILED") << endl;
+}
+
+void testAccountColumns() {
+    UTree tree;
+    AccountColumns columns;
+    tree.addObserver(&columns);
+    fillTree(tree, 5, 6);
+
+    Query query;
+    bool result = query.parse("count by status where nitro");
+    vector<QueryRow> rows = query.run(columns);
+    // nitro discriminators 0, 2 and 4: 0 is idle, 2 and 4 online
+    uint64_t idle = 0;
+    uint64_t online = 0;
+    for (const QueryRow& row : rows) {
+        (row.group == "idle" ? idle : online) += row.count;
+    }
+    cout << "Nitro idle " << idle << ", online " << online << " (expected: 5, 10)" << endl;
+    cout << "Test " << (result && idle == 5 && online == 10 ? "PASSED" : "FAILED") << endl;
 }
 
 int main() {
@@ -419,6 +778,20 @@ int main() {
     testUTreeRetrieve();
     testUTreeRetrieveUser();
     testUTreeNumUsers();
+    testUTreeLoadDataParallel();
+    testUTreeInsertBatch();
+    testStreamLoader();
+    testUTreeInsertBatchVacancies();
+    testUTreeRemoveBatch();
+    testUTreeRemoveIf();
+    testUTreeSnapshot();
+    testMappedUTree();
+    testJournalReplay();
+    testDTreeFreeze();
+    testUTreeLookups();
+    testBitmapIndex();
+    testDiscIndex();
+    testAccountColumns();
     testUTreePrintUsers();
     testUTreeDump();
     return 0;
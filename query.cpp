@@ -0,0 +1,551 @@
+/**
+ * Project 2 - Binary Trees
+ * query.cpp
+ * Filter and group-by queries evaluated block by block over a columnar mirror of a UTree.
+ */
+
+#include "query.h"
+#include <algorithm>
+#include <cctype>
+#include <charconv>
+#include <limits>
+
+/**
+ * Appends a new account as a row, reusing a row freed by a removal if there is one.
+ * @param account account the UTree inserted
+ */
+void AccountColumns::accountInserted(const Account& account) {
+    uint32_t row = _freeRows.empty() ? static_cast<uint32_t>(_discs.size()) : _freeRows.back();
+    if (!_rows.emplace(std::make_pair(account.getUsername(), account.getDiscriminator()), row).second) {
+        return;
+    }
+    uint16_t disc = static_cast<uint16_t>(account.getDiscriminator());
+    uint32_t badge = static_cast<uint32_t>(_badges.encode(account.getBadge()));
+    uint32_t status = static_cast<uint32_t>(_statuses.encode(account.getStatus()));
+    if (row == _discs.size()) {
+        _discs.push_back(disc);
+        _nitro.push_back(account.hasNitro());
+        _badgeCodes.push_back(badge);
+        _statusCodes.push_back(status);
+        _live.push_back(1);
+        return;
+    }
+    _freeRows.pop_back();
+    _discs[row] = disc;
+    _nitro[row] = account.hasNitro();
+    _badgeCodes[row] = badge;
+    _statusCodes[row] = status;
+    _live[row] = 1;
+}
+
+void AccountColumns::accountRemoved(const Account& account) {
+    auto found = _rows.find(std::make_pair(account.getUsername(), account.getDiscriminator()));
+    if (found == _rows.end()) {
+        return;
+    }
+    _live[found->second] = 0;
+    _freeRows.push_back(found->second);
+    _rows.erase(found);
+}
+
+// An update rewrites the account's row in place
+void AccountColumns::accountUpdated(const Account&, const Account& after) {
+    auto found = _rows.find(std::make_pair(after.getUsername(), after.getDiscriminator()));
+    if (found == _rows.end()) {
+        return;
+    }
+    uint32_t row = found->second;
+    _nitro[row] = after.hasNitro();
+    _badgeCodes[row] = static_cast<uint32_t>(_badges.encode(after.getBadge()));
+    _statusCodes[row] = static_cast<uint32_t>(_statuses.encode(after.getStatus()));
+}
+
+void AccountColumns::treeCleared() {
+    _discs.clear();
+    _nitro.clear();
+    _badgeCodes.clear();
+    _statusCodes.clear();
+    _live.clear();
+    _badges.clear();
+    _statuses.clear();
+    _rows.clear();
+    _freeRows.clear();
+}
+
+std::shared_ptr<QueryExpr> QueryExpr::compare(QueryColumn column, QueryOp op, int64_t number) {
+    auto expr = std::make_shared<QueryExpr>();
+    expr->column = column;
+    expr->op = op;
+    expr->number = number;
+    return expr;
+}
+
+std::shared_ptr<QueryExpr> QueryExpr::compare(QueryColumn column, QueryOp op, string text) {
+    auto expr = std::make_shared<QueryExpr>();
+    expr->column = column;
+    expr->op = op;
+    expr->text = std::move(text);
+    return expr;
+}
+
+std::shared_ptr<QueryExpr> QueryExpr::both(std::shared_ptr<QueryExpr> left, std::shared_ptr<QueryExpr> right) {
+    auto expr = std::make_shared<QueryExpr>();
+    expr->kind = EXPR_AND;
+    expr->left = std::move(left);
+    expr->right = std::move(right);
+    return expr;
+}
+
+std::shared_ptr<QueryExpr> QueryExpr::either(std::shared_ptr<QueryExpr> left, std::shared_ptr<QueryExpr> right) {
+    auto expr = std::make_shared<QueryExpr>();
+    expr->kind = EXPR_OR;
+    expr->left = std::move(left);
+    expr->right = std::move(right);
+    return expr;
+}
+
+std::shared_ptr<QueryExpr> QueryExpr::negate(std::shared_ptr<QueryExpr> operand) {
+    auto expr = std::make_shared<QueryExpr>();
+    expr->kind = EXPR_NOT;
+    expr->left = std::move(operand);
+    return expr;
+}
+
+// A filter with its string constants replaced by dictionary codes, ready to run
+struct BoundExpr {
+    QueryExpr::Kind kind;
+    QueryColumn column;
+    QueryOp op;
+    int32_t constant;               //clamped number or dictionary code
+    bool always;                    //for a string missing from the dictionary, the result of every row
+    bool isConstant;
+    int left;
+    int right;
+};
+
+// Appends the bound form of expr to program, returning its index
+static int bindFilter(const QueryExpr& expr, const StringDictionary& badges, const StringDictionary& statuses,
+                vector<BoundExpr>& program) {
+    BoundExpr bound = {expr.kind, expr.column, expr.op, 0, false, false, -1, -1};
+    if (expr.kind != QueryExpr::EXPR_COMPARE) {
+        if (!expr.left || (expr.kind != QueryExpr::EXPR_NOT && !expr.right)) {
+            throw std::invalid_argument("Query filter is missing an operand");
+        }
+        bound.left = bindFilter(*expr.left, badges, statuses, program);
+        if (expr.kind != QueryExpr::EXPR_NOT) {
+            bound.right = bindFilter(*expr.right, badges, statuses, program);
+        }
+    }
+    else if (expr.column == QUERY_BADGE || expr.column == QUERY_STATUS) {
+        if (expr.op != OP_EQ && expr.op != OP_NE) {
+            throw std::invalid_argument("Badges and statuses can only be compared with = and !=");
+        }
+        uint64_t code;
+        if ((expr.column == QUERY_BADGE ? badges : statuses).find(expr.text, code)) {
+            bound.constant = static_cast<int32_t>(code);
+        }
+        else {
+            bound.isConstant = true;
+            bound.always = (expr.op == OP_NE);
+        }
+    }
+    else if (expr.column == QUERY_DISC || expr.column == QUERY_NITRO) {
+        //columns hold 0-65535, so clamping keeps every comparison's outcome
+        bound.constant = static_cast<int32_t>(std::max<int64_t>(-1, std::min<int64_t>(65536, expr.number)));
+    }
+    else {
+        throw std::invalid_argument("Query filter compares no column");
+    }
+    program.push_back(bound);
+    return static_cast<int>(program.size()) - 1;
+}
+
+// out[i] = column[i] op constant; each case is a loop the compiler can vectorize
+template <typename T>
+static void compareColumn(const T* column, size_t count, QueryOp op, int32_t constant, uint8_t* out) {
+    switch (op) {
+        case OP_EQ: for (size_t i = 0; i < count; i++) out[i] = static_cast<int32_t>(column[i]) == constant; break;
+        case OP_NE: for (size_t i = 0; i < count; i++) out[i] = static_cast<int32_t>(column[i]) != constant; break;
+        case OP_LT: for (size_t i = 0; i < count; i++) out[i] = static_cast<int32_t>(column[i]) < constant; break;
+        case OP_LE: for (size_t i = 0; i < count; i++) out[i] = static_cast<int32_t>(column[i]) <= constant; break;
+        case OP_GT: for (size_t i = 0; i < count; i++) out[i] = static_cast<int32_t>(column[i]) > constant; break;
+        case OP_GE: for (size_t i = 0; i < count; i++) out[i] = static_cast<int32_t>(column[i]) >= constant; break;
+    }
+}
+
+// Fills out with the filter result for rows start .. start + count - 1; scratch holds a mask per nesting level
+static void evaluate(const vector<BoundExpr>& program, int index, const uint16_t* discs, const uint8_t* nitro,
+                     const uint32_t* badges, const uint32_t* statuses, size_t start, size_t count, uint8_t* out, uint8_t* scratch) {
+    const BoundExpr& expr = program[index];
+    if (expr.kind == QueryExpr::EXPR_COMPARE) {
+        if (expr.isConstant) {
+            std::fill(out, out + count, expr.always ? 1 : 0);
+        }
+        else if (expr.column == QUERY_DISC) {
+            compareColumn(discs + start, count, expr.op, expr.constant, out);
+        }
+        else if (expr.column == QUERY_NITRO) {
+            compareColumn(nitro + start, count, expr.op, expr.constant, out);
+        }
+        else {
+            compareColumn((expr.column == QUERY_BADGE ? badges : statuses) + start, count, expr.op, expr.constant, out);
+        }
+        return;
+    }
+    evaluate(program, expr.left, discs, nitro, badges, statuses, start, count, out, scratch);
+    if (expr.kind == QueryExpr::EXPR_NOT) {
+        for (size_t i = 0; i < count; i++) {
+            out[i] ^= 1;
+        }
+        return;
+    }
+    evaluate(program, expr.right, discs, nitro, badges, statuses, start, count, scratch, scratch + QUERY_BLOCK_ROWS);
+    if (expr.kind == QueryExpr::EXPR_AND) {
+        for (size_t i = 0; i < count; i++) {
+            out[i] &= scratch[i];
+        }
+    }
+    else {
+        for (size_t i = 0; i < count; i++) {
+            out[i] |= scratch[i];
+        }
+    }
+}
+
+// Deepest chain of nested combinations, which sets how many scratch masks evaluate needs
+static int depthOf(const vector<BoundExpr>& program, int index) {
+    const BoundExpr& expr = program[index];
+    if (expr.kind == QueryExpr::EXPR_COMPARE) {
+        return 1;
+    }
+    int depth = depthOf(program, expr.left);
+    if (expr.right >= 0) {
+        depth = std::max(depth, depthOf(program, expr.right));
+    }
+    return depth + 1;
+}
+
+/**
+ * Runs the query over every live row.
+ * @param columns mirror of the tree to query
+ * @return one row per group with at least one match in group order (badges and
+ * statuses by name), or a single row without a group-by column
+ * @throws std::invalid_argument if the filter compares a string column with an ordering
+ */
+vector<QueryRow> Query::run(const AccountColumns& columns) const {
+    vector<BoundExpr> program;
+    int root = _filter ? bindFilter(*_filter, columns._badges, columns._statuses, program) : -1;
+    vector<uint8_t> masks(QUERY_BLOCK_ROWS * (root >= 0 ? depthOf(program, root) + 1 : 1));
+
+    size_t numGroups = 1;
+    const uint32_t* groupCodes = nullptr;
+    if (_groupBy == QUERY_BADGE || _groupBy == QUERY_STATUS) {
+        numGroups = std::max<size_t>(1, (_groupBy == QUERY_BADGE ? columns.getBadges() : columns.getStatuses()).size());
+        groupCodes = (_groupBy == QUERY_BADGE) ? columns._badgeCodes.data() : columns._statusCodes.data();
+    }
+    else if (_groupBy == QUERY_NITRO) {
+        numGroups = 2;
+    }
+    else if (_groupBy == QUERY_DISC) {
+        numGroups = MAX_DISC + 1;
+    }
+    vector<uint64_t> counts(numGroups, 0);
+    vector<int64_t> sums(numGroups, 0);
+    vector<int32_t> minimums(numGroups, std::numeric_limits<int32_t>::max());
+    vector<int32_t> maximums(numGroups, std::numeric_limits<int32_t>::min());
+
+    const uint16_t* discs = columns._discs.data();
+    const uint8_t* nitro = columns._nitro.data();
+    const uint8_t* live = columns._live.data();
+    uint8_t* mask = masks.data();
+    size_t numRows = columns.getNumRows();
+    for (size_t start = 0; start < numRows; start += QUERY_BLOCK_ROWS) {
+        size_t count = std::min<size_t>(QUERY_BLOCK_ROWS, numRows - start);
+        if (root >= 0) {
+            evaluate(program, root, discs, nitro, columns._badgeCodes.data(), columns._statusCodes.data(),
+                     start, count, mask, mask + QUERY_BLOCK_ROWS);
+            for (size_t i = 0; i < count; i++) {
+                mask[i] &= live[start + i];
+            }
+        }
+        else {
+            std::copy(live + start, live + start + count, mask);
+        }
+
+        if (_groupBy == QUERY_NONE) {
+            uint64_t matched = 0;
+            int64_t sum = 0;
+            int32_t minimum = minimums[0];
+            int32_t maximum = maximums[0];
+            for (size_t i = 0; i < count; i++) {
+                matched += mask[i];
+                sum += mask[i] * discs[start + i];
+            }
+            if (_aggregate == AGGREGATE_MIN || _aggregate == AGGREGATE_MAX) {
+                for (size_t i = 0; i < count; i++) {
+                    int32_t disc = discs[start + i];
+                    minimum = std::min(minimum, mask[i] ? disc : std::numeric_limits<int32_t>::max());
+                    maximum = std::max(maximum, mask[i] ? disc : std::numeric_limits<int32_t>::min());
+                }
+            }
+            counts[0] += matched;
+            sums[0] += sum;
+            minimums[0] = minimum;
+            maximums[0] = maximum;
+            continue;
+        }
+        for (size_t i = 0; i < count; i++) {
+            if (mask[i] == 0) {
+                continue;
+            }
+            size_t row = start + i;
+            size_t group = groupCodes ? groupCodes[row] : (_groupBy == QUERY_NITRO ? nitro[row] : discs[row]);
+            int32_t disc = discs[row];
+            counts[group]++;
+            sums[group] += disc;
+            minimums[group] = std::min(minimums[group], disc);
+            maximums[group] = std::max(maximums[group], disc);
+        }
+    }
+
+    vector<QueryRow> result;
+    for (size_t g = 0; g < numGroups; g++) {
+        if (counts[g] == 0 && _groupBy != QUERY_NONE) {
+            continue;
+        }
+        QueryRow row;
+        if (_groupBy == QUERY_BADGE || _groupBy == QUERY_STATUS) {
+            row.group = (_groupBy == QUERY_BADGE ? columns.getBadges() : columns.getStatuses())[g];
+        }
+        else if (_groupBy != QUERY_NONE) {
+            row.group = std::to_string(g);
+        }
+        row.count = counts[g];
+        switch (_aggregate) {
+            case AGGREGATE_COUNT: row.value = counts[g]; break;
+            case AGGREGATE_SUM: row.value = sums[g]; break;
+            case AGGREGATE_MIN: row.value = counts[g] ? minimums[g] : 0; break;
+            case AGGREGATE_MAX: row.value = counts[g] ? maximums[g] : 0; break;
+        }
+        result.push_back(std::move(row));
+    }
+    if (_groupBy == QUERY_BADGE || _groupBy == QUERY_STATUS) {
+        std::sort(result.begin(), result.end(), [](const QueryRow& a, const QueryRow& b) {
+            return a.group < b.group;
+        });
+    }
+    return result;
+}
+
+// Splits a query into words, numbers, operators, parentheses and quoted strings
+static bool tokenize(const string& text, vector<string>& tokens, vector<bool>& quoted, string& error) {
+    size_t i = 0;
+    while (i < text.size()) {
+        char c = text[i];
+        if (std::isspace(static_cast<unsigned char>(c))) {
+            i++;
+        }
+        else if (c == '\'' || c == '"') {
+            size_t end = text.find(c, i + 1);
+            if (end == string::npos) {
+                error = "unterminated string";
+                return false;
+            }
+            tokens.push_back(text.substr(i + 1, end - i - 1));
+            quoted.push_back(true);
+            i = end + 1;
+        }
+        else if (c == '(' || c == ')') {
+            tokens.push_back(string(1, c));
+            quoted.push_back(false);
+            i++;
+        }
+        else if (c == '<' || c == '>' || c == '=' || c == '!') {
+            size_t length = (i + 1 < text.size() && text[i + 1] == '=') ? 2 : 1;
+            tokens.push_back(text.substr(i, length));
+            quoted.push_back(false);
+            i += length;
+        }
+        else {
+            size_t end = i;
+            while (end < text.size() && !std::isspace(static_cast<unsigned char>(text[end]))
+                   && string("()<>=!'\"").find(text[end]) == string::npos) {
+                end++;
+            }
+            tokens.push_back(text.substr(i, end - i));
+            quoted.push_back(false);
+            i = end;
+        }
+    }
+    return true;
+}
+
+// Recursive descent over the tokens of a query
+class QueryParser {
+public:
+    QueryParser(const vector<string>& tokens, const vector<bool>& quoted)
+        : _tokens(tokens), _quoted(quoted), _pos(0) {}
+
+    bool atEnd() const {return _pos == _tokens.size();}
+
+    // Consumes the next token if it is the unquoted word, ignoring case
+    bool accept(const string& word) {
+        if (atEnd() || _quoted[_pos] || _tokens[_pos].size() != word.size()) {
+            return false;
+        }
+        for (size_t c = 0; c < word.size(); c++) {
+            if (std::tolower(static_cast<unsigned char>(_tokens[_pos][c])) != word[c]) {
+                return false;
+            }
+        }
+        _pos++;
+        return true;
+    }
+
+    bool column(QueryColumn& result) {
+        const char* names[] = {"disc", "nitro", "badge", "status"};
+        const QueryColumn columns[] = {QUERY_DISC, QUERY_NITRO, QUERY_BADGE, QUERY_STATUS};
+        for (int c = 0; c < 4; c++) {
+            if (accept(names[c])) {
+                result = columns[c];
+                return true;
+            }
+        }
+        return false;
+    }
+
+    std::shared_ptr<QueryExpr> filter() {
+        std::shared_ptr<QueryExpr> expr = term();
+        while (expr && accept("or")) {
+            std::shared_ptr<QueryExpr> right = term();
+            expr = right ? QueryExpr::either(expr, right) : nullptr;
+        }
+        return expr;
+    }
+
+    std::shared_ptr<QueryExpr> term() {
+        std::shared_ptr<QueryExpr> expr = factor();
+        while (expr && accept("and")) {
+            std::shared_ptr<QueryExpr> right = factor();
+            expr = right ? QueryExpr::both(expr, right) : nullptr;
+        }
+        return expr;
+    }
+
+    std::shared_ptr<QueryExpr> factor() {
+        if (accept("not")) {
+            std::shared_ptr<QueryExpr> operand = factor();
+            return operand ? QueryExpr::negate(operand) : nullptr;
+        }
+        if (accept("(")) {
+            std::shared_ptr<QueryExpr> expr = filter();
+            return (expr && accept(")")) ? expr : fail("expected )");
+        }
+        QueryColumn target;
+        if (!column(target)) {
+            return fail("expected a column");
+        }
+        QueryOp op;
+        const char* symbols[] = {"=", "==", "!=", "<", "<=", ">", ">="};
+        const QueryOp ops[] = {OP_EQ, OP_EQ, OP_NE, OP_LT, OP_LE, OP_GT, OP_GE};
+        int found = -1;
+        for (int s = 0; s < 7 && found < 0; s++) {
+            if (accept(symbols[s])) {
+                found = s;
+            }
+        }
+        if (found < 0) {
+            //a bare "nitro" means nitro = 1
+            return (target == QUERY_NITRO) ? QueryExpr::compare(QUERY_NITRO, OP_EQ, int64_t(1)) : fail("expected an operator");
+        }
+        op = ops[found];
+        if (atEnd()) {
+            return fail("expected a value");
+        }
+        const string& value = _tokens[_pos];
+        if (target == QUERY_BADGE || target == QUERY_STATUS) {
+            if (op != OP_EQ && op != OP_NE) {
+                _pos--;
+                return fail("expected = or !=");
+            }
+            _pos++;
+            return QueryExpr::compare(target, op, value);
+        }
+        int64_t number;
+        auto parsed = std::from_chars(value.data(), value.data() + value.size(), number);
+        if (value.empty() || parsed.ec != std::errc() || parsed.ptr != value.data() + value.size()) {
+            return fail("expected a number");
+        }
+        _pos++;
+        return QueryExpr::compare(target, op, number);
+    }
+
+    std::shared_ptr<QueryExpr> fail(const string& message) {
+        if (_error.empty()) {
+            _error = message + (atEnd() ? " at the end" : " at '" + _tokens[_pos] + "'");
+        }
+        return nullptr;
+    }
+
+    string getError() const {return _error;}
+
+private:
+    const vector<string>& _tokens;
+    const vector<bool>& _quoted;
+    size_t _pos;
+    string _error;
+};
+
+/**
+ * Replaces this query with one parsed from the expression syntax.
+ * @param text the query, e.g. "count by status where nitro and disc < 1000"
+ * @return true if it parsed, false otherwise with the reason in getError()
+ */
+bool Query::parse(const string& text) {
+    vector<string> tokens;
+    vector<bool> quoted;
+    _error.clear();
+    if (!tokenize(text, tokens, quoted, _error)) {
+        return false;
+    }
+    QueryParser parser(tokens, quoted);
+    Aggregate aggregate;
+    if (parser.accept("count")) {
+        aggregate = AGGREGATE_COUNT;
+    }
+    else if (parser.accept("sum") || parser.accept("min") || parser.accept("max")) {
+        string name = tokens[0];
+        std::transform(name.begin(), name.end(), name.begin(), ::tolower);
+        aggregate = (name == "sum") ? AGGREGATE_SUM : (name == "min") ? AGGREGATE_MIN : AGGREGATE_MAX;
+        if (!parser.accept("disc")) {
+            _error = "only disc can be summed or compared";
+            return false;
+        }
+    }
+    else {
+        _error = "expected count, sum disc, min disc or max disc";
+        return false;
+    }
+    QueryColumn groupBy = QUERY_NONE;
+    if (parser.accept("by") && !parser.column(groupBy)) {
+        _error = "expected a column after by";
+        return false;
+    }
+    std::shared_ptr<QueryExpr> filter;
+    if (parser.accept("where")) {
+        filter = parser.filter();
+        if (!filter) {
+            _error = parser.getError();
+            return false;
+        }
+    }
+    if (!parser.atEnd()) {
+        parser.fail("unexpected input");
+        _error = parser.getError();
+        return false;
+    }
+    _aggregate = aggregate;
+    _groupBy = groupBy;
+    _filter = filter;
+    return true;
+}
@@ -0,0 +1,138 @@
+/**
+ * Project 2 - Binary Trees
+ * query.h
+ * An interface for filter and group-by queries over a columnar mirror of a UTree.
+ */
+
+#pragma once
+
+#include "utree.h"
+#include "binaryio.h"
+#include <memory>
+#include <unordered_map>
+
+#define QUERY_BLOCK_ROWS 1024       //rows a predicate is evaluated over at a time
+
+/* Columns a query can filter or group on */
+enum QueryColumn {
+    QUERY_NONE,
+    QUERY_DISC,
+    QUERY_NITRO,
+    QUERY_BADGE,
+    QUERY_STATUS
+};
+
+enum QueryOp {
+    OP_EQ,
+    OP_NE,
+    OP_LT,
+    OP_LE,
+    OP_GT,
+    OP_GE
+};
+
+/* Value computed per group; the sum, min and max are of the discriminator */
+enum Aggregate {
+    AGGREGATE_COUNT,
+    AGGREGATE_SUM,
+    AGGREGATE_MIN,
+    AGGREGATE_MAX
+};
+
+/**
+ * Every account of a UTree as columns: one array per field, indexed by row.
+ * Attached as an observer it follows inserts and removals; a removed account's
+ * row is marked dead and reused by a later insert. Badges and statuses are
+ * stored as dictionary codes.
+ */
+class AccountColumns : public UTreeObserver {
+public:
+    friend class Query;
+
+    /* UTreeObserver */
+    void accountInserted(const Account& account) override;
+    void accountRemoved(const Account& account) override;
+    void accountUpdated(const Account& before, const Account& after) override;
+    void treeCleared() override;
+
+    /* Getters */
+    size_t getNumRows() const {return _discs.size();}
+    size_t getNumAccounts() const {return _rows.size();}
+    const vector<string>& getBadges() const {return _badges.getValues();}
+    const vector<string>& getStatuses() const {return _statuses.getValues();}
+
+private:
+    vector<uint16_t> _discs;
+    vector<uint8_t> _nitro;
+    vector<uint32_t> _badgeCodes;
+    vector<uint32_t> _statusCodes;
+    vector<uint8_t> _live;          //0 for a row freed by a removal
+    StringDictionary _badges;
+    StringDictionary _statuses;
+    std::unordered_map<std::pair<string, int>, uint32_t, AccountKeyHash> _rows;
+    vector<uint32_t> _freeRows;
+};
+
+/* A filter: a comparison of one column with a constant, or a combination of filters */
+struct QueryExpr {
+    enum Kind {EXPR_COMPARE, EXPR_AND, EXPR_OR, EXPR_NOT};
+
+    Kind kind = EXPR_COMPARE;
+    QueryColumn column = QUERY_NONE;
+    QueryOp op = OP_EQ;
+    int64_t number = 0;             //constant for disc and nitro
+    string text;                    //constant for badge and status
+    std::shared_ptr<QueryExpr> left;
+    std::shared_ptr<QueryExpr> right;
+
+    static std::shared_ptr<QueryExpr> compare(QueryColumn column, QueryOp op, int64_t number);
+    static std::shared_ptr<QueryExpr> compare(QueryColumn column, QueryOp op, string text);
+    static std::shared_ptr<QueryExpr> both(std::shared_ptr<QueryExpr> left, std::shared_ptr<QueryExpr> right);
+    static std::shared_ptr<QueryExpr> either(std::shared_ptr<QueryExpr> left, std::shared_ptr<QueryExpr> right);
+    static std::shared_ptr<QueryExpr> negate(std::shared_ptr<QueryExpr> operand);
+};
+
+/* One group of a query result */
+struct QueryRow {
+    string group;                   //value of the group-by column, "" without one
+    uint64_t count = 0;             //matching accounts in the group
+    int64_t value = 0;              //the aggregate, equal to count for AGGREGATE_COUNT
+};
+
+/**
+ * An aggregate over the accounts matching a filter, optionally per value of a
+ * column. Built in C++ or parsed from a short expression:
+ *
+ *     count by status where nitro and disc < 1000
+ *     max disc by badge where status = 'idle' or not nitro
+ *
+ *   query      := aggregate ["by" column] ["where" filter]
+ *   aggregate  := "count" | "sum disc" | "min disc" | "max disc"
+ *   filter     := term {"or" term}
+ *   term       := factor {"and" factor}
+ *   factor     := "not" factor | "(" filter ")" | "nitro" | column op value
+ *   op         := "=" | "!=" | "<" | "<=" | ">" | ">="
+ * Strings with spaces go in single or double quotes.
+ *
+ * Filters run over QUERY_BLOCK_ROWS rows at a time: each comparison fills a
+ * byte mask from one column with a plain loop the compiler vectorizes, masks
+ * are combined with bytewise & and |, and the surviving rows are aggregated.
+ */
+class Query {
+public:
+    Query(Aggregate aggregate = AGGREGATE_COUNT, QueryColumn groupBy = QUERY_NONE,
+          std::shared_ptr<QueryExpr> filter = nullptr)
+        : _aggregate(aggregate), _groupBy(groupBy), _filter(filter) {}
+
+    bool parse(const string& text);
+    vector<QueryRow> run(const AccountColumns& columns) const;
+
+    /* Getters */
+    string getError() const {return _error;}
+
+private:
+    Aggregate _aggregate;
+    QueryColumn _groupBy;
+    std::shared_ptr<QueryExpr> _filter;
+    string _error;
+};
@@ -0,0 +1,628 @@
+/**
+ * Project 2 - Binary Trees
+ * server.cpp
+ * A request server for a UTree over a Unix domain socket, or over stdin and stdout.
+ *
+ * Usage: server [--socket PATH] [--load FILE] [--batch N]
+ * Without --socket, requests are read from stdin and answered on stdout until EOF.
+ *
+ * Protocol: one request per line, answered in order on the same connection.
+ * Clients may send any number of requests before reading the answers.
+ *   INSERT username,disc,nitro,badge,status  -> OK | EXISTS
+ *   REMOVE username disc                     -> OK username,disc,nitro,badge,status | NOTFOUND
+ *   GET username disc                        -> OK username,disc,nitro,badge,status | NOTFOUND
+ *   COUNT username                           -> OK n
+ *   PREFIX [prefix [limit]]                  -> OK n, then n account lines (limit 100 by default, 0 for all)
+ *   STATS                                    -> OK n, then n lines of latency figures
+ *   PING                                     -> OK
+ *   QUIT                                     -> OK, then the connection is closed
+ * A request that cannot be parsed is answered with ERR and a reason.
+ *
+ * Build: g++ -std=c++17 -O2 -pthread server.cpp treeworker.cpp utree.cpp dtree.cpp csvloader.cpp
+ *        snapshot.cpp export.cpp columnar.cpp accountcache.cpp usernamefilter.cpp usernameindex.cpp -o server
+ */
+
+#include "treeworker.h"
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/eventfd.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <csignal>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <chrono>
+#include <charconv>
+#include <deque>
+#include <memory>
+
+#define SERVER_MAX_LINE 4096                //longest request line
+#define SERVER_MAX_PIPELINE 65536           //unanswered requests before a connection stops being read
+#define SERVER_READ_SIZE 65536
+#define SERVER_DEFAULT_PREFIX_LIMIT 100
+#define NUM_COMMAND_TYPES 5
+#define LATENCY_STEPS 4                     //linear steps per power of two
+#define LATENCY_BUCKETS (64 * LATENCY_STEPS)
+
+static const char* COMMAND_NAMES[NUM_COMMAND_TYPES] = {"INSERT", "REMOVE", "GET", "COUNT", "PREFIX"};
+
+/**
+ * Latencies of one request type. Buckets split each power of two of nanoseconds
+ * into LATENCY_STEPS, so a percentile is read back within 25% of the real value.
+ * Recorded on the tree owner thread and read by the I/O thread.
+ */
+class LatencyHistogram {
+public:
+    void record(uint64_t nanos);
+    double getPercentileMicros(double fraction) const;
+
+    /* Getters */
+    uint64_t getCount() const {return _count.load(std::memory_order_relaxed);}
+    double getMeanMicros() const {return getCount() == 0 ? 0 : _totalNanos.load(std::memory_order_relaxed) / 1e3 / getCount();}
+    double getMaxMicros() const {return _maxNanos.load(std::memory_order_relaxed) / 1e3;}
+
+private:
+    std::atomic<uint64_t> _buckets[LATENCY_BUCKETS] = {};
+    std::atomic<uint64_t> _count{0};
+    std::atomic<uint64_t> _totalNanos{0};
+    std::atomic<uint64_t> _maxNanos{0};
+
+    static int bucketOf(uint64_t nanos);
+    static uint64_t bucketLimit(int bucket);
+};
+
+int LatencyHistogram::bucketOf(uint64_t nanos) {
+    if (nanos < LATENCY_STEPS) {
+        return static_cast<int>(nanos);
+    }
+    int power = 63 - __builtin_clzll(nanos);
+    return power * LATENCY_STEPS + static_cast<int>((nanos >> (power - 2)) & (LATENCY_STEPS - 1));
+}
+
+// Smallest latency that falls past a bucket
+uint64_t LatencyHistogram::bucketLimit(int bucket) {
+    if (bucket < LATENCY_STEPS) {
+        return bucket + 1;
+    }
+    int power = bucket / LATENCY_STEPS;
+    uint64_t step = 1ull << (power - 2);
+    return (LATENCY_STEPS + bucket % LATENCY_STEPS) * step + step;
+}
+
+void LatencyHistogram::record(uint64_t nanos) {
+    _buckets[bucketOf(nanos)].fetch_add(1, std::memory_order_relaxed);
+    _count.fetch_add(1, std::memory_order_relaxed);
+    _totalNanos.fetch_add(nanos, std::memory_order_relaxed);
+    uint64_t longest = _maxNanos.load(std::memory_order_relaxed);
+    while (nanos > longest && !_maxNanos.compare_exchange_weak(longest, nanos, std::memory_order_relaxed)) {}
+}
+
+/**
+ * Estimates a percentile from the buckets.
+ * @param fraction e.g. 0.99 for the 99th percentile
+ * @return upper bound of the bucket holding that percentile, in microseconds
+ */
+double LatencyHistogram::getPercentileMicros(double fraction) const {
+    uint64_t count = getCount();
+    uint64_t rank = static_cast<uint64_t>(fraction * count);
+    uint64_t seen = 0;
+    for (int b = 0; b < LATENCY_BUCKETS && count > 0; b++) {
+        seen += _buckets[b].load(std::memory_order_relaxed);
+        if (seen > rank) {
+            return std::min<double>(bucketLimit(b), _maxNanos.load(std::memory_order_relaxed)) / 1e3;
+        }
+    }
+    return getMaxMicros();
+}
+
+/**
+ * Serves one UTree to many clients. A single I/O thread polls the connections,
+ * splits what they send into requests and hands tree requests to a TreeWorker,
+ * so everything that arrives between two polls reaches the tree as one batch and
+ * a client that pipelines requests gets them applied in large batches. Answers
+ * are filled in on the owner thread and written back by the I/O thread in
+ * request order.
+ */
+class RequestServer {
+public:
+    RequestServer(UTree& tree, size_t maxBatch);
+    ~RequestServer();
+
+    bool listen(const string& path);
+    void addStream(int inFd, int outFd);
+    void run();
+    void requestStop();
+
+private:
+    /* The answer to one request; filled on the owner thread unless answered right away */
+    struct Response {
+        string text;
+        bool ready = false;
+    };
+    struct Connection {
+        int inFd;
+        int outFd;
+        string input;               //bytes not split into requests yet
+        size_t inputStart = 0;
+        string output;              //answers not written yet
+        bool inputClosed = false;
+        bool quit = false;
+        bool broken = false;
+        std::mutex mutex;           //guards responses
+        std::deque<Response> responses;
+    };
+    typedef std::shared_ptr<Connection> ConnectionPtr;
+
+    TreeWorker _worker;
+    int _listenFd;
+    string _socketPath;
+    int _wakeFd;
+    std::atomic<bool> _wakePending;
+    volatile std::sig_atomic_t _stopping;
+    vector<ConnectionPtr> _connections;
+    LatencyHistogram _latencies[NUM_COMMAND_TYPES];
+
+    void acceptClients();
+    void readInput(const ConnectionPtr& connection);
+    void handleLine(const ConnectionPtr& connection, string_view line);
+    Response* addResponse(const ConnectionPtr& connection);
+    void answer(const ConnectionPtr& connection, string text);
+    CommandCallback completion(const ConnectionPtr& connection, CommandType type);
+    void writeOutput(Connection& connection);
+    string formatStats() const;
+    void wake();
+};
+
+// Appends an account as a .csv line without the newline
+static void appendAccount(string& out, const Account& account) {
+    out += account.getUsername();
+    out += CSV_DELIM;
+    out += std::to_string(account.getDiscriminator());
+    out += CSV_DELIM;
+    out += account.hasNitro() ? '1' : '0';
+    out += CSV_DELIM;
+    out += account.getBadge();
+    out += CSV_DELIM;
+    out += account.getStatus();
+}
+
+// Parses a whole field as a non-negative integer
+static bool parseNumber(string_view field, size_t& value) {
+    auto result = std::from_chars(field.data(), field.data() + field.size(), value);
+    return !field.empty() && result.ec == std::errc() && result.ptr == field.data() + field.size();
+}
+
+// Splits "username disc" and checks the discriminator is in range
+static bool parseKey(string_view args, string& username, int& disc) {
+    size_t space = args.find(' ');
+    size_t value;
+    if (space == 0 || space == string_view::npos || !parseNumber(args.substr(space + 1), value) || value > MAX_DISC) {
+        return false;
+    }
+    username.assign(args.substr(0, space));
+    disc = static_cast<int>(value);
+    return true;
+}
+
+RequestServer::RequestServer(UTree& tree, size_t maxBatch)
+    : _worker(tree, maxBatch), _listenFd(-1), _wakeFd(eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)),
+      _wakePending(false), _stopping(0) {}
+
+RequestServer::~RequestServer() {
+    _worker.stop();
+    for (const ConnectionPtr& connection : _connections) {
+        close(connection->inFd);
+        if (connection->outFd != connection->inFd) {
+            close(connection->outFd);
+        }
+    }
+    if (_listenFd >= 0) {
+        close(_listenFd);
+        unlink(_socketPath.c_str());
+    }
+    close(_wakeFd);
+}
+
+/**
+ * Listens for clients on a Unix domain socket, replacing a stale socket file.
+ * @param path filesystem path of the socket
+ * @return true if the socket is listening, false otherwise
+ */
+bool RequestServer::listen(const string& path) {
+    sockaddr_un address = {};
+    if (path.size() >= sizeof(address.sun_path)) {
+        return false;
+    }
+    address.sun_family = AF_UNIX;
+    std::memcpy(address.sun_path, path.c_str(), path.size() + 1);
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        return false;
+    }
+    unlink(path.c_str());
+    if (bind(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 || ::listen(fd, SOMAXCONN) != 0) {
+        close(fd);
+        return false;
+    }
+    _listenFd = fd;
+    _socketPath = path;
+    return true;
+}
+
+/* Serves requests read from inFd, answering on outFd; run() returns once it reaches EOF and no socket listens */
+void RequestServer::addStream(int inFd, int outFd) {
+    ConnectionPtr connection = std::make_shared<Connection>();
+    connection->inFd = inFd;
+    connection->outFd = outFd;
+    _connections.push_back(connection);
+}
+
+/* Safe to call from a signal handler */
+void RequestServer::requestStop() {
+    _stopping = 1;
+    uint64_t one = 1;
+    (void)!write(_wakeFd, &one, sizeof(one));
+}
+
+/**
+ * Serves until requestStop(), or until every stream has been answered in full
+ * when there is no socket. Requests still queued when it stops are applied
+ * before it returns.
+ */
+void RequestServer::run() {
+    _worker.start();
+    vector<pollfd> polls;
+    vector<std::pair<size_t, short>> owners;    //connection index and event of each poll after the first two
+    while (!_stopping && (_listenFd >= 0 || !_connections.empty())) {
+        polls.clear();
+        owners.clear();
+        polls.push_back({_wakeFd, POLLIN, 0});
+        polls.push_back({_listenFd, POLLIN, 0});
+        for (size_t c = 0; c < _connections.size(); c++) {
+            const ConnectionPtr& connection = _connections[c];
+            bool reading = !connection->inputClosed && !connection->quit
+                        && connection->responses.size() < SERVER_MAX_PIPELINE;
+            bool writing = !connection->output.empty();
+            if (reading) {
+                polls.push_back({connection->inFd, POLLIN, 0});
+                owners.emplace_back(c, POLLIN);
+            }
+            if (writing) {
+                polls.push_back({connection->outFd, POLLOUT, 0});
+                owners.emplace_back(c, POLLOUT);
+            }
+        }
+        if (poll(polls.data(), polls.size(), -1) < 0 && errno != EINTR) {
+            break;
+        }
+        if (polls[0].revents != 0) {
+            uint64_t count;
+            (void)!read(_wakeFd, &count, sizeof(count));
+            _wakePending.store(false);
+        }
+        if (polls[1].revents != 0) {
+            acceptClients();
+        }
+        for (size_t p = 2; p < polls.size(); p++) {
+            if (polls[p].revents != 0 && owners[p - 2].second == POLLIN) {
+                readInput(_connections[owners[p - 2].first]);
+            }
+        }
+
+        //write whatever is answered, and drop connections that are done
+        size_t kept = 0;
+        for (size_t c = 0; c < _connections.size(); c++) {
+            Connection& connection = *_connections[c];
+            writeOutput(connection);
+            bool done = connection.broken || ((connection.inputClosed || connection.quit)
+                        && connection.responses.empty() && connection.output.empty());
+            if (done) {
+                close(connection.inFd);
+                if (connection.outFd != connection.inFd) {
+                    close(connection.outFd);
+                }
+                //answers still on the owner thread hold their own reference
+                continue;
+            }
+            _connections[kept++] = _connections[c];
+        }
+        _connections.resize(kept);
+    }
+    _worker.stop();
+    for (const ConnectionPtr& connection : _connections) {
+        writeOutput(*connection);
+    }
+}
+
+void RequestServer::acceptClients() {
+    while (true) {
+        int fd = accept4(_listenFd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0) {
+            return;
+        }
+        addStream(fd, fd);
+    }
+}
+
+/* Reads what a connection has sent and handles every complete line */
+void RequestServer::readInput(const ConnectionPtr& connection) {
+    Connection& c = *connection;
+    size_t size = c.input.size();
+    c.input.resize(size + SERVER_READ_SIZE);
+    ssize_t count = read(c.inFd, &c.input[size], SERVER_READ_SIZE);
+    c.input.resize(size + std::max<ssize_t>(count, 0));
+    if (count == 0 || (count < 0 && errno != EAGAIN && errno != EINTR)) {
+        c.inputClosed = true;
+    }
+    while (!c.quit) {
+        size_t newline = c.input.find(CSV_NEWLINE, c.inputStart);
+        if (newline == string::npos) {
+            break;
+        }
+        handleLine(connection, string_view(c.input).substr(c.inputStart, newline - c.inputStart));
+        c.inputStart = newline + 1;
+    }
+    c.input.erase(0, c.inputStart);
+    c.inputStart = 0;
+    if (!c.quit && c.input.size() > SERVER_MAX_LINE) {
+        answer(connection, "ERR line too long");
+        c.quit = true;
+    }
+}
+
+/**
+ * Parses one request. Tree requests are queued on the worker with a reserved
+ * answer slot; the rest are answered right away, behind any earlier answers.
+ * @param connection connection the request came from
+ * @param line the request without its newline
+ */
+void RequestServer::handleLine(const ConnectionPtr& connection, string_view line) {
+    if (!line.empty() && line.back() == '\r') {
+        line.remove_suffix(1);
+    }
+    if (line.empty()) {
+        return;
+    }
+    size_t space = line.find(' ');
+    string_view verb = line.substr(0, space);
+    string_view args = (space == string_view::npos) ? string_view() : line.substr(space + 1);
+    string username;
+    int disc;
+
+    if (verb == "INSERT") {
+        RecordView record;
+        try {
+            CSVScanner scanner(args);
+            if (!scanner.next(record) || record.username.empty()) {
+                throw std::invalid_argument("empty username");
+            }
+            Account account = record.toAccount();
+            _worker.insert(std::move(account), completion(connection, COMMAND_INSERT));
+        }
+        catch (const std::exception&) {
+            answer(connection, "ERR expected INSERT username,disc,nitro,badge,status with disc 0-9999");
+        }
+    }
+    else if (verb == "REMOVE" || verb == "GET") {
+        if (!parseKey(args, username, disc)) {
+            answer(connection, "ERR expected " + string(verb) + " username disc with disc 0-9999");
+        }
+        else if (verb == "REMOVE") {
+            _worker.remove(std::move(username), disc, completion(connection, COMMAND_REMOVE));
+        }
+        else {
+            _worker.retrieve(std::move(username), disc, completion(connection, COMMAND_RETRIEVE));
+        }
+    }
+    else if (verb == "COUNT") {
+        if (args.empty() || args.find(' ') != string_view::npos) {
+            answer(connection, "ERR expected COUNT username");
+        }
+        else {
+            _worker.count(string(args), completion(connection, COMMAND_COUNT));
+        }
+    }
+    else if (verb == "PREFIX") {
+        size_t limitStart = args.find(' ');
+        size_t limit = SERVER_DEFAULT_PREFIX_LIMIT;
+        if (limitStart != string_view::npos && !parseNumber(args.substr(limitStart + 1), limit)) {
+            answer(connection, "ERR expected PREFIX [prefix [limit]]");
+        }
+        else {
+            _worker.prefix(string(args.substr(0, limitStart)), limit, completion(connection, COMMAND_PREFIX));
+        }
+    }
+    else if (verb == "STATS") {
+        answer(connection, formatStats());
+    }
+    else if (verb == "PING") {
+        answer(connection, "OK");
+    }
+    else if (verb == "QUIT") {
+        answer(connection, "OK");
+        connection->quit = true;
+    }
+    else {
+        answer(connection, "ERR unknown command " + string(verb));
+    }
+}
+
+// Reserves the next answer slot of a connection; deque slots stay put while others are added or taken
+RequestServer::Response* RequestServer::addResponse(const ConnectionPtr& connection) {
+    std::lock_guard<std::mutex> lock(connection->mutex);
+    connection->responses.emplace_back();
+    return &connection->responses.back();
+}
+
+void RequestServer::answer(const ConnectionPtr& connection, string text) {
+    Response* response = addResponse(connection);
+    std::lock_guard<std::mutex> lock(connection->mutex);
+    response->text = std::move(text);
+    response->ready = true;
+}
+
+/**
+ * Builds the callback that answers a tree request on the owner thread and
+ * records how long the request took from being parsed to being applied.
+ * @param connection connection to answer
+ * @param type kind of request
+ * @return callback to pass to the worker
+ */
+CommandCallback RequestServer::completion(const ConnectionPtr& connection, CommandType type) {
+    Response* response = addResponse(connection);
+    auto received = std::chrono::steady_clock::now();
+    return [this, connection, response, type, received](const CommandResult& result) {
+        string text;
+        if (type == COMMAND_INSERT) {
+            text = result.succeeded ? "OK" : "EXISTS";
+        }
+        else if (type == COMMAND_REMOVE || type == COMMAND_RETRIEVE) {
+            if (result.succeeded) {
+                text = "OK ";
+                appendAccount(text, result.account);
+            }
+            else {
+                text = "NOTFOUND";
+            }
+        }
+        else if (type == COMMAND_COUNT) {
+            text = "OK " + std::to_string(result.count);
+        }
+        else {
+            text = "OK " + std::to_string(result.accounts.size());
+            for (const Account& account : result.accounts) {
+                text += CSV_NEWLINE;
+                appendAccount(text, account);
+            }
+        }
+        {
+            std::lock_guard<std::mutex> lock(connection->mutex);
+            response->text = std::move(text);
+            response->ready = true;
+        }
+        _latencies[type].record(std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - received).count());
+        wake();
+    };
+}
+
+// Signals the I/O thread that answers are ready, once per poll round
+void RequestServer::wake() {
+    if (!_wakePending.exchange(true)) {
+        uint64_t one = 1;
+        (void)!write(_wakeFd, &one, sizeof(one));
+    }
+}
+
+/* Moves the answers ready at the front of the queue to the output buffer and writes as much as fits */
+void RequestServer::writeOutput(Connection& connection) {
+    {
+        std::lock_guard<std::mutex> lock(connection.mutex);
+        while (!connection.responses.empty() && connection.responses.front().ready) {
+            connection.output += connection.responses.front().text;
+            connection.output += CSV_NEWLINE;
+            connection.responses.pop_front();
+        }
+    }
+    size_t written = 0;
+    while (written < connection.output.size() && !connection.broken) {
+        ssize_t count = write(connection.outFd, connection.output.data() + written, connection.output.size() - written);
+        if (count < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                break;
+            }
+            if (errno != EINTR) {
+                connection.broken = true;
+            }
+            continue;
+        }
+        written += count;
+    }
+    connection.output.erase(0, written);
+}
+
+// Answer to STATS: one line per request type seen so far, then the worker's batching
+string RequestServer::formatStats() const {
+    string lines;
+    int numLines = 0;
+    char line[256];
+    for (int t = 0; t < NUM_COMMAND_TYPES; t++) {
+        const LatencyHistogram& latency = _latencies[t];
+        if (latency.getCount() == 0) {
+            continue;
+        }
+        std::snprintf(line, sizeof(line), "\n%s count=%llu mean_us=%.1f p50_us=%.1f p99_us=%.1f p999_us=%.1f max_us=%.1f",
+                      COMMAND_NAMES[t], static_cast<unsigned long long>(latency.getCount()), latency.getMeanMicros(),
+                      latency.getPercentileMicros(0.5), latency.getPercentileMicros(0.99),
+                      latency.getPercentileMicros(0.999), latency.getMaxMicros());
+        lines += line;
+        numLines++;
+    }
+    size_t numBatches = _worker.getNumBatches();
+    std::snprintf(line, sizeof(line), "\nbatches=%zu applied=%zu mean_batch=%.1f connections=%zu",
+                  numBatches, _worker.getNumApplied(),
+                  numBatches == 0 ? 0.0 : static_cast<double>(_worker.getNumApplied()) / numBatches, _connections.size());
+    lines += line;
+    numLines++;
+    return "OK " + std::to_string(numLines) + lines;
+}
+
+static RequestServer* activeServer = nullptr;
+
+static void handleSignal(int) {
+    if (activeServer != nullptr) {
+        activeServer->requestStop();
+    }
+}
+
+int main(int argc, char** argv) {
+    string socketPath;
+    string loadPath;
+    size_t maxBatch = DEFAULT_WORKER_BATCH;
+    for (int a = 1; a < argc; a++) {
+        string flag = argv[a];
+        if (a + 1 < argc && flag == "--socket") {
+            socketPath = argv[++a];
+        }
+        else if (a + 1 < argc && flag == "--load") {
+            loadPath = argv[++a];
+        }
+        else if (a + 1 < argc && flag == "--batch") {
+            maxBatch = std::strtoul(argv[++a], nullptr, 10);
+        }
+        else {
+            std::fprintf(stderr, "usage: %s [--socket PATH] [--load FILE] [--batch N]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    UTree tree;
+    if (!loadPath.empty()) {
+        try {
+            tree.loadData(loadPath, false);
+        }
+        catch (const std::exception& error) {
+            std::fprintf(stderr, "cannot load %s: %s\n", loadPath.c_str(), error.what());
+            return 1;
+        }
+    }
+
+    RequestServer server(tree, maxBatch);
+    if (socketPath.empty()) {
+        server.addStream(STDIN_FILENO, STDOUT_FILENO);
+    }
+    else if (!server.listen(socketPath)) {
+        std::perror(socketPath.c_str());
+        return 1;
+    }
+    activeServer = &server;
+    std::signal(SIGPIPE, SIG_IGN);
+    std::signal(SIGINT, handleSignal);
+    std::signal(SIGTERM, handleSignal);
+    server.run();
+    activeServer = nullptr;
+    return 0;
+}
@@ -0,0 +1,187 @@
+/**
+ * Project 2 - Binary Trees
+ * snapshot.cpp
+ * Binary snapshots of a UTree for fast restarts.
+ *
+ * Layout (integers little-endian, varints LEB128):
+ *   magic "DTSNAP\0\0" | version fixed32 | user count fixed64 | account count fixed64
+ *   badge dictionary: varint count, then varint length + bytes per badge
+ *   status dictionary: same as badges
+ *   per username, in order: varint shared prefix with the previous username,
+ *     varint suffix length, suffix bytes, varint account count, then per account
+ *     in discriminator order: varint gap from the previous discriminator,
+ *     varint (badge code << 1 | nitro), varint status code
+ *   CRC-32 of everything above, fixed32
+ */
+
+#include "utree.h"
+#include "binaryio.h"
+#include <cstdio>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+
+#define SNAPSHOT_MAGIC "DTSNAP\0\0"
+#define SNAPSHOT_MAGIC_SIZE 8
+#define SNAPSHOT_VERSION 1
+#define SNAPSHOT_HEADER_SIZE (SNAPSHOT_MAGIC_SIZE + 4 + 8 + 8)
+
+// Writes to a temporary file, syncs it and renames it over path so a crash never leaves half a file
+static bool writeFileAtomically(const string& path, const vector<const string*>& parts) {
+    string temp = path + ".tmp";
+    int fd = ::open(temp.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        return false;
+    }
+    bool written = true;
+    for (const string* part : parts) {
+        const char* data = part->data();
+        size_t remaining = part->size();
+        while (written && remaining > 0) {
+            ssize_t count = ::write(fd, data, remaining);
+            if (count < 0 && errno == EINTR) {
+                continue;
+            }
+            written = count > 0;
+            data += (count > 0) ? count : 0;
+            remaining -= (count > 0) ? count : 0;
+        }
+    }
+    written = written && fsync(fd) == 0;
+    written = (::close(fd) == 0) && written;
+    if (!written || std::rename(temp.c_str(), path.c_str()) != 0) {
+        std::remove(temp.c_str());
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Saves every account in the tree to a binary snapshot file.
+ * The file is replaced atomically, an existing snapshot survives a failed save.
+ * @param outfile path of the snapshot
+ * @return true if the snapshot was written, false otherwise
+ */
+bool UTree::saveSnapshot(string outfile) const {
+    StringDictionary badges;
+    StringDictionary statuses;
+    string users;
+    string previous;
+    uint64_t numUsers = 0;
+    uint64_t numAccounts = 0;
+
+    forEachNode(_root, [&](UNode* node) {
+        const string username = node->getUsername();
+        size_t shared = 0;
+        while (shared < previous.size() && shared < username.size() && previous[shared] == username[shared]) {
+            shared++;
+        }
+        putVarint(users, shared);
+        putVarint(users, username.size() - shared);
+        users.append(username, shared, string::npos);
+        putVarint(users, countAccounts(node));
+
+        int previousDisc = -1;
+        forEachAccount(node, [&](const Account& account) {
+            putVarint(users, account._disc - previousDisc - 1);
+            putVarint(users, badges.encode(account._badge) << 1 | (account._nitro ? 1 : 0));
+            putVarint(users, statuses.encode(account._status));
+            previousDisc = account._disc;
+            numAccounts++;
+        });
+        previous = username;
+        numUsers++;
+    });
+
+    string header(SNAPSHOT_MAGIC, SNAPSHOT_MAGIC_SIZE);
+    putFixed32(header, SNAPSHOT_VERSION);
+    putFixed64(header, numUsers);
+    putFixed64(header, numAccounts);
+    badges.write(header);
+    statuses.write(header);
+
+    string trailer;
+    putFixed32(trailer, crc32(users.data(), users.size(), crc32(header.data(), header.size())));
+    return writeFileAtomically(outfile, {&header, &users, &trailer});
+}
+
+/**
+ * Replaces the contents of the tree with a binary snapshot. Both tree levels are
+ * built balanced straight from the sorted snapshot.
+ * @param infile path of the snapshot
+ * @return true if the snapshot was loaded, false if it is missing, corrupt or of
+ * another version, in which case the tree is left untouched
+ */
+bool UTree::loadSnapshot(string infile) {
+    MappedFile file;
+    if (!file.open(infile) || file.getSize() < SNAPSHOT_HEADER_SIZE + 4) {
+        return false;
+    }
+    const char* data = file.getData();
+    const char* end = data + file.getSize() - 4;
+    if (std::memcmp(data, SNAPSHOT_MAGIC, SNAPSHOT_MAGIC_SIZE) != 0
+        || getFixed32(data + SNAPSHOT_MAGIC_SIZE) != SNAPSHOT_VERSION
+        || getFixed32(end) != crc32(data, end - data)) {
+        return false;
+    }
+    uint64_t numUsers = getFixed64(data + SNAPSHOT_MAGIC_SIZE + 4);
+    const char* cursor = data + SNAPSHOT_HEADER_SIZE;
+
+    vector<string> badges;
+    vector<string> statuses;
+    if (!readDictionary(cursor, end, badges) || !readDictionary(cursor, end, statuses)
+        || numUsers > static_cast<uint64_t>(end - cursor)) {
+        return false;
+    }
+
+    vector<UNode*> nodes;
+    nodes.reserve(numUsers);
+    vector<Account> accounts;
+    string username;
+    bool valid = true;
+    for (uint64_t u = 0; valid && u < numUsers; u++) {
+        uint64_t shared, suffixLength, count;
+        valid = getVarint(cursor, end, shared) && shared <= username.size()
+             && getVarint(cursor, end, suffixLength) && suffixLength <= static_cast<uint64_t>(end - cursor);
+        if (!valid) {
+            break;
+        }
+        string previous = username;
+        username.resize(shared);
+        username.append(cursor, suffixLength);
+        cursor += suffixLength;
+        valid = (u == 0 || previous < username) && getVarint(cursor, end, count) && count > 0 && count <= MAX_DISC + 1;
+
+        accounts.clear();
+        int disc = -1;
+        for (uint64_t i = 0; valid && i < count; i++) {
+            uint64_t gap, badge, status;
+            valid = getVarint(cursor, end, gap) && gap <= MAX_DISC
+                 && getVarint(cursor, end, badge) && (badge >> 1) < badges.size()
+                 && getVarint(cursor, end, status) && status < statuses.size();
+            disc += static_cast<int>(gap) + 1;
+            valid = valid && disc <= MAX_DISC;
+            if (valid) {
+                accounts.emplace_back(username, disc, (badge & 1) != 0, badges[badge >> 1], statuses[status]);
+            }
+        }
+        if (valid) {
+            UNode* node = new UNode();
+            node->_dtree->buildSorted(accounts);
+            nodes.push_back(node);
+        }
+    }
+    if (!valid || cursor != end) {
+        for (UNode* node : nodes) {
+            delete node;
+        }
+        return false;
+    }
+
+    clear();
+    _root = buildBalanced(nodes, 0, static_cast<int>(nodes.size()) - 1);
+    rebuildLookups(nodes.size());
+    notifyContents();
+    return true;
+}
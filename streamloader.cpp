@@ -0,0 +1,209 @@
+/**
+ * Project 2 - Binary Trees
+ * streamloader.cpp
+ * Implementation for the StreamLoader class.
+ */
+
+#include "streamloader.h"
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+
+StreamLoader::StreamLoader(UTree& tree, size_t batchSize, size_t maxLineLength)
+    : _tree(tree), _batchSize(batchSize > 0 ? batchSize : 1), _maxLineLength(maxLineLength),
+      _partialTooLong(false), _line(0), _numInserted(0), _numDuplicates(0), _numRejected(0) {
+    _batch.reserve(_batchSize);
+}
+
+/**
+ * Consumes the next chunk of the stream. Complete lines are parsed straight out of
+ * the chunk; only a line cut off at the end of the chunk is copied and kept.
+ * @param data bytes of the chunk
+ * @param length number of bytes in the chunk
+ * @return true if every complete line in the chunk was accepted, false if any was rejected
+ */
+bool StreamLoader::feed(const char* data, size_t length) {
+    string_view chunk(data, length);
+    bool accepted = true;
+
+    //finish the line left over from the previous chunk
+    if (!_partial.empty() || _partialTooLong) {
+        size_t newline = chunk.find(CSV_NEWLINE);
+        if (newline == string_view::npos) {
+            newline = chunk.size();
+        }
+        if (!_partialTooLong && _partial.size() + newline <= _maxLineLength) {
+            _partial.append(chunk.data(), newline);
+        }
+        else {
+            _partialTooLong = true;
+            _partial.clear();
+        }
+        if (newline == chunk.size()) {
+            return true;
+        }
+        if (_partialTooLong) {
+            reject(++_line, "line exceeds " + std::to_string(_maxLineLength) + " bytes");
+            accepted = false;
+        }
+        else {
+            accepted = scanLines(_partial);
+        }
+        _partial.clear();
+        _partialTooLong = false;
+        chunk.remove_prefix(newline + 1);
+    }
+
+    //every complete line is parsed in place
+    size_t lastNewline = chunk.rfind(CSV_NEWLINE);
+    if (lastNewline != string_view::npos) {
+        accepted = scanLines(chunk.substr(0, lastNewline + 1)) && accepted;
+        chunk.remove_prefix(lastNewline + 1);
+    }
+
+    //keep the cut off line for the next chunk
+    if (chunk.size() > _maxLineLength) {
+        _partialTooLong = true;
+    }
+    else {
+        _partial.assign(chunk.data(), chunk.size());
+    }
+    return accepted;
+}
+
+/**
+ * Ends the stream: a last line without a newline is parsed and the pending batch is
+ * applied to the tree. The loader can be fed again afterwards.
+ * @return true if the last line was accepted, false otherwise
+ */
+bool StreamLoader::finish() {
+    bool accepted = true;
+    if (_partialTooLong) {
+        reject(++_line, "line exceeds " + std::to_string(_maxLineLength) + " bytes");
+        accepted = false;
+    }
+    else if (!_partial.empty()) {
+        accepted = scanLines(_partial);
+    }
+    _partial.clear();
+    _partialTooLong = false;
+    flush();
+    return accepted;
+}
+
+/**
+ * Applies the pending batch of accounts to the tree through insertBatch, which costs
+ * one descent per username in the batch and gives the results of inserting in order.
+ * Like insertBatch, it can free the DNodes of a username it merges into.
+ */
+void StreamLoader::flush() {
+    if (_batch.empty()) {
+        return;
+    }
+    vector<bool> inserted = _tree.insertBatch(std::move(_batch));
+    for (bool succeeded : inserted) {
+        if (succeeded) {
+            _numInserted++;
+        }
+        else {
+            _numDuplicates++;
+        }
+    }
+    _batch.clear();
+    _batch.reserve(_batchSize);
+}
+
+/**
+ * Reads a stream to its end and ingests everything in it.
+ * @param in stream to read from
+ * @return true if every line was accepted and the stream was read without error
+ */
+bool StreamLoader::loadStream(std::istream& in) {
+    vector<char> buffer(STREAM_READ_SIZE);
+    bool accepted = true;
+    while (in) {
+        in.read(buffer.data(), buffer.size());
+        if (in.gcount() > 0) {
+            accepted = feed(buffer.data(), in.gcount()) && accepted;
+        }
+    }
+    accepted = finish() && accepted;
+    if (in.bad()) {
+        _error = "read error on input stream";
+        return false;
+    }
+    return accepted;
+}
+
+/**
+ * Reads a file descriptor (file, pipe or socket) until end of file and ingests everything in it.
+ * @param fd descriptor to read from, it is not closed
+ * @return true if every line was accepted and the descriptor was read without error
+ */
+bool StreamLoader::loadDescriptor(int fd) {
+    vector<char> buffer(STREAM_READ_SIZE);
+    bool accepted = true;
+    while (true) {
+        ssize_t count = ::read(fd, buffer.data(), buffer.size());
+        if (count < 0 && errno == EINTR) {
+            continue;
+        }
+        if (count < 0) {
+            _error = string("read error: ") + std::strerror(errno);
+            finish();
+            return false;
+        }
+        if (count == 0) {
+            break;
+        }
+        accepted = feed(buffer.data(), count) && accepted;
+    }
+    return finish() && accepted;
+}
+
+/**
+ * Ingests a whole .csv file.
+ * @param infile path to .csv file containing database of accounts
+ * @return true if the file was read and every line was accepted, false otherwise
+ */
+bool StreamLoader::loadFile(string infile) {
+    int fd = ::open(infile.c_str(), O_RDONLY);
+    if (fd < 0) {
+        _error = "File " + infile + " could not be opened or located";
+        return false;
+    }
+    bool accepted = loadDescriptor(fd);
+    ::close(fd);
+    return accepted;
+}
+
+// Parses complete lines and queues their accounts, bad lines are skipped
+bool StreamLoader::scanLines(string_view lines) {
+    CSVScanner scanner(lines);
+    RecordView record;
+    bool accepted = true;
+    while (true) {
+        try {
+            if (!scanner.next(record)) {
+                break;
+            }
+            _batch.push_back(record.toAccount());
+            if (_batch.size() >= _batchSize) {
+                flush();
+            }
+        }
+        catch (const std::exception& e) {
+            reject(_line + scanner.getLineNumber(), e.what());
+            accepted = false;
+        }
+    }
+    _line += scanner.getLineNumber();
+    return accepted;
+}
+
+// Counts a rejected line and remembers why
+void StreamLoader::reject(size_t line, const string& reason) {
+    _numRejected++;
+    _error = "line " + std::to_string(line) + ": " + reason;
+}
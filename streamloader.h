@@ -0,0 +1,64 @@
+/**
+ * Project 2 - Binary Trees
+ * streamloader.h
+ * An interface for loading accounts into a UTree from a stream of chunks.
+ */
+
+#pragma once
+
+#include "utree.h"
+
+#define DEFAULT_BATCH_SIZE 4096
+#define DEFAULT_MAX_LINE_LENGTH 65536
+#define STREAM_READ_SIZE 65536
+
+/**
+ * Incremental .csv ingest for a UTree. Bytes can arrive in chunks of any size from
+ * any source (a pipe, a growing file, a socket); a record split across chunks is
+ * stitched back together. Accounts are applied to the tree in batches, so at most
+ * one batch and one partial line are buffered at a time; a line carried over between
+ * chunks that grows past maxLineLength is rejected instead of buffered.
+ * Bad lines are skipped and reported through the return value and getError()
+ * instead of ending the process.
+ */
+class StreamLoader {
+public:
+    StreamLoader(UTree& tree, size_t batchSize = DEFAULT_BATCH_SIZE, size_t maxLineLength = DEFAULT_MAX_LINE_LENGTH);
+    ~StreamLoader() {finish();}
+
+    StreamLoader(const StreamLoader&) = delete;
+    StreamLoader& operator=(const StreamLoader&) = delete;
+
+    bool feed(const char* data, size_t length);
+    bool feed(string_view chunk) {return feed(chunk.data(), chunk.size());}
+    bool finish();
+    void flush();
+
+    bool loadStream(std::istream& in);
+    bool loadDescriptor(int fd);
+    bool loadFile(string infile);
+
+    /* Getters */
+    string getError() const {return _error;}
+    size_t getLineNumber() const {return _line;}
+    size_t getNumInserted() const {return _numInserted;}
+    size_t getNumDuplicates() const {return _numDuplicates;}
+    size_t getNumRejected() const {return _numRejected;}
+    size_t getNumBuffered() const {return _batch.size() + _partial.size();}
+
+private:
+    UTree& _tree;
+    size_t _batchSize;
+    size_t _maxLineLength;
+    string _partial;        //start of a line whose end has not arrived yet
+    bool _partialTooLong;   //the partial line overflowed and is being skipped
+    vector<Account> _batch;
+    string _error;
+    size_t _line;
+    size_t _numInserted;
+    size_t _numDuplicates;
+    size_t _numRejected;
+
+    bool scanLines(string_view lines);
+    void reject(size_t line, const string& reason);
+};
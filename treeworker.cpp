@@ -0,0 +1,341 @@
+/**
+ * Project 2 - Binary Trees
+ * treeworker.cpp
+ * An asynchronous front end that applies queued commands to a UTree on one owner thread.
+ */
+
+#include "treeworker.h"
+#include <algorithm>
+
+/**
+ * Appends a command. Producers only swap the head pointer, so pushes from any
+ * number of threads never wait on each other or on the consumer.
+ * @param command command to append, owned by the queue until popped
+ */
+void CommandQueue::push(Command* command) {
+    command->next.store(nullptr, std::memory_order_relaxed);
+    Command* previous = _head.exchange(command);
+    //between the exchange and this store the command is unreachable from _tail
+    previous->next.store(command, std::memory_order_release);
+}
+
+/**
+ * Removes the oldest command. Only the owner thread may call this.
+ * @return the command, or nullptr if the queue is empty or the next push is not linked in yet
+ */
+Command* CommandQueue::pop() {
+    Command* tail = _tail;
+    Command* next = tail->next.load(std::memory_order_acquire);
+    if (tail == &_stub) {
+        if (next == nullptr) {
+            return nullptr;
+        }
+        _tail = next;
+        tail = next;
+        next = next->next.load(std::memory_order_acquire);
+    }
+    if (next != nullptr) {
+        _tail = next;
+        return tail;
+    }
+    if (tail != _head.load(std::memory_order_acquire)) {
+        return nullptr;
+    }
+    //tail is the last command, put the stub behind it so it can be handed out
+    push(&_stub);
+    next = tail->next.load(std::memory_order_acquire);
+    if (next != nullptr) {
+        _tail = next;
+        return tail;
+    }
+    return nullptr;
+}
+
+/* True if nothing has been pushed since the last pop, owner thread only */
+bool CommandQueue::isEmpty() const {
+    return _tail->next.load(std::memory_order_acquire) == nullptr && _head.load() == _tail;
+}
+
+TreeWorker::TreeWorker(UTree& tree, size_t maxBatch)
+    : _tree(tree), _maxBatch(std::max<size_t>(1, maxBatch)), _stopping(false), _sleeping(false),
+      _numApplied(0), _numBatches(0) {}
+
+/* Stops the worker; futures of commands that were never applied report a broken promise */
+TreeWorker::~TreeWorker() {
+    stop();
+    while (Command* command = _queue.pop()) {
+        delete command;
+    }
+}
+
+/* Starts the owner thread, which applies commands until stop() */
+void TreeWorker::start() {
+    if (isRunning()) {
+        return;
+    }
+    _stopping.store(false);
+    _thread = std::thread(&TreeWorker::run, this);
+}
+
+/**
+ * Applies every command queued before the call, then joins the owner thread.
+ * Commands submitted while the worker is stopped wait for the next start().
+ */
+void TreeWorker::stop() {
+    if (!isRunning()) {
+        return;
+    }
+    _stopping.store(true);
+    {
+        std::lock_guard<std::mutex> lock(_wakeMutex);
+    }
+    _wake.notify_one();
+    _thread.join();
+}
+
+std::future<CommandResult> TreeWorker::insert(Account account) {
+    Command* command = new Command;
+    command->type = COMMAND_INSERT;
+    command->account = std::move(account);
+    return submit(command);
+}
+
+std::future<CommandResult> TreeWorker::remove(string username, int disc) {
+    Command* command = new Command;
+    command->type = COMMAND_REMOVE;
+    command->username = std::move(username);
+    command->disc = disc;
+    return submit(command);
+}
+
+std::future<CommandResult> TreeWorker::retrieve(string username, int disc) {
+    Command* command = new Command;
+    command->type = COMMAND_RETRIEVE;
+    command->username = std::move(username);
+    command->disc = disc;
+    return submit(command);
+}
+
+std::future<CommandResult> TreeWorker::count(string username) {
+    Command* command = new Command;
+    command->type = COMMAND_COUNT;
+    command->username = std::move(username);
+    return submit(command);
+}
+
+std::future<CommandResult> TreeWorker::prefix(string prefix, size_t limit) {
+    Command* command = new Command;
+    command->type = COMMAND_PREFIX;
+    command->username = std::move(prefix);
+    command->limit = limit;
+    return submit(command);
+}
+
+void TreeWorker::insert(Account account, CommandCallback callback) {
+    Command* command = new Command;
+    command->type = COMMAND_INSERT;
+    command->account = std::move(account);
+    command->callback = std::move(callback);
+    enqueue(command);
+}
+
+void TreeWorker::remove(string username, int disc, CommandCallback callback) {
+    Command* command = new Command;
+    command->type = COMMAND_REMOVE;
+    command->username = std::move(username);
+    command->disc = disc;
+    command->callback = std::move(callback);
+    enqueue(command);
+}
+
+void TreeWorker::retrieve(string username, int disc, CommandCallback callback) {
+    Command* command = new Command;
+    command->type = COMMAND_RETRIEVE;
+    command->username = std::move(username);
+    command->disc = disc;
+    command->callback = std::move(callback);
+    enqueue(command);
+}
+
+void TreeWorker::count(string username, CommandCallback callback) {
+    Command* command = new Command;
+    command->type = COMMAND_COUNT;
+    command->username = std::move(username);
+    command->callback = std::move(callback);
+    enqueue(command);
+}
+
+void TreeWorker::prefix(string prefix, size_t limit, CommandCallback callback) {
+    Command* command = new Command;
+    command->type = COMMAND_PREFIX;
+    command->username = std::move(prefix);
+    command->limit = limit;
+    command->callback = std::move(callback);
+    enqueue(command);
+}
+
+std::future<CommandResult> TreeWorker::submit(Command* command) {
+    command->promise.emplace();
+    std::future<CommandResult> result = command->promise->get_future();
+    enqueue(command);
+    return result;
+}
+
+/**
+ * Pushes a command and wakes the owner thread if it went to sleep. The owner
+ * sets _sleeping before its last look at the queue and the push comes before
+ * this load, so at least one of them sees the other and no wakeup is lost.
+ */
+void TreeWorker::enqueue(Command* command) {
+    _queue.push(command);
+    if (_sleeping.load()) {
+        {
+            std::lock_guard<std::mutex> lock(_wakeMutex);
+        }
+        _wake.notify_one();
+    }
+}
+
+/* Owner thread: drain up to _maxBatch commands at a time, sleep when there are none */
+void TreeWorker::run() {
+    vector<Command*> batch;
+    batch.reserve(_maxBatch);
+    while (true) {
+        while (batch.size() < _maxBatch) {
+            Command* command = _queue.pop();
+            if (command == nullptr) {
+                break;
+            }
+            batch.push_back(command);
+        }
+        if (!batch.empty()) {
+            apply(batch);
+            batch.clear();
+            continue;
+        }
+        if (!_queue.isEmpty()) {
+            //a push is half done, it will be linked in momentarily
+            std::this_thread::yield();
+            continue;
+        }
+        if (_stopping.load()) {
+            return;
+        }
+        std::unique_lock<std::mutex> lock(_wakeMutex);
+        _sleeping.store(true);
+        _wake.wait(lock, [this]() {
+            return !_queue.isEmpty() || _stopping.load();
+        });
+        _sleeping.store(false);
+    }
+}
+
+/**
+ * Applies a batch in queue order. Each run of consecutive commands of one type
+ * goes to the tree in a single call where the tree has a batched form: inserts
+ * through insertBatch, removes through removeBatch and retrieves through
+ * retrieveMany, all of which give the results of the same commands applied one
+ * by one. A lone remove goes straight to removeUser; a run of them costs one
+ * descent per username it touches, never a pass over the whole tree.
+ * @param batch commands to apply, deleted once completed
+ */
+void TreeWorker::apply(vector<Command*>& batch) {
+    size_t start = 0;
+    while (start < batch.size()) {
+        CommandType type = batch[start]->type;
+        size_t end = start + 1;
+        while (end < batch.size() && batch[end]->type == type) {
+            end++;
+        }
+        vector<CommandResult> results(end - start);
+        if (type == COMMAND_INSERT) {
+            vector<Account> accounts;
+            accounts.reserve(end - start);
+            for (size_t i = start; i < end; i++) {
+                accounts.push_back(std::move(batch[i]->account));
+            }
+            vector<bool> inserted = _tree.insertBatch(std::move(accounts));
+            for (size_t i = start; i < end; i++) {
+                results[i - start].succeeded = inserted[i - start];
+            }
+        }
+        else if (type == COMMAND_REMOVE && end - start == 1) {
+            //a lone remove skips removeBatch's sorting; the account is copied first,
+            //removeUser frees its DNode if it was the username's last
+            DNode* found = _tree.retrieveUser(batch[start]->username, batch[start]->disc);
+            if (found != nullptr) {
+                results[0].account = found->getAccount();
+                DNode* removed = nullptr;
+                results[0].succeeded = _tree.removeUser(batch[start]->username, batch[start]->disc, removed);
+            }
+        }
+        else if (type == COMMAND_REMOVE) {
+            vector<std::pair<string, int>> keys;
+            keys.reserve(end - start);
+            for (size_t i = start; i < end; i++) {
+                keys.emplace_back(batch[i]->username, batch[i]->disc);
+            }
+            vector<Account> removed = _tree.removeBatch(keys);
+            //removed is in key order; a key queued twice only succeeds the first time
+            vector<char> claimed(removed.size(), 0);
+            for (size_t i = start; i < end; i++) {
+                auto found = std::lower_bound(removed.begin(), removed.end(), keys[i - start],
+                    [](const Account& account, const std::pair<string, int>& key) {
+                        return std::make_pair(account.getUsername(), account.getDiscriminator()) < key;
+                    });
+                size_t index = found - removed.begin();
+                if (found != removed.end() && found->getUsername() == keys[i - start].first
+                    && found->getDiscriminator() == keys[i - start].second && !claimed[index]) {
+                    claimed[index] = 1;
+                    results[i - start].succeeded = true;
+                    results[i - start].account = *found;
+                }
+            }
+        }
+        else if (type == COMMAND_RETRIEVE) {
+            vector<std::pair<string, int>> keys;
+            keys.reserve(end - start);
+            for (size_t i = start; i < end; i++) {
+                keys.emplace_back(batch[i]->username, batch[i]->disc);
+            }
+            //copy the accounts out, the nodes may change once the next run is applied
+            vector<DNode*> found = _tree.retrieveMany(keys);
+            for (size_t i = start; i < end; i++) {
+                if (found[i - start] != nullptr) {
+                    results[i - start].succeeded = true;
+                    results[i - start].account = found[i - start]->getAccount();
+                }
+            }
+        }
+        else if (type == COMMAND_COUNT) {
+            for (size_t i = start; i < end; i++) {
+                results[i - start].count = _tree.numUsers(batch[i]->username);
+                results[i - start].succeeded = results[i - start].count > 0;
+            }
+        }
+        else {
+            for (size_t i = start; i < end; i++) {
+                results[i - start].accounts = _tree.retrievePrefix(batch[i]->username, batch[i]->limit);
+                results[i - start].count = results[i - start].accounts.size();
+                results[i - start].succeeded = true;
+            }
+        }
+        for (size_t i = start; i < end; i++) {
+            complete(batch[i], results[i - start]);
+        }
+        start = end;
+    }
+    _numApplied.fetch_add(batch.size());
+    _numBatches.fetch_add(1);
+}
+
+// Hands the result to the callback or the future, then frees the command
+void TreeWorker::complete(Command* command, CommandResult& result) {
+    if (command->promise) {
+        command->promise->set_value(std::move(result));
+    }
+    else if (command->callback) {
+        command->callback(result);
+    }
+    delete command;
+}
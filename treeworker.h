@@ -0,0 +1,125 @@
+/**
+ * Project 2 - Binary Trees
+ * treeworker.h
+ * An interface for the TreeWorker class, an asynchronous front end to a UTree.
+ */
+
+#pragma once
+
+#include "utree.h"
+#include <atomic>
+#include <condition_variable>
+#include <future>
+#include <mutex>
+#include <optional>
+#include <thread>
+
+#define DEFAULT_WORKER_BATCH 1024
+
+enum CommandType {
+    COMMAND_INSERT,
+    COMMAND_REMOVE,
+    COMMAND_RETRIEVE,
+    COMMAND_COUNT,
+    COMMAND_PREFIX
+};
+
+/* Outcome of a command; account is filled by a successful retrieve or remove */
+struct CommandResult {
+    bool succeeded = false;
+    int count = 0;
+    Account account;
+    vector<Account> accounts;   //prefix matches
+};
+
+typedef std::function<void(const CommandResult&)> CommandCallback;
+
+/* A queued command, linked into the queue through next */
+struct Command {
+    std::atomic<Command*> next{nullptr};
+    CommandType type = COMMAND_COUNT;
+    Account account;            //insert
+    string username;            //remove, retrieve, count, prefix
+    int disc = INVALID_DISC;    //remove, retrieve
+    size_t limit = 0;           //prefix
+    std::optional<std::promise<CommandResult>> promise;  //only made for future-returning calls
+    CommandCallback callback;   //called on the owner thread when there is no promise
+};
+
+/**
+ * Unbounded multi-producer single-consumer queue (Vyukov's intrusive list).
+ * push never blocks or locks; pop may briefly return nullptr while a push
+ * is half done, the command shows up on a later pop.
+ */
+class CommandQueue {
+public:
+    CommandQueue(): _head(&_stub), _tail(&_stub) {}
+
+    CommandQueue(const CommandQueue&) = delete;
+    CommandQueue& operator=(const CommandQueue&) = delete;
+
+    void push(Command* command);
+    Command* pop();
+    bool isEmpty() const;
+
+private:
+    std::atomic<Command*> _head;    //last pushed, shared by producers
+    Command* _tail;                 //next to pop, consumer only
+    Command _stub;
+};
+
+/**
+ * Owns a UTree on a dedicated thread. Any thread can submit commands, which
+ * go through a lock-free queue; the owner thread drains it in batches and is
+ * the only thread touching the tree, so the tree needs no lock. Runs of
+ * consecutive inserts are applied with insertBatch and runs of retrieves with
+ * retrieveMany, and commands always take effect in the order they were queued.
+ *
+ * Each call returns a future, or takes a callback that runs on the owner
+ * thread. Don't touch the tree directly while the worker is running.
+ */
+class TreeWorker {
+public:
+    TreeWorker(UTree& tree, size_t maxBatch = DEFAULT_WORKER_BATCH);
+    ~TreeWorker();
+
+    TreeWorker(const TreeWorker&) = delete;
+    TreeWorker& operator=(const TreeWorker&) = delete;
+
+    void start();
+    void stop();
+
+    std::future<CommandResult> insert(Account account);
+    std::future<CommandResult> remove(string username, int disc);
+    std::future<CommandResult> retrieve(string username, int disc);
+    std::future<CommandResult> count(string username);
+    std::future<CommandResult> prefix(string prefix, size_t limit = 0);
+    void insert(Account account, CommandCallback callback);
+    void remove(string username, int disc, CommandCallback callback);
+    void retrieve(string username, int disc, CommandCallback callback);
+    void count(string username, CommandCallback callback);
+    void prefix(string prefix, size_t limit, CommandCallback callback);
+
+    /* Getters */
+    bool isRunning() const {return _thread.joinable();}
+    size_t getNumApplied() const {return _numApplied.load();}
+    size_t getNumBatches() const {return _numBatches.load();}
+
+private:
+    UTree& _tree;
+    size_t _maxBatch;
+    CommandQueue _queue;
+    std::thread _thread;
+    std::atomic<bool> _stopping;
+    std::atomic<bool> _sleeping;
+    std::mutex _wakeMutex;
+    std::condition_variable _wake;
+    std::atomic<size_t> _numApplied;
+    std::atomic<size_t> _numBatches;
+
+    std::future<CommandResult> submit(Command* command);
+    void enqueue(Command* command);
+    void run();
+    void apply(vector<Command*>& batch);
+    void complete(Command* command, CommandResult& result);
+};
@@ -0,0 +1,97 @@
+/**
+ * Project 2 - Binary Trees
+ * usernamefilter.cpp
+ * A blocked counting Bloom filter over usernames.
+ */
+
+#include "usernamefilter.h"
+#include <functional>
+
+/**
+ * Creates an empty filter.
+ * @param capacity usernames the filter keeps its false positive rate for
+ */
+UsernameFilter::UsernameFilter(size_t capacity)
+    : _blocks((capacity * FILTER_COUNTERS_PER_NAME + FILTER_BLOCK_SIZE - 1) / FILTER_BLOCK_SIZE + 1),
+      _capacity(capacity), _numUsernames(0) {
+    clear();
+}
+
+/**
+ * Records a username. A username added twice has to be removed twice.
+ * @param username username to record
+ */
+void UsernameFilter::add(std::string_view username) {
+    uint64_t hash = hashOf(username);
+    Block& block = blockOf(hash);
+    for (int i = 0; i < FILTER_NUM_PROBES; i++) {
+        uint8_t& counter = block.counters[probe(hash, i)];
+        if (counter != UINT8_MAX) {
+            counter++;
+        }
+    }
+    _numUsernames++;
+}
+
+/**
+ * Forgets a username added before; removing one that never was corrupts the filter.
+ * @param username username to forget
+ */
+void UsernameFilter::remove(std::string_view username) {
+    uint64_t hash = hashOf(username);
+    Block& block = blockOf(hash);
+    for (int i = 0; i < FILTER_NUM_PROBES; i++) {
+        uint8_t& counter = block.counters[probe(hash, i)];
+        //a saturated counter no longer knows how many usernames share it
+        if (counter != UINT8_MAX && counter != 0) {
+            counter--;
+        }
+    }
+    if (_numUsernames > 0) {
+        _numUsernames--;
+    }
+}
+
+/**
+ * Checks a username.
+ * @param username username to look for
+ * @return false if the username was certainly not added, true if it may have been
+ */
+bool UsernameFilter::mightContain(std::string_view username) const {
+    uint64_t hash = hashOf(username);
+    const Block& block = blockOf(hash);
+    //no early exit, the probes share a cache line and the branch would mispredict
+    uint8_t all = UINT8_MAX;
+    for (int i = 0; i < FILTER_NUM_PROBES; i++) {
+        all &= (block.counters[probe(hash, i)] != 0) ? UINT8_MAX : 0;
+    }
+    return all != 0;
+}
+
+void UsernameFilter::clear() {
+    for (Block& block : _blocks) {
+        for (uint8_t& counter : block.counters) {
+            counter = 0;
+        }
+    }
+    _numUsernames = 0;
+}
+
+// Picks the block from the top half of the hash without a division
+UsernameFilter::Block& UsernameFilter::blockOf(uint64_t hash) {
+    return _blocks[((hash >> 32) * _blocks.size()) >> 32];
+}
+
+const UsernameFilter::Block& UsernameFilter::blockOf(uint64_t hash) const {
+    return _blocks[((hash >> 32) * _blocks.size()) >> 32];
+}
+
+uint64_t UsernameFilter::hashOf(std::string_view username) {
+    return std::hash<std::string_view>()(username);
+}
+
+// Counter of the i-th probe within the block, six bits each from a remix of the hash
+unsigned int UsernameFilter::probe(uint64_t hash, int i) {
+    uint64_t mixed = hash * 0x9E3779B97F4A7C15ULL;
+    return static_cast<unsigned int>(mixed >> (64 - 6 * (i + 1))) & (FILTER_BLOCK_SIZE - 1);
+}
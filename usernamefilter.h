@@ -0,0 +1,58 @@
+/**
+ * Project 2 - Binary Trees
+ * usernamefilter.h
+ * An interface for the UsernameFilter class, a counting Bloom filter over usernames.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <string_view>
+#include <vector>
+
+#define DEFAULT_FILTER_CAPACITY 1024    //usernames a UsernameFilter is sized for unless told otherwise
+#define FILTER_COUNTERS_PER_NAME 16     //counters per username of capacity, about 1% false positives
+#define FILTER_NUM_PROBES 6             //counters set per username
+#define FILTER_BLOCK_SIZE 64            //counters per block, one cache line
+
+/**
+ * A counting Bloom filter answering "is this username possibly present": a no
+ * is certain, a yes is wrong about 1% of the time while the filter holds no more
+ * usernames than its capacity. Each username bumps FILTER_NUM_PROBES one byte
+ * counters, all in the same cache line sized block, so a check costs a single
+ * cache miss. Counters make removal possible; one that saturates stays set,
+ * which can only add false positives.
+ *
+ * UTree::enableUsernameFilter keeps one in step with the tree's UNodes so that
+ * lookups of missing usernames skip the descent.
+ */
+class UsernameFilter {
+public:
+    UsernameFilter(size_t capacity = DEFAULT_FILTER_CAPACITY);
+
+    void add(std::string_view username);
+    void remove(std::string_view username);
+    bool mightContain(std::string_view username) const;
+    void clear();
+
+    /* Getters */
+    size_t getCapacity() const {return _capacity;}
+    size_t getNumUsernames() const {return _numUsernames;}
+    size_t getMemoryBytes() const {return _blocks.size() * sizeof(Block);}
+    bool isFull() const {return _numUsernames > _capacity;}
+
+private:
+    struct alignas(FILTER_BLOCK_SIZE) Block {
+        uint8_t counters[FILTER_BLOCK_SIZE];
+    };
+
+    std::vector<Block> _blocks;
+    size_t _capacity;
+    size_t _numUsernames;
+
+    Block& blockOf(uint64_t hash);
+    const Block& blockOf(uint64_t hash) const;
+    static uint64_t hashOf(std::string_view username);
+    static unsigned int probe(uint64_t hash, int i);
+};
@@ -0,0 +1,382 @@
+/**
+ * Project 2 - Binary Trees
+ * usernameindex.cpp
+ * A B+ tree from username to UNode with packed key heads and per-node prefix compression.
+ */
+
+#include "usernameindex.h"
+#include <algorithm>
+
+using std::string;
+using std::string_view;
+using std::vector;
+
+/**
+ * Creates an empty index.
+ * @param compressPrefixes true to store the bytes shared by the keys of a node once
+ */
+UsernameIndex::UsernameIndex(bool compressPrefixes)
+    : _root(new Node()), _compress(compressPrefixes), _size(0), _height(1), _numNodes(1) {}
+
+UsernameIndex::~UsernameIndex() {
+    clear(_root);
+}
+
+/**
+ * Looks up the UNode of a username.
+ * @param username username to look for
+ * @return the UNode, nullptr if the username is not in the index
+ */
+UNode* UsernameIndex::find(string_view username) const {
+    const Node* node = _root;
+    while (!node->leaf) {
+        node = node->children[upperBound(node, username)];
+    }
+    bool equal;
+    int pos = lowerBound(node, username, equal);
+    return equal ? node->values[pos] : nullptr;
+}
+
+/**
+ * Maps a username to a UNode, replacing what it was mapped to before.
+ * @param username username to map
+ * @param node UNode of the username
+ */
+void UsernameIndex::insert(string_view username, UNode* node) {
+    string split;
+    Node* right = nullptr;
+    if (insert(_root, username, node, split, right)) {
+        _size++;
+    }
+    if (right != nullptr) {
+        //the root split, the tree grows a level
+        Node* root = new Node();
+        root->leaf = false;
+        root->children[0] = _root;
+        root->children[1] = right;
+        setKeys(root, {split});
+        _root = root;
+        _height++;
+        _numNodes++;
+    }
+}
+
+/**
+ * Removes a username. Its leaf is not merged with a neighbour, even once empty.
+ * @param username username to remove
+ * @return true if the username was in the index
+ */
+bool UsernameIndex::erase(string_view username) {
+    Node* node = _root;
+    while (!node->leaf) {
+        node = node->children[upperBound(node, username)];
+    }
+    bool equal;
+    int pos = lowerBound(node, username, equal);
+    if (!equal) {
+        return false;
+    }
+    for (int i = pos; i + 1 < node->count; i++) {
+        node->heads[i] = node->heads[i + 1];
+        node->suffixes[i] = std::move(node->suffixes[i + 1]);
+        node->values[i] = node->values[i + 1];
+    }
+    node->count--;
+    node->suffixes[node->count].clear();
+    _size--;
+    return true;
+}
+
+/**
+ * Replaces the contents with full nodes built bottom-up, linear in the number of usernames.
+ * @param sorted (username, UNode) pairs in increasing username order without duplicates
+ */
+void UsernameIndex::build(const vector<std::pair<string_view, UNode*>>& sorted) {
+    clear();
+    if (sorted.empty()) {
+        return;
+    }
+    delete _root;
+    _numNodes = 0;
+    vector<Node*> level;
+    vector<string> firsts;      //smallest key below each node of the level
+    vector<string> keys;
+    for (size_t start = 0; start < sorted.size(); start += INDEX_NODE_KEYS) {
+        size_t end = std::min(sorted.size(), start + INDEX_NODE_KEYS);
+        Node* leaf = new Node();
+        keys.clear();
+        for (size_t i = start; i < end; i++) {
+            keys.emplace_back(sorted[i].first);
+            leaf->values[i - start] = sorted[i].second;
+        }
+        setKeys(leaf, keys);
+        level.push_back(leaf);
+        firsts.push_back(keys.front());
+    }
+    _numNodes = level.size();
+    _height = 1;
+    while (level.size() > 1) {
+        vector<Node*> parents;
+        vector<string> parentFirsts;
+        for (size_t start = 0; start < level.size(); start += INDEX_NODE_KEYS + 1) {
+            size_t end = std::min(level.size(), start + INDEX_NODE_KEYS + 1);
+            Node* parent = new Node();
+            parent->leaf = false;
+            keys.clear();
+            for (size_t i = start; i < end; i++) {
+                parent->children[i - start] = level[i];
+                if (i > start) {
+                    keys.push_back(std::move(firsts[i]));
+                }
+            }
+            setKeys(parent, keys);
+            parents.push_back(parent);
+            parentFirsts.push_back(std::move(firsts[start]));
+        }
+        _numNodes += parents.size();
+        _height++;
+        level.swap(parents);
+        firsts.swap(parentFirsts);
+    }
+    _root = level.front();
+    _size = sorted.size();
+}
+
+void UsernameIndex::clear() {
+    clear(_root);
+    _root = new Node();
+    _size = 0;
+    _height = 1;
+    _numNodes = 1;
+}
+
+/**
+ * @return bytes taken by the nodes and the key strings they allocated
+ */
+size_t UsernameIndex::getMemoryBytes() const {
+    return getMemoryBytes(_root);
+}
+
+// Packs the first eight bytes of a key big-endian, so integer order is byte order
+uint64_t UsernameIndex::headOf(string_view suffix) {
+    uint64_t head = 0;
+    size_t length = std::min(suffix.size(), sizeof(uint64_t));
+    for (size_t i = 0; i < sizeof(uint64_t); i++) {
+        head <<= 8;
+        if (i < length) {
+            head |= static_cast<unsigned char>(suffix[i]);
+        }
+    }
+    return head;
+}
+
+// Orders key i of a node against a suffix: negative, zero or positive
+int UsernameIndex::compare(const Node* node, int i, string_view suffix, uint64_t head) {
+    if (node->heads[i] != head) {
+        return node->heads[i] < head ? -1 : 1;
+    }
+    return string_view(node->suffixes[i]).compare(suffix);
+}
+
+// Position of the first key of a node not less than key, equal set if it is key
+int UsernameIndex::lowerBound(const Node* node, string_view key, bool& equal) {
+    equal = false;
+    string_view prefix = node->prefix;
+    if (key.substr(0, prefix.size()) != prefix) {
+        //every key of the node starts with the prefix, so they all compare alike
+        return key < prefix ? 0 : node->count;
+    }
+    string_view suffix = key.substr(prefix.size());
+    uint64_t head = headOf(suffix);
+    int low = 0;
+    int high = node->count;
+    while (low < high) {
+        int mid = (low + high) / 2;
+        if (compare(node, mid, suffix, head) < 0) {
+            low = mid + 1;
+        }
+        else {
+            high = mid;
+        }
+    }
+    equal = low < node->count && compare(node, low, suffix, head) == 0;
+    return low;
+}
+
+// Position of the first key of a node greater than key, the child to descend into
+int UsernameIndex::upperBound(const Node* node, string_view key) {
+    string_view prefix = node->prefix;
+    if (key.substr(0, prefix.size()) != prefix) {
+        return key < prefix ? 0 : node->count;
+    }
+    string_view suffix = key.substr(prefix.size());
+    uint64_t head = headOf(suffix);
+    int low = 0;
+    int high = node->count;
+    while (low < high) {
+        int mid = (low + high) / 2;
+        if (compare(node, mid, suffix, head) <= 0) {
+            low = mid + 1;
+        }
+        else {
+            high = mid;
+        }
+    }
+    return low;
+}
+
+string UsernameIndex::keyOf(const Node* node, int i) {
+    return node->prefix + node->suffixes[i];
+}
+
+// Bytes a string allocated outside itself, 0 for one held in its small buffer
+size_t UsernameIndex::heapBytes(const string& text) {
+    const char* data = text.data();
+    bool inside = data >= reinterpret_cast<const char*>(&text) && data < reinterpret_cast<const char*>(&text + 1);
+    return inside ? 0 : text.capacity() + 1;
+}
+
+// Replaces the keys of a node with sorted keys, recomputing its prefix
+void UsernameIndex::setKeys(Node* node, const vector<string>& keys) const {
+    size_t shared = 0;
+    if (_compress && !keys.empty()) {
+        //the keys are sorted, so what the first and last share every key shares
+        const string& first = keys.front();
+        const string& last = keys.back();
+        while (shared < first.size() && shared < last.size() && first[shared] == last[shared]) {
+            shared++;
+        }
+    }
+    node->prefix = keys.empty() ? string() : keys.front().substr(0, shared);
+    node->count = static_cast<int>(keys.size());
+    for (size_t i = 0; i < keys.size(); i++) {
+        node->suffixes[i].assign(keys[i], shared, string::npos);
+        node->heads[i] = headOf(node->suffixes[i]);
+    }
+    for (int i = node->count; i < INDEX_NODE_KEYS; i++) {
+        node->suffixes[i].clear();
+    }
+}
+
+// Adds a key to a node that has room, shortening its prefix if the key does not share it.
+// A leaf takes value for the key; an inner node takes child as the subtree right of it
+void UsernameIndex::addEntry(Node* node, string_view key, UNode* value, Node* child) const {
+    string_view prefix = node->prefix;
+    if (key.substr(0, prefix.size()) != prefix) {
+        size_t shared = 0;
+        while (shared < prefix.size() && shared < key.size() && prefix[shared] == key[shared]) {
+            shared++;
+        }
+        string cut(prefix.substr(shared));
+        for (int i = 0; i < node->count; i++) {
+            node->suffixes[i].insert(0, cut);
+            node->heads[i] = headOf(node->suffixes[i]);
+        }
+        node->prefix.resize(shared);
+    }
+    int pos = upperBound(node, key);
+    for (int i = node->count; i > pos; i--) {
+        node->heads[i] = node->heads[i - 1];
+        node->suffixes[i] = std::move(node->suffixes[i - 1]);
+        if (node->leaf) {
+            node->values[i] = node->values[i - 1];
+        }
+        else {
+            node->children[i + 1] = node->children[i];
+        }
+    }
+    node->suffixes[pos].assign(key.substr(node->prefix.size()));
+    node->heads[pos] = headOf(node->suffixes[pos]);
+    if (node->leaf) {
+        node->values[pos] = value;
+    }
+    else {
+        node->children[pos + 1] = child;
+    }
+    node->count++;
+}
+
+// Inserts below node; if node had to split, right is the new node holding keys from split up
+bool UsernameIndex::insert(Node* node, string_view key, UNode* value, string& split, Node*& right) {
+    if (node->leaf) {
+        bool equal;
+        int pos = lowerBound(node, key, equal);
+        if (equal) {
+            node->values[pos] = value;
+            return false;
+        }
+        if (node->count == INDEX_NODE_KEYS) {
+            splitNode(node, split, right);
+            addEntry(key < split ? node : right, key, value, nullptr);
+        }
+        else {
+            addEntry(node, key, value, nullptr);
+        }
+        return true;
+    }
+
+    string childSplit;
+    Node* childRight = nullptr;
+    bool added = insert(node->children[upperBound(node, key)], key, value, childSplit, childRight);
+    if (childRight != nullptr) {
+        if (node->count == INDEX_NODE_KEYS) {
+            splitNode(node, split, right);
+            addEntry(childSplit < split ? node : right, childSplit, nullptr, childRight);
+        }
+        else {
+            addEntry(node, childSplit, nullptr, childRight);
+        }
+    }
+    return added;
+}
+
+// Moves the upper half of a full node to a new node. A leaf's split key is the first key
+// of the new node, an inner node's middle key moves up and is kept by neither half
+void UsernameIndex::splitNode(Node* node, string& split, Node*& right) {
+    int mid = node->count / 2;
+    vector<string> leftKeys;
+    vector<string> rightKeys;
+    for (int i = 0; i < node->count; i++) {
+        (i < mid ? leftKeys : rightKeys).push_back(keyOf(node, i));
+    }
+    right = new Node();
+    right->leaf = node->leaf;
+    _numNodes++;
+    if (node->leaf) {
+        for (int i = mid; i < node->count; i++) {
+            right->values[i - mid] = node->values[i];
+        }
+        split = rightKeys.front();
+    }
+    else {
+        for (int i = mid + 1; i <= node->count; i++) {
+            right->children[i - mid - 1] = node->children[i];
+        }
+        split = std::move(rightKeys.front());
+        rightKeys.erase(rightKeys.begin());
+    }
+    setKeys(node, leftKeys);
+    setKeys(right, rightKeys);
+}
+
+void UsernameIndex::clear(Node* node) {
+    if (!node->leaf) {
+        for (int i = 0; i <= node->count; i++) {
+            clear(node->children[i]);
+        }
+    }
+    delete node;
+}
+
+size_t UsernameIndex::getMemoryBytes(const Node* node) const {
+    size_t bytes = sizeof(Node) + heapBytes(node->prefix);
+    for (int i = 0; i < node->count; i++) {
+        bytes += heapBytes(node->suffixes[i]);
+    }
+    if (!node->leaf) {
+        for (int i = 0; i <= node->count; i++) {
+            bytes += getMemoryBytes(node->children[i]);
+        }
+    }
+    return bytes;
+}
@@ -0,0 +1,81 @@
+/**
+ * Project 2 - Binary Trees
+ * usernameindex.h
+ * An interface for the UsernameIndex class, a B+ tree from username to UNode.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#define INDEX_NODE_KEYS 64      //keys per B+ tree node, leaf or inner
+
+class UNode;
+
+/**
+ * A B+ tree from username to UNode with wide nodes: a lookup visits about
+ * log64(n) nodes instead of the log2(n) UNodes of the AVL descent. Each node
+ * keeps its keys in sorted arrays with the first eight bytes of every key
+ * packed into an integer, so the binary search in a node compares integers in
+ * one or two cache lines and only reads a string to break a tie.
+ *
+ * With prefix compression, the bytes all keys of a node share are stored once
+ * per node and stripped from its keys, which for names like "user123456"
+ * leaves the packed integers to tell most keys apart on their own.
+ *
+ * Erasing never merges nodes, a node may end up empty; build() packs them
+ * again. UTree::enableUsernameIndex keeps one in step with the UNodes.
+ */
+class UsernameIndex {
+public:
+    UsernameIndex(bool compressPrefixes = true);
+    ~UsernameIndex();
+
+    UsernameIndex(const UsernameIndex&) = delete;
+    UsernameIndex& operator=(const UsernameIndex&) = delete;
+
+    UNode* find(std::string_view username) const;
+    void insert(std::string_view username, UNode* node);
+    bool erase(std::string_view username);
+    void build(const std::vector<std::pair<std::string_view, UNode*>>& sorted);
+    void clear();
+
+    /* Getters */
+    size_t getSize() const {return _size;}
+    int getHeight() const {return _height;}
+    size_t getNumNodes() const {return _numNodes;}
+    size_t getMemoryBytes() const;
+
+private:
+    struct Node {
+        bool leaf = true;
+        int count = 0;
+        std::string prefix;                     //shared by every key of the node, "" without compression
+        uint64_t heads[INDEX_NODE_KEYS];        //first eight bytes of each key after the prefix
+        std::string suffixes[INDEX_NODE_KEYS];  //each key after the prefix
+        UNode* values[INDEX_NODE_KEYS];         //leaf: the UNode of each key
+        Node* children[INDEX_NODE_KEYS + 1];    //inner: keys below children[i] are < key i <= keys below children[i + 1]
+    };
+
+    Node* _root;
+    bool _compress;
+    size_t _size;
+    int _height;
+    size_t _numNodes;
+
+    static uint64_t headOf(std::string_view suffix);
+    static int compare(const Node* node, int i, std::string_view suffix, uint64_t head);
+    static int lowerBound(const Node* node, std::string_view key, bool& equal);
+    static int upperBound(const Node* node, std::string_view key);
+    static std::string keyOf(const Node* node, int i);
+    static size_t heapBytes(const std::string& text);
+    void setKeys(Node* node, const std::vector<std::string>& keys) const;
+    void addEntry(Node* node, std::string_view key, UNode* value, Node* child) const;
+    bool insert(Node* node, std::string_view key, UNode* value, std::string& split, Node*& right);
+    void splitNode(Node* node, std::string& split, Node*& right);
+    void clear(Node* node);
+    size_t getMemoryBytes(const Node* node) const;
+};
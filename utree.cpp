@@ -9,12 +9,23 @@
  */
 
 #include "utree.h"
+#include <thread>
+#include <atomic>
+#include <functional>
+#include <unordered_map>
+#include <exception>
+#include <algorithm>
 
 /**
  * Destructor, deletes all dynamic memory.
  */
 UTree::~UTree() {
+    //tearing the tree down is not a change observers should record
+    _observers.clear();
     clear();
+    delete _cache;
+    delete _filter;
+    delete _index;
 }
 
 /**
@@ -23,40 +34,404 @@ UTree::~UTree() {
  * @param append true to append to an existing tree structure or false to clear before importing
  */ 
 void UTree::loadData(string infile, bool append) {
-    std::ifstream instream(infile);
-    string line;
-    char delim = ',';
-    const int numFields = 5;
-    string fields[numFields];
+    MappedFile file;
 
     /* Check to make sure the file was opened */
-    if(!instream.is_open()) {
+    if(!file.open(infile)) {
         std::cerr << __FUNCTION__ << ": File " << infile << " could not be opened or located" << endl;
         exit(-1);
     }
 
+    /* Scan the mapped file in place, fields stay views into the mapping until
+     * the Account is built - each line always has 5 sections of data */
+    CSVScanner scanner(file.getView());
+    RecordView record;
+
+    /* A full load sorts the file and builds both levels balanced in one shot */
+    if(!append || _root == nullptr) {
+        vector<RecordView> records;
+        while(scanner.next(record)) {
+            records.push_back(record);
+        }
+        this->clear();
+        bulkLoad(records);
+        return;
+    }
+
+    while(scanner.next(record)) {
+        this->insert(record.toAccount());
+    }
+}
+
+/**
+ * Builds the tree from scratch out of every record of a file. Records are sorted by
+ * (username, discriminator), keeping file order among duplicates so the first one wins
+ * like it does with insert. Each DTree is built balanced from its run of the sort and the
+ * UTree is built perfectly balanced bottom-up, linear in the number of records.
+ * @param records parsed lines of the file, reordered by the call
+ */
+void UTree::bulkLoad(vector<RecordView>& records) {
+    for (const RecordView& record : records) {
+        if (record.disc < MIN_DISC || record.disc > MAX_DISC) {
+            throw std::out_of_range("Discriminator out of valid range (" + std::to_string(MIN_DISC)
+                                    + "-" + std::to_string(MAX_DISC) + ")");
+        }
+    }
+    std::stable_sort(records.begin(), records.end(), [](const RecordView& a, const RecordView& b) {
+        int order = a.username.compare(b.username);
+        return order < 0 || (order == 0 && a.disc < b.disc);
+    });
+
+    vector<UNode*> nodes;
+    vector<Account> accounts;
+    size_t start = 0;
+    while (start < records.size()) {
+        size_t end = start;
+        accounts.clear();
+        while (end < records.size() && records[end].username == records[start].username) {
+            //only the first of a run of equal discriminators is kept
+            if (end == start || records[end].disc != records[end - 1].disc) {
+                accounts.push_back(records[end].toAccount());
+            }
+            end++;
+        }
+        UNode* node = new UNode();
+        node->_dtree->buildSorted(accounts);
+        nodes.push_back(node);
+        start = end;
+    }
+    _root = buildBalanced(nodes, 0, static_cast<int>(nodes.size()) - 1);
+    rebuildLookups(nodes.size());
+    notifyContents();
+}
+
+/**
+ * Sources a .csv file like a full loadData, but leaves every DTree unbuilt. Each
+ * username only keeps the offsets of its lines, one per discriminator, and the file
+ * stays mapped; the DTree is built from those lines the first time an insert, a
+ * removal or retrieve touches the username. Startup then costs one parse and sort,
+ * and memory holds an offset per account instead of a DNode and its strings until
+ * accounts are used. Traversals like printUsers or saveSnapshot read lazy usernames
+ * straight from the file without building them.
+ * The DTree of a UNode reached through getLeft/getRight is empty until retrieve
+ * returns that UNode.
+ *
+ * The file must stay unchanged until getNumLazy() is 0 or the tree is cleared: lazy
+ * usernames read the mapping, so a rewrite changes their accounts and a truncation,
+ * e.g. exportAccounts into the same path, makes the next read crash with SIGBUS.
+ * @param infile path to .csv file containing database of accounts, replaces the tree
+ */
+void UTree::loadDataLazy(string infile) {
+    MappedFile file;
+    if (!file.open(infile)) {
+        std::cerr << __FUNCTION__ << ": File " << infile << " could not be opened or located" << endl;
+        exit(-1);
+    }
+
+    //only the key and where the line starts are kept; the fields are checked now
+    //so building a DTree later cannot fail
+    struct LazyRecord {
+        string_view username;
+        int disc;
+        size_t offset;
+    };
+    vector<LazyRecord> records;
+    CSVScanner scanner(file.getView());
+    RecordView record;
+    size_t offset = scanner.getPosition();
+    while (scanner.next(record)) {
+        if (record.disc < MIN_DISC || record.disc > MAX_DISC) {
+            throw std::out_of_range("Discriminator out of valid range (" + std::to_string(MIN_DISC)
+                                    + "-" + std::to_string(MAX_DISC) + ")");
+        }
+        records.push_back({record.username, record.disc, offset});
+        offset = scanner.getPosition();
+    }
+    std::stable_sort(records.begin(), records.end(), [](const LazyRecord& a, const LazyRecord& b) {
+        int order = a.username.compare(b.username);
+        return order < 0 || (order == 0 && a.disc < b.disc);
+    });
+
+    this->clear();
+    _lazySource.swap(file);
+    _lazySource.adviseRandomAccess();
+    vector<UNode*> nodes;
+    size_t start = 0;
+    while (start < records.size()) {
+        UNode* node = new UNode();
+        node->_lazyName = records[start].username;
+        node->_lazyBegin = _lazyLines.size();
+        size_t end = start;
+        while (end < records.size() && records[end].username == records[start].username) {
+            //only the first of a run of equal discriminators is kept, like bulkLoad
+            if (end == start || records[end].disc != records[end - 1].disc) {
+                _lazyLines.push_back(records[end].offset);
+                node->_lazyCount++;
+            }
+            end++;
+        }
+        nodes.push_back(node);
+        start = end;
+    }
+    _numLazy = nodes.size();
+    _root = buildBalanced(nodes, 0, static_cast<int>(nodes.size()) - 1);
+    rebuildLookups(nodes.size());
+    notifyContents();
+}
+
+// Builds the DTree of a UNode left unbuilt by loadDataLazy
+void UTree::materialize(UNode* node) {
+    if (!node->isLazy()) {
+        return;
+    }
+    vector<Account> accounts;
+    accounts.reserve(node->_lazyCount);
+    forEachAccount(node, [&](const Account& account) {
+        accounts.push_back(account);
+    });
+    node->_dtree->buildSorted(accounts);
+    dropLazyRange(node);
+}
+
+// Forgets the source lines of a UNode whose DTree now holds its accounts
+void UTree::dropLazyRange(UNode* node) {
+    if (node->isLazy()) {
+        node->_lazyName = string_view();
+        node->_lazyCount = 0;
+        _numLazy--;
+    }
+}
+
+// Number of accounts under a UNode, without building a lazy one
+int UTree::countAccounts(UNode* node) const {
+    return node->isLazy() ? node->_lazyCount : node->_dtree->getNumUsers();
+}
+
+// Visits the accounts of a UNode in discriminator order, reading a lazy one from the source file
+void UTree::forEachAccount(UNode* node, const std::function<void(const Account&)>& visit) const {
+    if (!node->isLazy()) {
+        node->_dtree->forEachAccount(visit);
+        return;
+    }
+    string_view source = _lazySource.getView();
+    RecordView record;
+    for (int i = 0; i < node->_lazyCount; i++) {
+        CSVScanner scanner(source.substr(_lazyLines[node->_lazyBegin + i]));
+        scanner.next(record);
+        visit(record.toAccount());
+    }
+}
+
+// Links sorted UNodes into a perfectly balanced subtree, heights follow updateHeight
+UNode* UTree::buildBalanced(vector<UNode*>& nodes, int start, int end) {
+    if (start > end) {
+        return nullptr;
+    }
+    int mid = (start + end) / 2;
+    UNode* root = nodes[mid];
+    root->_left = buildBalanced(nodes, start, mid - 1);
+    root->_right = buildBalanced(nodes, mid + 1, end);
+    int leftHeight = (root->_left != nullptr) ? root->_left->_height : 0;
+    int rightHeight = (root->_right != nullptr) ? root->_right->_height : 0;
+    root->_height = 1 + std::max(leftHeight, rightHeight);
+    return root;
+}
+
+// One piece of the input file parsed by a loader thread
+struct LoadChunk {
+    vector<RecordView> records;
+    vector<string_view> names;      //usernames in order of first appearance
+    vector<vector<size_t>> members; //indices into records for each name
+    std::exception_ptr error;
+};
+
+// All records of one username across the file, in file order
+struct LoadGroup {
+    vector<const RecordView*> records;
+    DTree* dtree = nullptr;
+    bool isNew = false;
+    vector<char> inserted;  //whether each record made it into the DTree
+};
+
+// Runs task(0) .. task(numTasks - 1) spread over up to numThreads threads
+void UTree::parallelFor(size_t numTasks, unsigned int numThreads, const std::function<void(size_t)>& task) {
+    std::atomic<size_t> nextTask(0);
+    auto worker = [&]() {
+        for (size_t i = nextTask++; i < numTasks; i = nextTask++) {
+            task(i);
+        }
+    };
+    vector<std::thread> threads;
+    for (unsigned int i = 1; i < numThreads && i < numTasks; i++) {
+        threads.emplace_back(worker);
+    }
+    worker();
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+}
+
+/**
+ * Sources a .csv file like loadData, but parses it on several threads.
+ * The file is split at line boundaries and each piece is parsed and grouped by username
+ * concurrently. A full load then builds every DTree balanced on a worker and the UTree
+ * bottom-up, as loadData's bulk load does, so both levels end up exactly as loadData
+ * builds them. When appending to a tree that is not empty, each username's accounts are
+ * inserted into its DTree by a worker in file order and new usernames are linked in
+ * order of first appearance. The same accounts win duplicate discriminators as with
+ * loadData, but DTree and UTree shapes may differ: DTree inserts rebalance differently
+ * from the balanced build and loadData also rebalances along the path of every repeated
+ * username. Finding the existing UNode of an appended username builds it if it is lazy.
+ * Unlike loadData, a malformed line is reported before the tree is modified.
+ * @param infile path to .csv file containing database of accounts
+ * @param append true to append to an existing tree structure or false to clear before importing
+ * @param numThreads number of threads to use, 0 for one per hardware thread
+ */
+void UTree::loadDataParallel(string infile, bool append, unsigned int numThreads) {
+    MappedFile file;
+
+    /* Check to make sure the file was opened */
+    if(!file.open(infile)) {
+        std::cerr << __FUNCTION__ << ": File " << infile << " could not be opened or located" << endl;
+        exit(-1);
+    }
+    if (numThreads == 0) {
+        numThreads = std::max(1u, std::thread::hardware_concurrency());
+    }
+
+    //cut the file into one chunk per thread, every cut lands right after a newline
+    string_view text = file.getView();
+    vector<size_t> bounds(1, 0);
+    for (unsigned int i = 1; i < numThreads; i++) {
+        size_t cut = text.size() / numThreads * i;
+        if (cut <= bounds.back()) {
+            continue;
+        }
+        size_t newline = text.find(CSV_NEWLINE, cut - 1);
+        if (newline == string_view::npos) {
+            break;
+        }
+        if (newline + 1 > bounds.back()) {
+            bounds.push_back(newline + 1);
+        }
+    }
+    bounds.push_back(text.size());
+
+    //parse and group every chunk concurrently
+    vector<LoadChunk> chunks(bounds.size() - 1);
+    parallelFor(chunks.size(), numThreads, [&](size_t c) {
+        LoadChunk& chunk = chunks[c];
+        try {
+            std::unordered_map<string_view, size_t> localGroup;
+            CSVScanner scanner(text.substr(bounds[c], bounds[c + 1] - bounds[c]));
+            RecordView record;
+            while (scanner.next(record)) {
+                //the Account constructor would throw this later on a worker
+                if (record.disc < MIN_DISC || record.disc > MAX_DISC) {
+                    throw std::out_of_range("Discriminator out of valid range (" + std::to_string(MIN_DISC)
+                                            + "-" + std::to_string(MAX_DISC) + ")");
+                }
+                auto found = localGroup.emplace(record.username, chunk.names.size());
+                if (found.second) {
+                    chunk.names.push_back(record.username);
+                    chunk.members.emplace_back();
+                }
+                chunk.members[found.first->second].push_back(chunk.records.size());
+                chunk.records.push_back(record);
+            }
+        }
+        catch (...) {
+            chunk.error = std::current_exception();
+        }
+    });
+    for (LoadChunk& chunk : chunks) {
+        if (chunk.error) {
+            std::rethrow_exception(chunk.error);
+        }
+    }
+
     /* Should we append or clear? */
     if(!append) this->clear();
 
-    /* Read in the data from the .csv file and insert into the UTree */
-    while(std::getline(instream, line)) {
-        std::stringstream buffer(line);
+    //merge the chunk groups in file order, a name's first chunk decides its position
+    std::unordered_map<string_view, size_t> groupOf;
+    vector<LoadGroup> groups;
+    for (LoadChunk& chunk : chunks) {
+        for (size_t i = 0; i < chunk.names.size(); i++) {
+            auto found = groupOf.emplace(chunk.names[i], groups.size());
+            if (found.second) {
+                groups.emplace_back();
+            }
+            LoadGroup& group = groups[found.first->second];
+            for (size_t index : chunk.members[i]) {
+                group.records.push_back(&chunk.records[index]);
+            }
+        }
+    }
+
+    //a full load sorts each group and builds it balanced, then links the UTree as bulkLoad does
+    if (_root == nullptr) {
+        vector<UNode*> nodes(groups.size());
+        parallelFor(groups.size(), numThreads, [&](size_t g) {
+            vector<const RecordView*>& records = groups[g].records;
+            std::stable_sort(records.begin(), records.end(), [](const RecordView* a, const RecordView* b) {
+                return a->disc < b->disc;
+            });
+            vector<Account> accounts;
+            for (size_t i = 0; i < records.size(); i++) {
+                //only the first of a run of equal discriminators is kept
+                if (i == 0 || records[i]->disc != records[i - 1]->disc) {
+                    accounts.push_back(records[i]->toAccount());
+                }
+            }
+            nodes[g] = new UNode();
+            nodes[g]->_dtree->buildSorted(accounts);
+        });
+        std::sort(nodes.begin(), nodes.end(), [](const UNode* a, const UNode* b) {
+            return usernameOf(a) < usernameOf(b);
+        });
+        _root = buildBalanced(nodes, 0, static_cast<int>(nodes.size()) - 1);
+        rebuildLookups(nodes.size());
+        notifyContents();
+        return;
+    }
+
+    //usernames already in the tree keep their DTree, the rest get a fresh one
+    for (LoadGroup& group : groups) {
+        UNode* existing = retrieve(string(group.records.front()->username));
+        group.isNew = (existing == nullptr);
+        group.dtree = group.isNew ? new DTree() : existing->_dtree;
+    }
 
-        /* Quick check to make sure each line is formatted correctly */
-        int delimCount = 0;
-        for(unsigned int c = 0; c < buffer.str().length(); c++) if(buffer.str()[c] == delim) delimCount++;
-        if(delimCount != numFields - 1) {
-            throw std::invalid_argument("Malformed input file detected - ensure each line contains 5 fields deliminated by a ','");
+    //every DTree is independent, so they can be filled concurrently
+    parallelFor(groups.size(), numThreads, [&](size_t g) {
+        LoadGroup& group = groups[g];
+        group.inserted.resize(group.records.size());
+        for (size_t i = 0; i < group.records.size(); i++) {
+            group.inserted[i] = group.dtree->insert(group.records[i]->toAccount());
         }
+    });
 
-        /* Populate the account attributes - 
-         * Each line always has 5 sections of data */
-        for(int i = 0; i < numFields; i++) {
-            std::getline(buffer, line, delim);
-            fields[i] = line;
+    //link the new usernames in the same order sequential inserts would have
+    for (LoadGroup& group : groups) {
+        if (group.isNew) {
+            UNode* node = new UNode();
+            delete node->_dtree;
+            node->_dtree = group.dtree;
+            insertNode(_root, node);
+            addUsername(group.records.front()->username, node);
+        }
+    }
+
+    //observers are not thread safe, tell them afterwards in per-username file order
+    if (!_observers.empty()) {
+        for (LoadGroup& group : groups) {
+            for (size_t i = 0; i < group.records.size(); i++) {
+                if (group.inserted[i]) {
+                    notifyInserted(group.records[i]->toAccount());
+                }
+            }
         }
-        Account newAcct = Account(fields[0], std::stoi(fields[1]), std::stoi(fields[2]), fields[3], fields[4]);
-        this->insert(newAcct);
     }
 }
 
@@ -68,7 +443,132 @@ void UTree::loadData(string infile, bool append) {
  * @return true if the account was inserted, false otherwise
  */
 bool UTree::insert(Account newAcct) {
-    return insert(_root, newAcct);
+    if (!insert(_root, newAcct)) {
+        return false;
+    }
+    notifyInserted(newAcct);
+    return true;
+}
+
+/**
+ * Inserts many accounts with the same outcome as calling insert on each in order,
+ * but with one UTree descent per distinct username. Accounts are sorted by
+ * (username, discriminator) and grouped; a new username gets a UNode whose DTree is
+ * built balanced from its group, an existing one takes its group in one merge of
+ * the sorted accounts that rebuilds the DTree, or, when the DTree is much larger
+ * than the group, through plain DTree inserts. Either way a removed discriminator
+ * can be inserted again, as with insert.
+ *
+ * The merge frees the username's DNodes, vacant ones included, so DNode pointers
+ * taken for it before, from retrieveUser or the removed of removeUser, dangle.
+ * @param accounts accounts to insert, consumed by the call
+ * @return for each account, in the order given, true if it was inserted
+ */
+vector<bool> UTree::insertBatch(vector<Account>&& accounts) {
+    vector<size_t> order(accounts.size());
+    for (size_t i = 0; i < order.size(); i++) {
+        order[i] = i;
+    }
+    //stable, so the first of several equal keys is the one that can succeed
+    std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+        int compare = accounts[a]._username.compare(accounts[b]._username);
+        return compare < 0 || (compare == 0 && accounts[a]._disc < accounts[b]._disc);
+    });
+
+    vector<bool> inserted(accounts.size(), false);
+    vector<Account> fresh;
+    vector<Account> merged;
+    size_t start = 0;
+    while (start < order.size()) {
+        const string& username = accounts[order[start]]._username;
+        size_t end = start;
+        fresh.clear();
+        vector<size_t> freshIndex;
+        while (end < order.size() && accounts[order[end]]._username == username) {
+            if (end == start || accounts[order[end]]._disc != accounts[order[end - 1]]._disc) {
+                fresh.push_back(accounts[order[end]]);
+                freshIndex.push_back(order[end]);
+            }
+            end++;
+        }
+
+        bool created = false;
+        UNode* node = insertGroup(_root, username, fresh, created);
+        if (created) {
+            for (size_t index : freshIndex) {
+                inserted[index] = true;
+            }
+        }
+        else if (fresh.size() * BATCH_MERGE_RATIO < static_cast<size_t>(countAccounts(node))) {
+            materialize(node);
+            for (size_t i = 0; i < fresh.size(); i++) {
+                inserted[freshIndex[i]] = node->_dtree->insert(fresh[i]);
+            }
+        }
+        else {
+            //merge the sorted new accounts into the DTree's and rebuild it once
+            materialize(node);
+            if (_cache != nullptr) {
+                _cache->eraseUsername(username);
+            }
+            merged.clear();
+            merged.reserve(countAccounts(node) + fresh.size());
+            size_t next = 0;
+            node->_dtree->forEachAccount([&](const Account& account) {
+                while (next < fresh.size() && fresh[next]._disc < account._disc) {
+                    inserted[freshIndex[next]] = true;
+                    merged.push_back(std::move(fresh[next++]));
+                }
+                if (next < fresh.size() && fresh[next]._disc == account._disc) {
+                    next++;
+                }
+                merged.push_back(account);
+            });
+            for (; next < fresh.size(); next++) {
+                inserted[freshIndex[next]] = true;
+                merged.push_back(std::move(fresh[next]));
+            }
+            node->_dtree->buildSorted(merged);
+        }
+        start = end;
+    }
+
+    for (size_t i = 0; i < accounts.size(); i++) {
+        if (inserted[i]) {
+            notifyInserted(accounts[i]);
+        }
+    }
+    return inserted;
+}
+
+// Descends once to the UNode of username; a missing one is created with its DTree built from fresh
+UNode* UTree::insertGroup(UNode*& node, const string& username, vector<Account>& fresh, bool& created) {
+    if (node == nullptr) {
+        node = new UNode();
+        node->_dtree->buildSorted(fresh);
+        node->_height = 1;
+        created = true;
+        addUsername(username, node);
+        return node;
+    }
+    UNode* found;
+    if (username > node->getUsername()) {
+        found = insertGroup(node->_right, username, fresh, created);
+    }
+    else if (username < node->getUsername()) {
+        found = insertGroup(node->_left, username, fresh, created);
+    }
+    else {
+        return node;
+    }
+    if (created) {
+        updateHeight(node);
+        int heightDifference = checkImbalance(node);
+        if (heightDifference > 1 || heightDifference < -1) {
+            rebalance(node);
+        }
+    }
+    return found;
 }
 
 bool UTree::insert(UNode*& node, Account newAcct){
@@ -76,7 +576,8 @@ bool UTree::insert(UNode*& node, Account newAcct){
     if (node == nullptr) {
         node = new UNode();
         node->getDTree()->insert(newAcct);
-        node->_height = 0;
+        node->_height = 1;
+        addUsername(newAcct._username, node);
         return true;
     }
     //insert into the right subtree
@@ -101,10 +602,31 @@ bool UTree::insert(UNode*& node, Account newAcct){
     }
     else{
         //insert into the DTree since the username already exists
+        materialize(node);
         return node->getDTree()->insert(newAcct);
     }
 }
 
+// Links a UNode holding a username not yet in the tree, rebalancing on the way back up
+void UTree::insertNode(UNode*& node, UNode* newNode) {
+    if (node == nullptr) {
+        node = newNode;
+        node->_height = 1;
+        return;
+    }
+    if (newNode->getUsername() > node->getUsername()) {
+        insertNode(node->_right, newNode);
+    }
+    else {
+        insertNode(node->_left, newNode);
+    }
+    updateHeight(node);
+    int heightDifference = checkImbalance(node);
+    if (heightDifference > 1 || heightDifference < -1) {
+        rebalance(node);
+    }
+}
+
 /**
  * Removes a user with a matching username and discriminator.
  * @param username username to match
@@ -151,8 +673,14 @@ bool UTree::removeUser(UNode*& node, string username, int disc, DNode*& removed)
     //found the user 
     else {
         //remove the user from the DTree
+        materialize(node);
         bool didRemoveDTree = node->getDTree()->remove(disc, removed);
         if (didRemoveDTree) {
+            if (_cache != nullptr) {
+                _cache->erase(username, disc);
+            }
+            //removed is freed with the UNode if this was the username's last account
+            notifyRemoved(removed->getAccount());
             if (node->getDTree()->getNumUsers() == 0) {
                 replaceVacantNode(node);
             }
@@ -171,6 +699,9 @@ void UTree::replaceVacantNode(UNode*& node) {
     if (node == nullptr) {
         return;
     }
+    //the username goes with its UNode, or with its DTree when a successor's takes its place
+    removeUsername(usernameOf(node));
+    dropLazyRange(node);
     //leaf node
     if (node->_left == nullptr && node->_right == nullptr) {
         delete node;
@@ -196,6 +727,10 @@ void UTree::replaceVacantNode(UNode*& node) {
 
         delete node->_dtree;
         node->_dtree = rightMost;
+        //the successor's username now lives in this UNode
+        if (_index != nullptr) {
+            _index->insert(usernameOf(node), node);
+        }
 
         updateHeight(node);
         int heightDifference = checkImbalance(node);
@@ -221,23 +756,284 @@ void UTree::deleteRightMost(UNode*& node, DTree*& rightMost) {
     }
     //found the rightmost node
     else {
+        //its DTree moves to another UNode, which has no lazy range to take along
+        materialize(node);
         rightMost = node->_dtree;
         UNode* temp = node;
         node = node->_left;
+        //the UNode destructor would delete the DTree that now belongs to the caller
+        temp->_dtree = nullptr;
         delete temp;
     }
 }
     
 
+/**
+ * Removes many accounts by key, with one UTree descent per distinct username. A
+ * DTree losing a large share of its accounts is rebuilt once without them or any
+ * vacancies; one losing fewer, under 1/REMOVAL_COMPACT_RATIO, has them removed in
+ * place as removeUser does, since a rebuild would cost more than the removals.
+ * A username left without accounts is unlinked from the UTree as removeUser does,
+ * unless so many are that rebuilding the UTree once without them is cheaper.
+ * @param keys (username, discriminator) pairs to remove, missing ones are skipped
+ * @return the removed accounts in username then discriminator order
+ */
+vector<Account> UTree::removeBatch(const vector<std::pair<string, int>>& keys) {
+    vector<std::pair<string, int>> sorted(keys);
+    std::sort(sorted.begin(), sorted.end());
+    vector<Account> removed;
+    vector<UNode*> emptied;
+    size_t start = 0;
+    while (start < sorted.size()) {
+        size_t end = start;
+        while (end < sorted.size() && sorted[end].first == sorted[start].first) {
+            end++;
+        }
+        UNode* node = findNode(sorted[start].first);
+        if (node == nullptr) {
+            start = end;
+            continue;
+        }
+        bool empty;
+        if ((end - start) * REMOVAL_COMPACT_RATIO < static_cast<size_t>(countAccounts(node))) {
+            empty = removeEach(node, sorted, start, end, removed);
+        }
+        else {
+            empty = compact(node, [&](const Account& account) {
+                return std::binary_search(sorted.begin() + start, sorted.begin() + end,
+                                          std::make_pair(account._username, account._disc));
+            }, removed);
+        }
+        if (empty) {
+            emptied.push_back(node);
+        }
+        start = end;
+    }
+    finishRemoval(emptied, removed);
+    return removed;
+}
+
+/**
+ * Removes every account a predicate selects, e.g. all accounts with some status,
+ * with the same single compaction pass as removeBatch.
+ * @param predicate returns true for the accounts to remove
+ * @return the removed accounts in username then discriminator order
+ */
+vector<Account> UTree::removeIf(const std::function<bool(const Account&)>& predicate) {
+    vector<UNode*> nodes;
+    forEachNode(_root, [&](UNode* node) {
+        nodes.push_back(node);
+    });
+    vector<Account> removed;
+    vector<UNode*> emptied;
+    for (UNode* node : nodes) {
+        if (compact(node, predicate, removed)) {
+            emptied.push_back(node);
+        }
+    }
+    finishRemoval(emptied, removed);
+    return removed;
+}
+
+// Rebuilds a UNode's DTree without the matching accounts, true if none would be left.
+// Such a UNode is left as it is, its username still steers lookups until finishRemoval
+bool UTree::compact(UNode* node, const std::function<bool(const Account&)>& matches, vector<Account>& removed) {
+    vector<Account> kept;
+    size_t before = removed.size();
+    forEachAccount(node, [&](const Account& account) {
+        (matches(account) ? removed : kept).push_back(account);
+    });
+    //the DTree is rebuilt or freed either way, its DNodes go
+    if (removed.size() > before && _cache != nullptr) {
+        _cache->eraseUsername(string(usernameOf(node)));
+    }
+    if (kept.empty()) {
+        return true;
+    }
+    //a lazy UNode nothing matched stays lazy
+    if (removed.size() > before) {
+        node->_dtree->buildSorted(kept);
+        dropLazyRange(node);
+    }
+    return false;
+}
+
+// Removes the sorted keys [start, end) of one username from its DTree in place, leaving
+// vacancies as removeUser does. True if no account is left, which finishRemoval handles
+bool UTree::removeEach(UNode* node, const vector<std::pair<string, int>>& keys, size_t start, size_t end,
+                       vector<Account>& removed) {
+    materialize(node);
+    for (size_t i = start; i < end; i++) {
+        DNode* found = nullptr;
+        //a repeated key finds its account vacant and is skipped
+        if (node->_dtree->remove(keys[i].second, found)) {
+            if (_cache != nullptr) {
+                _cache->erase(keys[i].first, keys[i].second);
+            }
+            removed.push_back(found->getAccount());
+        }
+    }
+    return node->_dtree->getNumUsers() == 0;
+}
+
+// Unlinks the UNodes compact() or removeEach() emptied, then reports the removals. Each
+// is unlinked in one descent, unless over 1/REMOVAL_REBUILD_RATIO of the usernames are
+// gone and a single rebuild of the UTree without them beats that many descents
+void UTree::finishRemoval(vector<UNode*>& emptied, const vector<Account>& removed) {
+    if (emptied.size() * REMOVAL_REBUILD_RATIO <= _numUsernames) {
+        //a UNode can take over its predecessor's DTree while unlinking, so go by username
+        vector<string> usernames;
+        for (UNode* node : emptied) {
+            usernames.emplace_back(usernameOf(node));
+        }
+        for (const string& username : usernames) {
+            unlinkNode(_root, username);
+        }
+    }
+    else {
+        std::sort(emptied.begin(), emptied.end());
+        vector<UNode*> nodes;
+        forEachNode(_root, [&](UNode* node) {
+            if (!std::binary_search(emptied.begin(), emptied.end(), node)) {
+                nodes.push_back(node);
+            }
+        });
+        _root = buildBalanced(nodes, 0, static_cast<int>(nodes.size()) - 1);
+        for (UNode* node : emptied) {
+            removeUsername(usernameOf(node));
+            dropLazyRange(node);
+            delete node;
+        }
+    }
+    for (const Account& account : removed) {
+        notifyRemoved(account);
+    }
+}
+
+// Descends to the UNode of a username and unlinks it, rebalancing on the way back up
+void UTree::unlinkNode(UNode*& node, const string& username) {
+    if (node == nullptr) {
+        return;
+    }
+    if (username > usernameOf(node)) {
+        unlinkNode(node->_right, username);
+    }
+    else if (username < usernameOf(node)) {
+        unlinkNode(node->_left, username);
+    }
+    else {
+        replaceVacantNode(node);
+    }
+    if (node != nullptr) {
+        updateHeight(node);
+        int heightDifference = checkImbalance(node);
+        if (heightDifference > 1 || heightDifference < -1) {
+            rebalance(node);
+        }
+    }
+}
+
+/**
+ * Changes the nitro, badge or status of an existing account in place. It is one
+ * descent to the account's DNode, where removeUser followed by insert would leave a
+ * vacant DNode behind and could rebalance the DTree.
+ * @param account account with the key to update and the new values
+ * @param fields UpdateField bits of the values to copy, the others are kept
+ * @return true if the account exists, false otherwise
+ */
+bool UTree::update(const Account& account, int fields) {
+    DNode* node = retrieveUser(account._username, account._disc);
+    if (node == nullptr) {
+        return false;
+    }
+    applyUpdate(node, account, fields);
+    return true;
+}
+
+/**
+ * Updates many accounts with one UTree descent per distinct username, e.g. to change
+ * the status of every account in a list. Has the same outcome as calling update on
+ * each account in order.
+ * @param accounts accounts with the keys to update and the new values
+ * @param fields UpdateField bits of the values to copy, the others are kept
+ * @return for each account, in the order given, true if it exists
+ */
+vector<bool> UTree::updateBatch(const vector<Account>& accounts, int fields) {
+    vector<size_t> order(accounts.size());
+    for (size_t i = 0; i < order.size(); i++) {
+        order[i] = i;
+    }
+    //stable, so updates of the same key keep their order
+    std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+        return accounts[a]._username < accounts[b]._username;
+    });
+
+    vector<bool> updated(accounts.size(), false);
+    size_t start = 0;
+    while (start < order.size()) {
+        const string& username = accounts[order[start]]._username;
+        size_t end = start;
+        while (end < order.size() && accounts[order[end]]._username == username) {
+            end++;
+        }
+        UNode* user = retrieve(username);
+        for (size_t i = start; user != nullptr && i < end; i++) {
+            DNode* node = user->_dtree->retrieve(accounts[order[i]]._disc);
+            if (node != nullptr) {
+                applyUpdate(node, accounts[order[i]], fields);
+                updated[order[i]] = true;
+            }
+        }
+        start = end;
+    }
+    return updated;
+}
+
+// Copies the selected values onto a stored account, true if that changed it.
+// The DNode stays where it is, so cached pointers to it remain valid
+bool UTree::applyUpdate(DNode* node, const Account& account, int fields) {
+    Account& stored = node->_account;
+    bool changed = ((fields & UPDATE_NITRO) && stored._nitro != account._nitro)
+                || ((fields & UPDATE_BADGE) && stored._badge != account._badge)
+                || ((fields & UPDATE_STATUS) && stored._status != account._status);
+    if (!changed) {
+        return false;
+    }
+    Account before = _observers.empty() ? Account() : stored;
+    if (fields & UPDATE_NITRO) {
+        stored.setNitro(account._nitro);
+    }
+    if (fields & UPDATE_BADGE) {
+        stored.setBadge(account._badge);
+    }
+    if (fields & UPDATE_STATUS) {
+        stored.setStatus(account._status);
+    }
+    notifyUpdated(before, stored);
+    return true;
+}
+
 /**
  * Retrieves a set of users within a UNode.
  * @param username username to match
  * @return UNode with a matching username, nullptr otherwise
  */
 UNode* UTree::retrieve(string username) {
-    if (_root == nullptr) {
+    if (_filter != nullptr && !_filter->mightContain(username)) {
         return nullptr;
     }
+    UNode* found = findNode(username);
+    if (found != nullptr) {
+        materialize(found);
+    }
+    return found;
+}
+
+// Finds the UNode of a username without building its DTree
+UNode* UTree::findNode(const string& username) const {
+    if (_index != nullptr) {
+        return _index->find(username);
+    }
     //start traversal process
     UNode* current = _root;
 
@@ -261,11 +1057,163 @@ UNode* UTree::retrieve(string username) {
  * @return DNode with a matching username and discriminator, nullptr otherwise
  */
 DNode* UTree::retrieveUser(string username, int disc) {
+    if (_cache != nullptr) {
+        DNode* cached = _cache->find(username, disc);
+        if (cached != nullptr) {
+            return cached;
+        }
+    }
     UNode* user = retrieve(username);
     if (user == nullptr) {
         return nullptr;
     }
-    return user->getDTree()->retrieve(disc);
+    DNode* found = user->getDTree()->retrieve(disc);
+    if (found != nullptr && _cache != nullptr) {
+        _cache->put(username, disc, found);
+    }
+    return found;
+}
+
+/**
+ * Looks up many accounts at once. A lookup is a chain of dependent cache misses
+ * (UNode, its DTree, the root DNode holding the username, then DNodes down to the
+ * discriminator), so instead of finishing one chain before starting the next,
+ * RETRIEVE_GROUP_SIZE lookups advance in turn one step each: every step prefetches
+ * what the lookup needs next and moves on to the other lookups while it arrives.
+ * A finished lookup's slot starts the next key right away.
+ * @param keys (username, discriminator) pairs to look up
+ * @return for each key, in order, what retrieveUser would return
+ */
+vector<DNode*> UTree::retrieveMany(const vector<std::pair<string, int>>& keys) {
+    enum Stage {AT_UNODE, AT_DTREE, AT_USERNAME, AT_DNODE, DONE};
+    struct Lookup {
+        size_t index;
+        Stage stage;
+        UNode* user;
+        DNode* account;
+    };
+    vector<DNode*> found(keys.size(), nullptr);
+    Lookup slots[RETRIEVE_GROUP_SIZE];
+    size_t next = 0;
+    size_t active = 0;
+
+    auto start = [&](Lookup& lookup) {
+        if (next >= keys.size()) {
+            lookup.stage = DONE;
+            return false;
+        }
+        lookup = {next++, AT_UNODE, _root, nullptr};
+        return true;
+    };
+    auto finish = [&](Lookup& lookup, DNode* result) {
+        found[lookup.index] = result;
+        if (!start(lookup)) {
+            active--;
+        }
+    };
+    for (Lookup& lookup : slots) {
+        active += start(lookup) ? 1 : 0;
+    }
+
+    while (active > 0) {
+        for (Lookup& lookup : slots) {
+            switch (lookup.stage) {
+                case AT_UNODE:
+                    if (lookup.user == nullptr) {
+                        finish(lookup, nullptr);
+                    }
+                    else if (lookup.user->isLazy()) {
+                        __builtin_prefetch(lookup.user->_lazyName.data());
+                        lookup.stage = AT_USERNAME;
+                    }
+                    else {
+                        __builtin_prefetch(lookup.user->_dtree);
+                        lookup.stage = AT_DTREE;
+                    }
+                    break;
+                case AT_DTREE:
+                    __builtin_prefetch(lookup.user->_dtree->getRoot());
+                    lookup.stage = AT_USERNAME;
+                    break;
+                case AT_USERNAME: {
+                    int order = string_view(keys[lookup.index].first).compare(usernameOf(lookup.user));
+                    if (order == 0) {
+                        materialize(lookup.user);
+                        lookup.account = lookup.user->_dtree->getRoot();
+                        lookup.stage = AT_DNODE;
+                    }
+                    else {
+                        lookup.user = (order < 0) ? lookup.user->_left : lookup.user->_right;
+                        __builtin_prefetch(lookup.user);
+                        lookup.stage = AT_UNODE;
+                    }
+                    break;
+                }
+                case AT_DNODE: {
+                    DNode* current = lookup.account;
+                    int disc = keys[lookup.index].second;
+                    if (current == nullptr) {
+                        finish(lookup, nullptr);
+                    }
+                    else if (disc == current->_account._disc) {
+                        finish(lookup, current->_vacant ? nullptr : current);
+                    }
+                    else {
+                        lookup.account = (disc < current->_account._disc) ? current->_left : current->_right;
+                        if (lookup.account != nullptr) {
+                            __builtin_prefetch(lookup.account);
+                            __builtin_prefetch(&lookup.account->_account._disc);
+                        }
+                    }
+                    break;
+                }
+                case DONE:
+                    break;
+            }
+        }
+    }
+    return found;
+}
+
+// Username of a UNode without copying it
+string_view UTree::usernameOf(const UNode* node) {
+    return node->isLazy() ? node->_lazyName : string_view(node->_dtree->getRoot()->_account._username);
+}
+
+/**
+ * Returns the accounts whose username starts with a prefix, walking only the part
+ * of the UTree that can hold such usernames. Lazy UNodes are read in place.
+ * @param prefix start of the usernames to match, "" matches every account
+ * @param limit most accounts to return, 0 for no limit
+ * @return matching accounts in username then discriminator order
+ */
+vector<Account> UTree::retrievePrefix(const string& prefix, size_t limit) const {
+    vector<Account> found;
+    retrievePrefix(_root, prefix, limit, found);
+    return found;
+}
+
+void UTree::retrievePrefix(UNode* node, const string& prefix, size_t limit, vector<Account>& found) const {
+    if (node == nullptr || (limit > 0 && found.size() >= limit)) {
+        return;
+    }
+    string_view username = usernameOf(node);
+    bool matches = username.substr(0, prefix.size()) == prefix;
+    //usernames left of a node smaller than prefix are smaller too
+    if (username >= prefix) {
+        retrievePrefix(node->_left, prefix, limit, found);
+    }
+    if (matches) {
+        forEachAccount(node, [&](const Account& account) {
+            if (limit == 0 || found.size() < limit) {
+                found.push_back(account);
+            }
+        });
+    }
+    //usernames right of a node past every match are past them too
+    if (matches || username < prefix) {
+        retrievePrefix(node->_right, prefix, limit, found);
+    }
 }
 
 /**
@@ -274,11 +1222,33 @@ DNode* UTree::retrieveUser(string username, int disc) {
  * @return number of users with the specified username
  */
 int UTree::numUsers(string username) {
-    UNode* user = retrieve(username);
+    if (_filter != nullptr && !_filter->mightContain(username)) {
+        return 0;
+    }
+    UNode* user = findNode(username);
     if (user == nullptr) {
         return 0;
     }
-    return user->getDTree()->getNumUsers();
+    return countAccounts(user);
+}
+
+/**
+ * Freezes the DTree of every username with many discriminators into a read-optimized
+ * array (see DTree::freeze). A DTree thaws by itself on its next insert or removal,
+ * so this can be called again whenever the tree has settled after a burst of writes.
+ * @param minAccounts smallest number of accounts a DTree needs to be frozen
+ * @return the number of DTrees frozen
+ */
+size_t UTree::freezeDTrees(int minAccounts) {
+    size_t numFrozen = 0;
+    forEachNode(_root, [&](UNode* node) {
+        //a lazy UNode is left for its first lookup to build
+        if (!node->isLazy() && node->_dtree->getNumUsers() >= minAccounts) {
+            node->_dtree->freeze();
+            numFrozen++;
+        }
+    });
+    return numFrozen;
 }
 
 /**
@@ -287,6 +1257,22 @@ int UTree::numUsers(string username) {
 void UTree::clear() {
     clear(_root);
     _root = nullptr;
+    _lazySource.close();
+    _lazyLines.clear();
+    _numLazy = 0;
+    _numUsernames = 0;
+    if (_cache != nullptr) {
+        _cache->clear();
+    }
+    if (_filter != nullptr) {
+        _filter->clear();
+    }
+    if (_index != nullptr) {
+        _index->clear();
+    }
+    for (UTreeObserver* observer : _observers) {
+        observer->treeCleared();
+    }
 }
 
 void UTree::clear(UNode* node){
@@ -303,6 +1289,7 @@ void UTree::clear(UNode* node){
  */
 void UTree::printUsers() const {
     printUsers(_root);
+    cout.flush();
 }
 
 void UTree::printUsers(UNode* node) const {
@@ -310,10 +1297,207 @@ void UTree::printUsers(UNode* node) const {
         return;
     }
     printUsers(node->_left);
-    node->getDTree()->printAccounts();
+    if (node->isLazy()) {
+        forEachAccount(node, [](const Account& account) {
+            cout << account << '\n';
+        });
+    }
+    else {
+        node->getDTree()->printAccounts();
+    }
     printUsers(node->_right);
 }
 
+// Visits every UNode in username order
+void UTree::forEachNode(UNode* node, const std::function<void(UNode*)>& visit) const {
+    if (node == nullptr) {
+        return;
+    }
+    forEachNode(node->_left, visit);
+    visit(node);
+    forEachNode(node->_right, visit);
+}
+
+/**
+ * Puts a bounded LRU cache of accounts in front of retrieveUser, for workloads where
+ * a few accounts take most lookups. Cached DNodes stay valid across rotations of
+ * either tree: UTree rotations move UNodes, which keep their DTree, and a DTree
+ * rebalance relinks the DNodes it keeps. Entries are dropped wherever DNodes are
+ * freed, rebuilt or made vacant: removals, the rebuilds of insertBatch, removeBatch
+ * and removeIf, and clearing or reloading the tree.
+ * @param capacity most accounts cached, replacing any cache already enabled
+ */
+void UTree::enableCache(size_t capacity) {
+    delete _cache;
+    _cache = new AccountCache(capacity);
+}
+
+/**
+ * Removes the cache enableCache set up, retrieveUser descends the trees every time.
+ */
+void UTree::disableCache() {
+    delete _cache;
+    _cache = nullptr;
+}
+
+/**
+ * Keeps a counting Bloom filter of the tree's usernames, so that retrieve, retrieveUser
+ * and numUsers answer for most missing usernames without descending the UTree. The
+ * filter follows every UNode created or deleted and is rebuilt, twice as large, once
+ * it holds more usernames than it was sized for.
+ * @param capacity usernames to size the filter for, at least twice the current number is used
+ */
+void UTree::enableUsernameFilter(size_t capacity) {
+    rebuildFilter(capacity);
+}
+
+/**
+ * Removes the filter enableUsernameFilter set up.
+ */
+void UTree::disableUsernameFilter() {
+    delete _filter;
+    _filter = nullptr;
+}
+
+/**
+ * Serves username lookups from a B+ tree of the UNodes instead of the AVL descent:
+ * retrieve, retrieveUser, numUsers, update and removeBatch find UNodes through it,
+ * while the AVL tree still owns the UNodes and keeps their order for inserts,
+ * removals and walks. The index follows every UNode created, deleted or handed
+ * another UNode's DTree.
+ * @param compressPrefixes true to store the bytes shared by the keys of a node once
+ */
+void UTree::enableUsernameIndex(bool compressPrefixes) {
+    delete _index;
+    _index = new UsernameIndex(compressPrefixes);
+    rebuildIndex();
+}
+
+/**
+ * Removes the index enableUsernameIndex set up, lookups descend the AVL tree again.
+ */
+void UTree::disableUsernameIndex() {
+    delete _index;
+    _index = nullptr;
+}
+
+// Counts a new UNode and records its username in the filter and index, if enabled
+void UTree::addUsername(string_view username, UNode* node) {
+    _numUsernames++;
+    if (_index != nullptr) {
+        _index->insert(username, node);
+    }
+    if (_filter == nullptr) {
+        return;
+    }
+    _filter->add(username);
+    if (_filter->isFull()) {
+        rebuildFilter(_filter->getCapacity() * 2);
+    }
+}
+
+// Forgets the username of a UNode about to be deleted
+void UTree::removeUsername(string_view username) {
+    _numUsernames--;
+    if (_index != nullptr) {
+        _index->erase(username);
+    }
+    if (_filter != nullptr) {
+        _filter->remove(username);
+    }
+}
+
+// Replaces the filter with one sized for at least twice the current usernames, holding all of them
+void UTree::rebuildFilter(size_t capacity) {
+    vector<UNode*> nodes;
+    forEachNode(_root, [&](UNode* node) {
+        nodes.push_back(node);
+    });
+    capacity = std::max({capacity, nodes.size() * 2, static_cast<size_t>(DEFAULT_FILTER_CAPACITY)});
+    delete _filter;
+    _filter = new UsernameFilter(capacity);
+    for (UNode* node : nodes) {
+        _filter->add(usernameOf(node));
+    }
+}
+
+// Fills the index with every UNode in one bottom-up build
+void UTree::rebuildIndex() {
+    vector<std::pair<string_view, UNode*>> sorted;
+    forEachNode(_root, [&](UNode* node) {
+        sorted.emplace_back(usernameOf(node), node);
+    });
+    _index->build(sorted);
+}
+
+// Rebuilds the filter and index that are enabled, after the UNodes were replaced wholesale
+void UTree::rebuildLookups(size_t numUsernames) {
+    _numUsernames = numUsernames;
+    if (_filter != nullptr) {
+        rebuildFilter(_filter->getCapacity());
+    }
+    if (_index != nullptr) {
+        rebuildIndex();
+    }
+}
+
+/**
+ * Registers an observer to be told about every later change to the tree's accounts.
+ * @param observer observer to add, it must outlive the tree or be removed first
+ */
+void UTree::addObserver(UTreeObserver* observer) {
+    if (std::find(_observers.begin(), _observers.end(), observer) == _observers.end()) {
+        _observers.push_back(observer);
+    }
+}
+
+/**
+ * Stops telling an observer about changes.
+ * @param observer observer to remove
+ */
+void UTree::removeObserver(UTreeObserver* observer) {
+    _observers.erase(std::remove(_observers.begin(), _observers.end(), observer), _observers.end());
+}
+
+void UTree::notifyInserted(const Account& account) {
+    for (UTreeObserver* observer : _observers) {
+        observer->accountInserted(account);
+    }
+}
+
+void UTree::notifyRemoved(const Account& account) {
+    for (UTreeObserver* observer : _observers) {
+        observer->accountRemoved(account);
+    }
+}
+
+void UTree::notifyUpdated(const Account& before, const Account& after) {
+    for (UTreeObserver* observer : _observers) {
+        observer->accountUpdated(before, after);
+    }
+}
+
+/**
+ * Reports every account in the tree to one observer as inserted, e.g. to fill an
+ * index attached after the tree was loaded. Lazy usernames are read from the
+ * source file without being built.
+ * @param observer observer to fill, it does not need to be attached
+ */
+void UTree::replayContents(UTreeObserver* observer) const {
+    forEachNode(_root, [&](UNode* node) {
+        forEachAccount(node, [&](const Account& account) {
+            observer->accountInserted(account);
+        });
+    });
+}
+
+// Reports every account as inserted, after the tree was rebuilt wholesale
+void UTree::notifyContents() {
+    for (UTreeObserver* observer : _observers) {
+        replayContents(observer);
+    }
+}
+
 /**
  * Dumps the UTree in the '()' notation.
  */
@@ -321,7 +1505,7 @@ void UTree::dump(UNode* node) const {
     if(node == nullptr) return;
     cout << "(";
     dump(node->_left);
-    cout << node->getUsername() << ":" << node->getHeight() << ":" << node->getDTree()->getNumUsers();
+    cout << node->getUsername() << ":" << node->getHeight() << ":" << countAccounts(node);
     dump(node->_right);
     cout << ")";
 }
@@ -331,13 +1515,11 @@ void UTree::dump(UNode* node) const {
  * @param node UNode object in which the height will be updated
  */
 void UTree::updateHeight(UNode* node) {
-    //use a post-order traversal to update the height of the tree
+    //children are updated before their parents, so only this node needs recomputing;
+    //walking the whole subtree made every insert and removal linear in the tree size
     if(node == nullptr){
         return;
     }
-    updateHeight(node->_left);
-    updateHeight(node->_right);
-
 
     // Check if _left or _right is nullptr before calling getHeight()
     int leftHeight = (node->_left != nullptr) ? node->_left->getHeight() : 0;
@@ -7,10 +7,35 @@
 #pragma once
 
 #include "dtree.h"
+#include "csvloader.h"
+#include "accountcache.h"
+#include "usernamefilter.h"
+#include "usernameindex.h"
 #include <fstream>
 #include <sstream>
 
 #define DEFAULT_HEIGHT 0
+#define EXPORT_BATCH_ACCOUNTS 16384     //accounts formatted per task by exportAccounts
+#define COLUMNAR_ROW_GROUP_SIZE 65536   //accounts per row group of exportColumnar
+#define RETRIEVE_GROUP_SIZE 16          //lookups retrieveMany keeps in flight
+#define BATCH_MERGE_RATIO 8             //insertBatch rebuilds a DTree unless it is this many times the new accounts
+#define FREEZE_MIN_ACCOUNTS 64          //smallest DTree freezeDTrees lays out as an array
+#define REMOVAL_COMPACT_RATIO 2         //removeBatch rebuilds a DTree once its keys reach 1/this of its accounts
+#define REMOVAL_REBUILD_RATIO 4         //removals rebuild the UTree once more than 1/this of its usernames empty
+
+/* Output formats of UTree::exportAccounts */
+enum ExportFormat {
+    EXPORT_CSV,     //the .csv layout loadData reads
+    EXPORT_JSONL    //one JSON object per line
+};
+
+/* Fields UTree::update copies onto a stored account, combined with | */
+enum UpdateField {
+    UPDATE_NITRO = 1,
+    UPDATE_BADGE = 2,
+    UPDATE_STATUS = 4,
+    UPDATE_ALL = UPDATE_NITRO | UPDATE_BADGE | UPDATE_STATUS
+};
 
 class Grader;   /* For grading purposes */
 class Tester;   /* Forward declaration for testing class */
@@ -25,6 +50,8 @@ public:
         _height = DEFAULT_HEIGHT;
         _left = nullptr;
         _right = nullptr;
+        _lazyBegin = 0;
+        _lazyCount = 0;
     }
 
     ~UNode() {
@@ -35,7 +62,8 @@ public:
     /* Getters */
     DTree*& getDTree() {return _dtree;}
     int getHeight() const {return _height;}
-    string getUsername() const {return _dtree->getUsername();}
+    string getUsername() const {return isLazy() ? string(_lazyName) : _dtree->getUsername();}
+    bool isLazy() const {return _lazyCount > 0;}
     //for testing
     UNode* getLeft() const {return _left;}
     UNode* getRight() const {return _right;}
@@ -45,17 +73,52 @@ private:
     int _height;
     UNode* _left;
     UNode* _right;
+    //set by loadDataLazy until the DTree is built: the username's records in the source
+    string_view _lazyName;
+    size_t _lazyBegin;      //first index into UTree::_lazyLines
+    int _lazyCount;         //records, one per discriminator, 0 once materialized
 
     /* IMPLEMENT (optional): Additional helper functions */
 
 };
 
+/* Hashes an account key, (username, discriminator), for unordered containers */
+struct AccountKeyHash {
+    size_t operator()(const std::pair<string, int>& key) const {
+        //multiplying spreads the discriminator over every bit before it is mixed in,
+        //where hash * 31 + disc only changed the low bits
+        uint64_t hash = std::hash<string>()(key.first);
+        hash ^= static_cast<uint64_t>(key.second) * 0x9E3779B97F4A7C15ULL + (hash << 6) + (hash >> 2);
+        return static_cast<size_t>(hash);
+    }
+};
+
+/**
+ * Receives every change made to the accounts of a UTree, e.g. to log or index them.
+ * Attach with UTree::addObserver; the tree does not own its observers. An
+ * observer only hears of changes made after it is attached, UTree::replayContents
+ * catches one attached to a loaded tree up with the accounts already there.
+ * An update keeps the account's key; observers that do not override
+ * accountUpdated see it as the old account removed and the new one inserted.
+ */
+class UTreeObserver {
+public:
+    virtual ~UTreeObserver() {}
+    virtual void accountInserted(const Account& account) = 0;
+    virtual void accountRemoved(const Account& account) = 0;
+    virtual void accountUpdated(const Account& before, const Account& after) {
+        accountRemoved(before);
+        accountInserted(after);
+    }
+    virtual void treeCleared() = 0;
+};
+
 class UTree {
     friend class Grader;
     friend class Tester;
 
 public:
-    UTree():_root(nullptr){}
+    UTree():_root(nullptr), _numLazy(0), _numUsernames(0), _cache(nullptr), _filter(nullptr), _index(nullptr){}
 
     /* IMPLEMENT: destructor */
     ~UTree();
@@ -63,16 +126,45 @@ public:
     /* IMPLEMENT: Basic operations */
 
     void loadData(string infile, bool append = true);
+    void loadDataParallel(string infile, bool append = true, unsigned int numThreads = 0);
+    void loadDataLazy(string infile);
     bool insert(Account newAcct);
+    vector<bool> insertBatch(vector<Account>&& accounts);
     bool removeUser(string username, int disc, DNode*& removed);
+    vector<Account> removeBatch(const vector<std::pair<string, int>>& keys);
+    vector<Account> removeIf(const std::function<bool(const Account&)>& predicate);
+    bool update(const Account& account, int fields = UPDATE_ALL);
+    vector<bool> updateBatch(const vector<Account>& accounts, int fields = UPDATE_ALL);
     UNode* retrieve(string username);
     DNode* retrieveUser(string username, int disc);
+    vector<DNode*> retrieveMany(const vector<std::pair<string, int>>& keys);
+    vector<Account> retrievePrefix(const string& prefix, size_t limit = 0) const;
     int numUsers(string username);
+    size_t freezeDTrees(int minAccounts = FREEZE_MIN_ACCOUNTS);
     void clear();
     void printUsers() const;
+    bool saveSnapshot(string outfile) const;
+    bool loadSnapshot(string infile);
+    bool exportAccounts(ostream& out, ExportFormat format = EXPORT_CSV, unsigned int numThreads = 0) const;
+    bool exportColumnar(string outfile, size_t rowGroupSize = COLUMNAR_ROW_GROUP_SIZE) const;
     void dump() const {dump(_root);}
     void dump(UNode* node) const;
 
+    size_t getNumLazy() const {return _numLazy;}
+
+    void enableCache(size_t capacity = DEFAULT_CACHE_CAPACITY);
+    void disableCache();
+    const AccountCache* getCache() const {return _cache;}
+    void enableUsernameFilter(size_t capacity = DEFAULT_FILTER_CAPACITY);
+    void disableUsernameFilter();
+    const UsernameFilter* getUsernameFilter() const {return _filter;}
+    void enableUsernameIndex(bool compressPrefixes = true);
+    void disableUsernameIndex();
+    const UsernameIndex* getUsernameIndex() const {return _index;}
+
+    void addObserver(UTreeObserver* observer);
+    void removeObserver(UTreeObserver* observer);
+    void replayContents(UTreeObserver* observer) const;
 
     /* IMPLEMENT: "Helper" functions */
     
@@ -86,15 +178,52 @@ public:
 
 private:
     UNode* _root;
+    vector<UTreeObserver*> _observers;
+    MappedFile _lazySource;     //file loadDataLazy read, kept mapped for lazy UNodes
+    vector<size_t> _lazyLines;  //line offsets into _lazySource, grouped per UNode by discriminator
+    size_t _numLazy;            //UNodes not materialized yet
+    size_t _numUsernames;       //UNodes in the tree
+    AccountCache* _cache;       //hot accounts for retrieveUser, nullptr unless enabled
+    UsernameFilter* _filter;    //usernames of every UNode, nullptr unless enabled
+    UsernameIndex* _index;      //B+ tree over the UNodes for findNode, nullptr unless enabled
 
     /* IMPLEMENT (optional): any additional helper functions here! */
     void clear(UNode* node);
     bool insert(UNode*& node, Account newAcct);
+    void insertNode(UNode*& node, UNode* newNode);
+    UNode* insertGroup(UNode*& node, const string& username, vector<Account>& fresh, bool& created);
+    void bulkLoad(vector<RecordView>& records);
+    UNode* buildBalanced(vector<UNode*>& nodes, int start, int end);
     bool removeUser(UNode*& node, string username, int disc, DNode*& removed);
+    UNode* findNode(const string& username) const;
+    static string_view usernameOf(const UNode* node);
+    void retrievePrefix(UNode* node, const string& prefix, size_t limit, vector<Account>& found) const;
+    void materialize(UNode* node);
+    void dropLazyRange(UNode* node);
+    bool compact(UNode* node, const std::function<bool(const Account&)>& matches, vector<Account>& removed);
+    bool removeEach(UNode* node, const vector<std::pair<string, int>>& keys, size_t start, size_t end,
+                    vector<Account>& removed);
+    bool applyUpdate(DNode* node, const Account& account, int fields);
+    void finishRemoval(vector<UNode*>& emptied, const vector<Account>& removed);
+    void unlinkNode(UNode*& node, const string& username);
+    int countAccounts(UNode* node) const;
+    void forEachAccount(UNode* node, const std::function<void(const Account&)>& visit) const;
+    bool formatAccounts(const vector<UNode*>& nodes, size_t start, size_t end, ExportFormat format, string& out) const;
     void replaceVacantNode(UNode*& node);
     void printUsers(UNode* node) const;
+    void forEachNode(UNode* node, const std::function<void(UNode*)>& visit) const;
+    static void parallelFor(size_t numTasks, unsigned int numThreads, const std::function<void(size_t)>& task);
     void zigLeft(UNode*& node);
     void zigRight(UNode*& node);
     void deleteRightMost(UNode*& node, DTree*& rightMost);
+    void addUsername(string_view username, UNode* node);
+    void removeUsername(string_view username);
+    void rebuildFilter(size_t capacity);
+    void rebuildIndex();
+    void rebuildLookups(size_t numUsernames);
+    void notifyInserted(const Account& account);
+    void notifyRemoved(const Account& account);
+    void notifyUpdated(const Account& before, const Account& after);
+    void notifyContents();
 
 };